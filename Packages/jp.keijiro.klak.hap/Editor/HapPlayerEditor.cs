@@ -10,6 +10,12 @@ sealed class HapPlayerEditor : Editor
         SerializedProperty _filePath;
         SerializedProperty _pathMode;
         SerializedProperty _hapAsset;
+        SerializedProperty _ioPolicy;
+        SerializedProperty _region;
+        SerializedProperty _decodeScale;
+        SerializedProperty _decodeAhead;
+        SerializedProperty _asyncSeek;
+        SerializedProperty _outputFormat;
 
         SerializedProperty _time;
         SerializedProperty _speed;
@@ -61,6 +67,12 @@ void OnEnable()
             _filePath = serializedObject.FindProperty("_filePath");
             _pathMode = serializedObject.FindProperty("_pathMode");
             _hapAsset = serializedObject.FindProperty("_hapAsset");
+            _ioPolicy = serializedObject.FindProperty("_ioPolicy");
+            _region = serializedObject.FindProperty("_region");
+            _decodeScale = serializedObject.FindProperty("_decodeScale");
+            _decodeAhead = serializedObject.FindProperty("_decodeAhead");
+            _asyncSeek = serializedObject.FindProperty("_asyncSeek");
+            _outputFormat = serializedObject.FindProperty("_outputFormat");
 
             _time = serializedObject.FindProperty("_time");
             _speed = serializedObject.FindProperty("_speed");
@@ -90,12 +102,18 @@ public override void OnInspectorGUI()
             EditorGUILayout.PropertyField(_hapAsset);
             EditorGUILayout.DelayedTextField(_filePath);
             EditorGUILayout.PropertyField(_pathMode);
+            EditorGUILayout.PropertyField(_ioPolicy);
+            EditorGUILayout.PropertyField(_region);
+            EditorGUILayout.PropertyField(_decodeScale);
+            EditorGUILayout.PropertyField(_decodeAhead);
+            EditorGUILayout.PropertyField(_outputFormat);
             reload = EditorGUI.EndChangeCheck();
 
             // Playback control
             EditorGUILayout.PropertyField(_time);
             EditorGUILayout.PropertyField(_speed);
             EditorGUILayout.PropertyField(_loop);
+            EditorGUILayout.PropertyField(_asyncSeek);
 
             // Target texture/renderer
             EditorGUILayout.PropertyField(_targetTexture);
@@ -0,0 +1,52 @@
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Native frame memory pool shared by all players. Frame buffers released
+    // by closed players are kept and reused, so opening another clip doesn't
+    // allocate and page-fault its frame memory again.
+    public static class BufferPool
+    {
+        #region Public properties
+
+        public static long cachedBytes { get {
+            KlakHap_GetBufferPoolState(out var bytes, out var blocks);
+            return bytes;
+        } }
+
+        public static int cachedBlockCount { get {
+            KlakHap_GetBufferPoolState(out var bytes, out var blocks);
+            return blocks;
+        } }
+
+        #endregion
+
+        #region Public methods
+
+        // Sets the size limit of the cached memory (256MB by default, 0
+        // disables caching). Huge pages (Linux/Android) and pre-faulting
+        // apply to the blocks allocated after the call.
+        public static void Configure
+          (int limitMB, bool hugePages = false, bool prefault = false)
+          => KlakHap_ConfigureBufferPool(limitMB, hugePages ? 1 : 0, prefault ? 1 : 0);
+
+        // Returns the cached memory to the OS.
+        public static void Trim()
+          => KlakHap_TrimBufferPool();
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_ConfigureBufferPool(int limitMB, int hugePages, int prefault);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_TrimBufferPool();
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_GetBufferPoolState(out long cachedBytes, out int cachedBlocks);
+
+        #endregion
+    }
+}
@@ -0,0 +1,62 @@
+using System.Runtime.InteropServices;
+using UnityEngine;
+
+namespace Klak.Hap
+{
+    // Opens upcoming clips in the background and keeps a bounded number of
+    // them warm, so that switching to them doesn't stall the main thread
+    public static class ClipPool
+    {
+        #region Public properties
+
+        // Maximum number of warm clips (8 by default, 0 disables the pool)
+        public static int capacity { set => KlakHap_SetClipPoolCapacity(value); }
+
+        public static int warmCount { get {
+            KlakHap_GetClipPoolState(out var warm, out var pending);
+            return warm;
+        } }
+
+        public static int pendingCount { get {
+            KlakHap_GetClipPoolState(out var warm, out var pending);
+            return pending;
+        } }
+
+        #endregion
+
+        #region Public methods
+
+        // Hints a clip that is going to be played soon. It returns
+        // immediately; the clip is opened on a background thread.
+        public static void Prewarm
+          (string filePath, HapPlayer.PathMode pathMode = HapPlayer.PathMode.StreamingAssets)
+        {
+            if (pathMode == HapPlayer.PathMode.StreamingAssets)
+                filePath = System.IO.Path.Combine(Application.streamingAssetsPath, filePath);
+            KlakHap_PrewarmClip(filePath);
+        }
+
+        // Releases the warm clips (the ones in use stay open).
+        public static void Clear()
+          => KlakHap_ClearClipPool();
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_SetClipPoolCapacity(int capacity);
+
+        [DllImport(NativeLibrary.Name, CharSet = CharSet.Ansi)]
+        static extern void KlakHap_PrewarmClip
+          ([MarshalAs(UnmanagedType.LPUTF8Str)] string filepath);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_ClearClipPool();
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_GetClipPoolState(out int warm, out int pending);
+
+        #endregion
+    }
+}
@@ -2,6 +2,22 @@ namespace Klak.Hap
 {
     public enum CodecType { Unsupported, Hap, HapQ, HapAlpha }
 
+    // File I/O policy for frame reads (shared with the native plugin)
+    public enum IOPolicy { Buffered, Prefetch, Streaming, Direct, Mapped }
+
+    // Reduced-resolution decode mode (shared with the native plugin)
+    public enum DecodeScale { Full, Half, Quarter, BlockAverage }
+
+    // Decoder output format (shared with the native plugin). Default is the
+    // HAP texture format (RGBA32 on mobile platforms). ETC2 and ASTC
+    // transcode the frames for GPUs without BC support, and the rest expand
+    // them into uncompressed pixels.
+    public enum OutputFormat { Default, ETC2, ASTC, RGBA32, BGRA32, RGB565, RGBA4444, R8 }
+
+    // Instruction set variant of the decoder kernels (shared with the
+    // native plugin)
+    public enum CpuVariant { Baseline, SSSE3, AVX2 }
+
     internal static class NativeLibrary
     {
 #if UNITY_IOS && !UNITY_EDITOR
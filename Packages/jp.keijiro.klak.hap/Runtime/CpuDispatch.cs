@@ -0,0 +1,23 @@
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Reports the instruction set variant of the decoder kernels, which the
+    // native plugin selects for the CPU at load time
+    public static class CpuDispatch
+    {
+        #region Public properties
+
+        public static CpuVariant activeVariant
+          => (CpuVariant)KlakHap_GetCpuVariant();
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern int KlakHap_GetCpuVariant();
+
+        #endregion
+    }
+}
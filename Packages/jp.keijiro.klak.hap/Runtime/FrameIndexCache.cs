@@ -0,0 +1,28 @@
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Sidecar frame index files that let clips skip the MP4 index parsing
+    public static class FrameIndexCache
+    {
+        #region Public methods
+
+        // Enables the frame index. The index files are written next to the
+        // video files when no cache directory is given.
+        public static void Enable(string cacheDirectory = null)
+          => KlakHap_SetFrameIndexMode(1, cacheDirectory);
+
+        public static void Disable()
+          => KlakHap_SetFrameIndexMode(0, null);
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name, CharSet = CharSet.Ansi)]
+        static extern void KlakHap_SetFrameIndexMode
+          (int enable, [MarshalAs(UnmanagedType.LPUTF8Str)] string directory);
+
+        #endregion
+    }
+}
@@ -21,6 +21,12 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
         [SerializeField] PathMode _pathMode = PathMode.StreamingAssets;
         [SerializeField] string _filePath = "";
         [SerializeField] TextAsset _hapAsset = null;
+        [SerializeField] IOPolicy _ioPolicy = IOPolicy.Buffered;
+        [SerializeField] RectInt _region = new RectInt(0, 0, 0, 0);
+        [SerializeField] DecodeScale _decodeScale = DecodeScale.Full;
+        [SerializeField, Range(0, 16)] int _decodeAhead = 0;
+        [SerializeField] bool _asyncSeek = false;
+        [SerializeField] OutputFormat _outputFormat = OutputFormat.Default;
 
         [SerializeField] float _time = 0;
         [SerializeField, Range(-10, 10)] float _speed = 1;
@@ -69,6 +75,47 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
             set { _hapAsset = value; }
         }
 
+        public IOPolicy ioPolicy {
+            get { return _ioPolicy; }
+            set { _ioPolicy = value; }
+        }
+
+        // Region of interest in the frame (an empty rect = the whole frame).
+        // It's applied when the stream is opened.
+        public RectInt region {
+            get { return _region; }
+            set { _region = value; }
+        }
+
+        // Reduced-resolution decoding. It's applied when the stream is opened.
+        public DecodeScale decodeScale {
+            get { return _decodeScale; }
+            set { _decodeScale = value; }
+        }
+
+        // Number of frames decoded ahead of the playhead (0 = decode on
+        // demand). It's applied when the stream is opened.
+        public int decodeAhead {
+            get { return _decodeAhead; }
+            set { _decodeAhead = value; }
+        }
+
+        // Seeks without blocking in play mode: The current frame is kept
+        // until the target frame is ready. Consecutive seeks coalesce into
+        // the latest one. Edit mode (e.g. Timeline scrubbing) always waits
+        // for the exact frame.
+        public bool asyncSeek {
+            get { return _asyncSeek; }
+            set { _asyncSeek = value; }
+        }
+
+        // Decoder output format (Default = ASTC or ETC2 on mobile GPUs without
+        // BC support). It's applied when the stream is opened.
+        public OutputFormat outputFormat {
+            get { return _outputFormat; }
+            set { _outputFormat = value; }
+        }
+
         #endregion
 
         #region Read-only properties
@@ -90,8 +137,21 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
                 return _filePath;
         } }
 
+        public RectInt decodedRegion { get {
+            return _decoder?.Region ?? new RectInt(0, 0, 0, 0);
+        } }
+
         public Texture2D texture { get { return _texture; } }
 
+        public bool isSeeking { get { return _decoder?.IsSeeking ?? false; } }
+
+        // Read-ahead statistics: Frames read from the file, frames skipped
+        // because they wouldn't be shown at the current speed and update
+        // rate, and frames read but dropped without being shown.
+        public int readFrameCount { get { return GetReadStats().read; } }
+        public int skippedFrameCount { get { return GetReadStats().skipped; } }
+        public int droppedFrameCount { get { return GetReadStats().dropped; } }
+
         #endregion
 
         #region Public methods
@@ -126,11 +186,27 @@ public void UpdateNow()
 
         float _storedTime;
         float _storedSpeed;
+        float _storedInterval;
+
+        // Expected interval between updates. The read-ahead steps by the
+        // playback time per update, so that it only reads the frames that
+        // are going to be shown.
+        float UpdateInterval { get {
+            if (!Application.isPlaying) return 1.0f / 60;
+            return Mathf.Clamp(Time.smoothDeltaTime, 1.0f / 1000, 0.25f);
+        } }
+
+        (int read, int skipped, int dropped) GetReadStats()
+        {
+            if (_decoder == null) return (0, 0, 0);
+            _decoder.GetReadStats(out var read, out var skipped, out var dropped);
+            return (read, skipped, dropped);
+        }
 
         void OpenInternal()
         {
             // Demuxer instantiation
-            _demuxer = new Demuxer(resolvedFilePath);
+            _demuxer = new Demuxer(resolvedFilePath, _ioPolicy);
 
             if (!_demuxer.IsValid)
             {
@@ -146,20 +222,39 @@ void OpenInternal()
                 return;
             }
 
-            // Stream reader instantiation
-            _stream = new StreamReader(_demuxer, _time, _speed / 60);
-            (_storedTime, _storedSpeed) = (_time, _speed);
+            // Region of interest (has to be set before reading frames)
+            _demuxer.SetRegion(_region);
+
+            _storedInterval = UpdateInterval;
+            var delta = _speed * _storedInterval;
+            var outputFormat = Utility.DetermineOutputFormat(_demuxer.VideoType, _outputFormat);
+
+            if (_decodeAhead > 0)
+            {
+                // Decoder instantiation with a decode-ahead ring
+                _decoder = new Decoder(_demuxer, _decodeAhead, _region, _decodeScale, outputFormat);
+                _decoder.Restart(_time, delta);
+            }
+            else
+            {
+                // Stream reader instantiation
+                _stream = new StreamReader(_demuxer, _time, delta);
+
+                // Decoder instantiation
+                _decoder = new Decoder(
+                    _stream, _demuxer.Width, _demuxer.Height, _demuxer.VideoType,
+                    _region, _decodeScale, outputFormat
+                );
+            }
 
-            // Decoder instantiation
-            _decoder = new Decoder(
-                _stream, _demuxer.Width, _demuxer.Height, _demuxer.VideoType
-            );
+            (_storedTime, _storedSpeed) = (_time, _speed);
 
-            // Texture initialization
-            _texture = new Texture2D(
-                _demuxer.Width, _demuxer.Height,
-                Utility.DetermineTextureFormat(_demuxer.VideoType, _demuxer.Width, _demuxer.Height), false
-            );
+            // Texture initialization (with the decoder output size)
+            var size = _decoder.OutputSize;
+            var format = _decoder.Scale == DecodeScale.BlockAverage ?
+                TextureFormat.RGBA32 :
+                Utility.DetermineTextureFormat(_demuxer.VideoType, _decoder.Format, size.x, size.y);
+            _texture = new Texture2D(size.x, size.y, format, false);
             _texture.wrapMode = TextureWrapMode.Clamp;
             _texture.hideFlags = HideFlags.DontSave;
 
@@ -180,7 +275,7 @@ void UpdateTargetTexture()
             // Material lazy initialization
             if (_blitMaterial == null)
             {
-                _blitMaterial = new Material(Utility.DetermineBlitShader(_demuxer.VideoType));
+                _blitMaterial = new Material(Utility.DetermineBlitShader(_demuxer.VideoType, _texture.format));
                 _blitMaterial.hideFlags = HideFlags.DontSave;
             }
 
@@ -319,13 +414,39 @@ void LateUpdate()
             var t = _loop ? _time : Mathf.Clamp(_time, 0, duration - 1e-4f);
 
             // Determine if background decoding is available.
-            // Resync shouldn't happen. Not preferable in edit mode.
-            var bgdec = !resync && Application.isPlaying;
-
-            // Restart the stream reader on resync.
-            if (resync) _stream.Restart(t, _speed / 60);
+            // Resync shouldn't happen unless seeking asynchronously. Not
+            // preferable in edit mode.
+            var asyncSeek = _asyncSeek && Application.isPlaying;
+            var bgdec = (!resync || asyncSeek) && Application.isPlaying;
+
+            // Restart the stream reader (or the decode-ahead ring) on resync.
+            // Otherwise, follow the update rate when it changed noticeably.
+            var interval = UpdateInterval;
+            if (resync)
+            {
+                _decoder.Restart(t, _speed * interval, !asyncSeek);
+                _storedInterval = interval;
+            }
+            else if (Mathf.Abs(interval - _storedInterval) > _storedInterval * 0.25f)
+            {
+                _decoder.Retime(t, _speed * interval);
+                _storedInterval = interval;
+            }
 
-            if (TextureUpdater.AsyncSupport)
+            if (_decoder.DecodesAhead)
+            {
+                // Decode-ahead ring: Pick the decoded frame and update the
+                // texture only when it changed. It only waits for decoding
+                // on (synchronous) resync.
+                if (_decoder.Present(t, !bgdec))
+                {
+                    if (TextureUpdater.AsyncSupport)
+                        _updater.RequestAsyncUpdate();
+                    else
+                        _updater.UpdateNow();
+                }
+            }
+            else if (TextureUpdater.AsyncSupport)
             {
                 // Asynchronous texture update supported:
                 // Decode a frame and request a texture update.
@@ -345,9 +466,9 @@ void LateUpdate()
             #endif
             else
             {
-                // Synchronous decoding and texture update.
-                _decoder.UpdateSync(t);
-                _updater.UpdateNow();
+                // Synchronous decoding and texture update: The frame is
+                // decoded straight into the texture memory.
+                _updater.DecodeAndUpdateNow(t);
             }
 
             // Update the stored time.
@@ -1,6 +1,7 @@
 using System;
 using System.Runtime.InteropServices;
 using System.Threading;
+using UnityEngine;
 
 namespace Klak.Hap
 {
@@ -8,14 +9,13 @@ internal sealed class Decoder : IDisposable
     {
         #region Initialization/finalization
 
-        public Decoder(StreamReader stream, int width, int height, int videoType)
+        public Decoder(StreamReader stream, int width, int height, int videoType,
+                       RectInt region, DecodeScale scale = DecodeScale.Full,
+                       OutputFormat format = OutputFormat.Default)
         {
             _stream = stream;
 
-            // Plugin initialization
-            _plugin = KlakHap_CreateDecoder(width, height, videoType);
-            _id = ++_instantiationCount;
-            KlakHap_AssignDecoder(_id, _plugin);
+            InitializePlugin(width, height, videoType, region, scale, format);
 
             // By default, start from the first frame.
             _time = 0;
@@ -27,8 +27,47 @@ public Decoder(StreamReader stream, int width, int height, int videoType)
             _thread.Start();
         }
 
+        // Decode-ahead mode: A native ring decodes the frames ahead of the
+        // playhead, which replaces the stream reader and the decoder thread.
+        public Decoder(Demuxer demuxer, int decodeAhead,
+                       RectInt region, DecodeScale scale = DecodeScale.Full,
+                       OutputFormat format = OutputFormat.Default)
+        {
+            InitializePlugin(demuxer.Width, demuxer.Height, demuxer.VideoType, region, scale, format);
+            _ring = KlakHap_CreateDecodeRing(demuxer.PluginPointer, _plugin, decodeAhead);
+        }
+
+        void InitializePlugin(int width, int height, int videoType,
+                              RectInt region, DecodeScale scale, OutputFormat format)
+        {
+            // Plugin initialization
+            _plugin = KlakHap_CreateScaledDecoder(width, height, videoType, (int)scale);
+            _id = ++_instantiationCount;
+            KlakHap_AssignDecoder(_id, _plugin);
+
+            // Region of interest (snapped to the block grid by the plugin)
+            KlakHap_SetDecoderRegion(_plugin, region.x, region.y, region.width, region.height);
+            KlakHap_GetDecoderRegion(_plugin, out var x, out var y, out var w, out var h);
+            _region = new RectInt(x, y, w, h);
+
+            // Decode scale (it can fall back to Full) and the output size
+            _scale = (DecodeScale)KlakHap_GetDecoderScale(_plugin);
+            KlakHap_GetDecoderOutputSize(_plugin, out w, out h);
+            _outputSize = new Vector2Int(w, h);
+
+            // Output format (it can fall back to Default)
+            _format = (OutputFormat)KlakHap_SetDecoderOutputFormat(_plugin, (int)format);
+        }
+
         public void Dispose()
         {
+            // The ring refers to the decoder, so it goes first.
+            if (_ring != IntPtr.Zero)
+            {
+                KlakHap_DestroyDecodeRing(_ring);
+                _ring = IntPtr.Zero;
+            }
+
             if (_thread != null)
             {
                 _terminate = true;
@@ -51,10 +90,80 @@ public void Dispose()
 
         public uint CallbackID { get { return _id; } }
 
+        public RectInt Region { get { return _region; } }
+        public DecodeScale Scale { get { return _scale; } }
+        public OutputFormat Format { get { return _format; } }
+        public Vector2Int OutputSize { get { return _outputSize; } }
+
         public int BufferSize { get {
             return KlakHap_GetDecoderBufferSize(_plugin);
         } }
 
+        public bool DecodesAhead { get { return _ring != IntPtr.Zero; } }
+
+        // Restarts the frame schedule of the decode-ahead ring or the stream
+        // reader. With wait = false, it returns immediately (asynchronous
+        // seek) and the current frame is kept until the target is ready.
+        public void Restart(float time, float delta, bool wait = true)
+        {
+            if (_ring != IntPtr.Zero)
+            {
+                if (wait)
+                    KlakHap_RestartDecodeRing(_ring, time, delta);
+                else
+                    KlakHap_SeekDecodeRing(_ring, time, delta);
+            }
+            else
+            {
+                _stream.Restart(time, delta, wait);
+            }
+        }
+
+        // True while an asynchronous seek hasn't reached its target frame
+        public bool IsSeeking { get {
+            if (_ring != IntPtr.Zero)
+                return KlakHap_DecodeRingIsSeeking(_ring) != 0;
+            else
+                return _stream.IsSeeking;
+        } }
+
+        // Changes the time step per update, keeping the frames read so far
+        // (the decode-ahead ring keeps the ones still on the new schedule).
+        public void Retime(float time, float delta)
+        {
+            if (_ring != IntPtr.Zero)
+                KlakHap_RestartDecodeRing(_ring, time, delta);
+            else
+                _stream.Retime(delta);
+        }
+
+        // Read statistics of the stream reader or the decode-ahead ring
+        public void GetReadStats(out int read, out int skipped, out int dropped)
+        {
+            if (_ring != IntPtr.Zero)
+            {
+                KlakHap_GetDecodeRingStats(_ring, out read, out skipped, out dropped);
+            }
+            else
+            {
+                read = _stream.ReadFrameCount;
+                skipped = _stream.SkippedFrameCount;
+                dropped = _stream.DroppedFrameCount;
+            }
+        }
+
+        // Decode-ahead mode: Picks the decoded frame for a given time. When
+        // it isn't ready, it waits for it (the first frame is always waited
+        // for) or keeps the latest one behind the playhead. Returns true
+        // when the output buffer was updated.
+        public bool Present(float time, bool wait)
+        {
+            wait |= !_presented;
+            var updated = KlakHap_PresentDecodeRing(_ring, time, wait ? 1 : 0) != 0;
+            _presented |= updated;
+            return updated;
+        }
+
         public void UpdateSync(float time)
         {
             _time = time;
@@ -63,6 +172,17 @@ public void UpdateSync(float time)
                 KlakHap_DecodeFrame(_plugin, buffer.PluginPointer);
         }
 
+        // Synchronous decoding straight into an external buffer. Returns
+        // true when a new frame was written into it.
+        public bool UpdateSyncInto(float time, IntPtr dest, int size)
+        {
+            _time = time;
+            var buffer = _stream.Advance(_time);
+            if (buffer == null) return false;
+            return KlakHap_DecodeFrameInto
+              (_plugin, buffer.PluginPointer, dest, size, 0) != 0;
+        }
+
         public void UpdateAsync(float time)
         {
             _time = time;
@@ -87,7 +207,13 @@ public void UnlockBuffer()
         static uint _instantiationCount;
 
         IntPtr _plugin;
+        IntPtr _ring;
+        bool _presented;
         uint _id;
+        RectInt _region;
+        DecodeScale _scale;
+        OutputFormat _format;
+        Vector2Int _outputSize;
 
         Thread _thread;
         (AutoResetEvent req, AutoResetEvent ack) _resume;
@@ -123,6 +249,9 @@ void DecoderThread()
         [DllImport(NativeLibrary.Name)]
         internal static extern IntPtr KlakHap_CreateDecoder(int width, int height, int typeID);
 
+        [DllImport(NativeLibrary.Name)]
+        internal static extern IntPtr KlakHap_CreateScaledDecoder(int width, int height, int typeID, int scale);
+
         [DllImport(NativeLibrary.Name)]
         internal static extern void KlakHap_DestroyDecoder(IntPtr decoder);
 
@@ -132,6 +261,48 @@ void DecoderThread()
         [DllImport(NativeLibrary.Name)]
         internal static extern void KlakHap_DecodeFrame(IntPtr decoder, IntPtr input);
 
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_DecodeFrameInto(IntPtr decoder, IntPtr input, IntPtr dest, int destSize, int rowPitch);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_SetDecoderRegion(IntPtr decoder, int x, int y, int width, int height);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_GetDecoderRegion(IntPtr decoder, out int x, out int y, out int width, out int height);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_GetDecoderScale(IntPtr decoder);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_SetDecoderOutputFormat(IntPtr decoder, int format);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_GetDecoderOutputFormat(IntPtr decoder);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_GetDecoderOutputSize(IntPtr decoder, out int width, out int height);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern IntPtr KlakHap_CreateDecodeRing(IntPtr demuxer, IntPtr decoder, int capacity);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_DestroyDecodeRing(IntPtr ring);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_RestartDecodeRing(IntPtr ring, double time, double delta);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_SeekDecodeRing(IntPtr ring, double time, double delta);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_DecodeRingIsSeeking(IntPtr ring);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_PresentDecodeRing(IntPtr ring, double time, int wait);
+
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_GetDecodeRingStats(IntPtr ring, out int read, out int skipped, out int dropped);
+
         [DllImport(NativeLibrary.Name)]
         internal static extern IntPtr KlakHap_LockDecoderBuffer(IntPtr decoder);
 
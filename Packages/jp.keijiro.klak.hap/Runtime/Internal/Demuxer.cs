@@ -1,5 +1,6 @@
 using System;
 using System.Runtime.InteropServices;
+using UnityEngine;
 
 namespace Klak.Hap
 {
@@ -8,17 +9,19 @@ internal sealed class Demuxer : IDisposable
         #region Public properties
 
         public bool IsValid { get { return _plugin != IntPtr.Zero; } }
+        public IntPtr PluginPointer { get { return _plugin; } }
         public int Width { get { return _width; } }
         public int Height { get { return _height; } }
         public int VideoType { get { return _videoType; } }
         public double Duration { get { return _duration; } }
         public int FrameCount { get { return _frameCount; } }
+        public IOPolicy IOPolicy { get { return _ioPolicy; } }
 
         #endregion
 
         #region Initialization/finalization
 
-        public Demuxer(string filePath)
+        public Demuxer(string filePath, IOPolicy ioPolicy = IOPolicy.Buffered)
         {
             _plugin = KlakHap_OpenDemuxer(filePath);
 
@@ -36,6 +39,9 @@ public Demuxer(string filePath)
             _videoType = KlakHap_AnalyzeVideoType(_plugin);
             _duration = KlakHap_GetDuration(_plugin);
             _frameCount = KlakHap_CountFrames(_plugin);
+
+            // I/O policy (it can fall back to another policy)
+            _ioPolicy = (IOPolicy)KlakHap_SetDemuxerIOPolicy(_plugin, (int)ioPolicy);
         }
 
         public void Dispose()
@@ -51,6 +57,11 @@ public void Dispose()
 
         #region Public methods
 
+        // Region of interest: Only the chunks covering the region are read.
+        // This has to be set before starting reading frames.
+        public void SetRegion(RectInt region)
+          => KlakHap_SetDemuxerRegion(_plugin, region.x, region.y, region.width, region.height);
+
         public void ReadFrame(ReadBuffer buffer, int index, float time)
         {
             KlakHap_ReadFrame(_plugin, index, buffer.PluginPointer);
@@ -66,6 +77,7 @@ public void ReadFrame(ReadBuffer buffer, int index, float time)
         int _width, _height, _videoType;
         double _duration;
         int _frameCount;
+        IOPolicy _ioPolicy;
 
         #endregion
 
@@ -80,6 +92,9 @@ public void ReadFrame(ReadBuffer buffer, int index, float time)
         [DllImport(NativeLibrary.Name)]
         internal static extern int KlakHap_DemuxerIsValid(IntPtr demuxer);
 
+        [DllImport(NativeLibrary.Name)]
+        internal static extern int KlakHap_SetDemuxerIOPolicy(IntPtr demuxer, int policy);
+
         [DllImport(NativeLibrary.Name)]
         internal static extern int KlakHap_CountFrames(IntPtr demuxer);
 
@@ -92,6 +107,9 @@ public void ReadFrame(ReadBuffer buffer, int index, float time)
         [DllImport(NativeLibrary.Name)]
         internal static extern int KlakHap_GetVideoHeight(IntPtr demuxer);
 
+        [DllImport(NativeLibrary.Name)]
+        internal static extern void KlakHap_SetDemuxerRegion(IntPtr demuxer, int x, int y, int width, int height);
+
         [DllImport(NativeLibrary.Name)]
         internal static extern int KlakHap_AnalyzeVideoType(IntPtr demuxer);
 
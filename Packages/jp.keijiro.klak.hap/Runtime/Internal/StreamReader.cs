@@ -75,10 +75,22 @@ public void Dispose()
             }
         }
 
-        public void Restart(float time, float delta)
+        // Restarts reading from a given time. With wait = false, it returns
+        // without waiting for the reader thread (asynchronous seek): Advance
+        // keeps the current frame until the target frame is read. Requests
+        // made before the reader thread picks them up coalesce into the
+        // latest one, and a frame being read for an older target is dropped.
+        public void Restart(float time, float delta, bool wait = true)
         {
             // Restart request
             lock (_restartLock) _restart = (time, SafeDelta(delta));
+            Volatile.Write(ref _seeking, true);
+
+            if (!wait)
+            {
+                _updateEvent.Set();
+                return;
+            }
 
             // Wait for reset/read on the reader thread.
             _readEvent.Reset();
@@ -89,6 +101,27 @@ public void Restart(float time, float delta)
             }
         }
 
+        // Changes the time step per update without flushing the frames read
+        // so far. It's used when the update rate changes.
+        public void Retime(float delta)
+        {
+            lock (_restartLock) _retime = SafeDelta(delta);
+        }
+
+        // True until the target frame of the last restart is returned from
+        // Advance
+        public bool IsSeeking => Volatile.Read(ref _seeking);
+
+        // Frames read from the file
+        public int ReadFrameCount => Volatile.Read(ref _readCount);
+
+        // Frames passed over by the read-ahead (not shown at this speed)
+        public int SkippedFrameCount => Volatile.Read(ref _skippedCount);
+
+        // Frames read but passed over without being shown (the update rate
+        // was lower than expected)
+        public int DroppedFrameCount => _droppedCount;
+
         public ReadBuffer Advance(float time)
         {
             // Add an epsilon-ish value to avoid rounding error.
@@ -96,6 +129,17 @@ public ReadBuffer Advance(float time)
 
             var changed = false;
 
+            // Pending restart: The lead queue is going to be flushed, so
+            // the frames in it aren't shown.
+            lock (_restartLock)
+            {
+                if (_restart != null)
+                {
+                    _updateEvent.Set();
+                    return null;
+                }
+            }
+
             // There is no slow path in this function, so we prefer holding
             // the queue lock for the entire function block rather than
             // acquiring/releasing it for each operation.
@@ -123,6 +167,7 @@ public ReadBuffer Advance(float time)
 
                         // Free the current frame before replacing it.
                         _freeBuffers.Add(_current);
+                        if (changed) _droppedCount++;
                     }
 
                     _current = _leadQueue.Dequeue();
@@ -133,6 +178,8 @@ public ReadBuffer Advance(float time)
             // Poke the reader thread.
             _updateEvent.Set();
 
+            if (changed) Volatile.Write(ref _seeking, false);
+
             // Only returns a buffer object when the frame was changed.
             return changed ? _current : null;
         }
@@ -158,8 +205,15 @@ public ReadBuffer Advance(float time)
 
         // Restart request
         (float, float)? _restart;
+        float? _retime;
+        bool _seeking;
         readonly object _restartLock = new object();
 
+        // Read statistics
+        int _readCount;
+        int _skippedCount;
+        int _droppedCount;
+
         // Used to avoid too small delta time values.
         float SafeDelta(float delta)
         {
@@ -181,22 +235,36 @@ void ReaderThread()
             var totalTime = _demuxer.Duration;
             var totalFrames = _demuxer.FrameCount;
 
+            // Last frame count pushed to the lead queue (null = restarted)
+            int? lastFrameCount = null;
+
             while (true)
             {
                 // Synchronization with the parent thread
                 _updateEvent.WaitOne();
                 if (_terminate) break;
 
-                // Check if there is a restart request.
-                lock (_restartLock) if (_restart != null)
+                lock (_restartLock)
                 {
-                    // Flush out the current contents of the lead queue.
-                    lock (_queueLock) while (_leadQueue.Count > 0)
-                        _freeBuffers.Add(_leadQueue.Dequeue());
+                    // Apply the time step change from the next frame.
+                    if (_retime != null)
+                    {
+                        delta = _retime.Value;
+                        _retime = null;
+                    }
 
-                    // Apply the restart request.
-                    (time, delta) = _restart.Value;
-                    _restart = null;
+                    // Check if there is a restart request.
+                    if (_restart != null)
+                    {
+                        // Flush out the current contents of the lead queue.
+                        lock (_queueLock) while (_leadQueue.Count > 0)
+                            _freeBuffers.Add(_leadQueue.Dequeue());
+
+                        // Apply the restart request.
+                        (time, delta) = _restart.Value;
+                        _restart = null;
+                        lastFrameCount = null;
+                    }
                 }
 
                 // Time -> Frame count
@@ -249,7 +317,27 @@ void ReaderThread()
 
                         // Frame data read
                         _demuxer.ReadFrame(buffer, frameNumber, snappedTime);
+                        Interlocked.Increment(ref _readCount);
+                    }
+
+                    // Superseded by a restart request meanwhile: Drop it.
+                    lock (_restartLock)
+                    {
+                        if (_restart != null)
+                        {
+                            _freeBuffers.Add(buffer);
+                            continue;
+                        }
+                    }
+
+                    // The frames between the steps are never shown, so
+                    // they aren't read.
+                    if (lastFrameCount != null)
+                    {
+                        var gap = Math.Abs(frameCount - lastFrameCount.Value) - 1;
+                        if (gap > 0) Interlocked.Add(ref _skippedCount, gap);
                     }
+                    lastFrameCount = frameCount;
 
                     // Push the buffer to the lead queue.
                     _leadQueue.Enqueue(buffer);
@@ -1,5 +1,6 @@
 using System;
 using System.Runtime.InteropServices;
+using Unity.Collections.LowLevel.Unsafe;
 using UnityEngine;
 using UnityEngine.Rendering;
 
@@ -52,6 +53,26 @@ public void UpdateNow()
             _decoder.UnlockBuffer();
         }
 
+        // Synchronous decoding into the texture memory: This skips the
+        // intermediate buffer and the copy in LoadRawTextureData. It falls
+        // back to UpdateNow when the raw data doesn't match the decoder
+        // output.
+        public unsafe void DecodeAndUpdateNow(float time)
+        {
+            var data = _texture.GetRawTextureData<byte>();
+
+            if (data.Length != _decoder.BufferSize)
+            {
+                _decoder.UpdateSync(time);
+                UpdateNow();
+                return;
+            }
+
+            var ptr = NativeArrayUnsafeUtility.GetUnsafeBufferPointerWithoutChecks(data);
+            if (_decoder.UpdateSyncInto(time, (IntPtr)ptr, data.Length))
+                _texture.Apply();
+        }
+
         public void RequestAsyncUpdate()
         {
             if (_command != null) Graphics.ExecuteCommandBuffer(_command);
@@ -40,8 +40,65 @@ static int GetDeviceGeneration(string deviceModel, string prefix)
             return int.MaxValue;
         }
 
-        public static TextureFormat DetermineTextureFormat(int videoType, int width = 0, int height = 0)
+        // Texture format of a transcoded output format
+        static TextureFormat GetTranscodedTextureFormat(int videoType, OutputFormat format)
         {
+            switch (format)
+            {
+                case OutputFormat.ASTC: return TextureFormat.ASTC_4x4;
+                case OutputFormat.RGBA32: return TextureFormat.RGBA32;
+                case OutputFormat.BGRA32: return TextureFormat.BGRA32;
+                case OutputFormat.RGB565: return TextureFormat.RGB565;
+                case OutputFormat.RGBA4444: return TextureFormat.RGBA4444;
+                case OutputFormat.R8: return TextureFormat.R8;
+            }
+            return (videoType & 0xf) == 0xb ? TextureFormat.ETC2_RGB : TextureFormat.ETC2_RGBA8;
+        }
+
+        // Codec support of the output formats (RGB565 is opaque only, and R8
+        // takes the alpha channel or the BC4 channel)
+        static bool IsTranscodable(int videoType, OutputFormat format)
+        {
+            var type = videoType & 0xf;
+            var color = type == 0xb || type == 0xe || type == 0xf;
+            var supported = format == OutputFormat.RGB565 ? type == 0xb :
+                            format == OutputFormat.R8 ? type == 0xe || type == 0xf || type == 0x1 :
+                            color;
+            return supported && SystemInfo.SupportsTextureFormat(GetTranscodedTextureFormat(videoType, format));
+        }
+
+        // Resolves the decoder output format. Default turns into ASTC (or
+        // ETC2) on mobile platforms when the GPU supports it, which replaces
+        // the RGBA32 conversion. An explicit format that the GPU or the codec
+        // doesn't support falls back to Default.
+        public static OutputFormat DetermineOutputFormat(int videoType, OutputFormat requested)
+        {
+            var type = videoType & 0xf;
+
+            if (requested == OutputFormat.Default)
+            {
+                #if (UNITY_IOS || UNITY_ANDROID) && !UNITY_EDITOR
+                if (IsTranscodable(videoType, OutputFormat.ASTC)) return OutputFormat.ASTC;
+                if (IsTranscodable(videoType, OutputFormat.ETC2)) return OutputFormat.ETC2;
+                #endif
+                return OutputFormat.Default;
+            }
+
+            if (!IsTranscodable(videoType, requested))
+            {
+                Debug.LogWarning($"KlakHap: Output format '{requested}' is not supported for video type 0x{type:x} on this platform. Using the default format.");
+                return OutputFormat.Default;
+            }
+
+            return requested;
+        }
+
+        public static TextureFormat DetermineTextureFormat(int videoType, OutputFormat outputFormat, int width = 0, int height = 0)
+        {
+            // Transcoded output
+            if (outputFormat != OutputFormat.Default)
+                return GetTranscodedTextureFormat(videoType, outputFormat);
+
             // For mobile platforms, always use RGBA32 when native conversion is available
             #if (UNITY_IOS || UNITY_ANDROID) && !UNITY_EDITOR
                 Debug.Log($"[KlakHap] {Application.platform}: Using RGBA32 format with native DXT conversion for video type 0x{(videoType & 0xf):x}");
@@ -240,9 +297,14 @@ bool IsPVRTCCompatible(int w, int h)
             #endif
         }
 
-        public static Shader DetermineBlitShader(int videoType)
+        // HAP Q frames decoded into uncompressed formats are already
+        // converted into RGB by the decoder. Only the compressed ones need
+        // the YCoCg conversion shader.
+        public static Shader DetermineBlitShader(int videoType, TextureFormat format)
         {
-            if ((videoType & 0xf) == 0xf)
+            var uncompressed = format == TextureFormat.RGBA32 || format == TextureFormat.BGRA32 ||
+                               format == TextureFormat.RGBA4444 || format == TextureFormat.R8;
+            if ((videoType & 0xf) == 0xf && !uncompressed)
                 return Shader.Find("Klak/HAP Q");
             else
                 return Shader.Find("Klak/HAP");
@@ -0,0 +1,53 @@
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Records the native frame pipeline (reads, decompression, conversion,
+    // buffer locks and texture updates) and writes it as a Chrome trace
+    // event file, which chrome://tracing and Perfetto can open
+    public static class PipelineTrace
+    {
+        #region Public properties
+
+        // Off by default. It costs next to nothing while disabled.
+        public static bool enabled {
+            get => _enabled;
+            set { _enabled = value; KlakHap_SetTraceEnabled(value ? 1 : 0); }
+        }
+
+        #endregion
+
+        #region Public methods
+
+        // Writes the recorded spans (the latest 65536) into a JSON file.
+        // Returns the number of the spans written, or -1 on failure.
+        public static int Dump(string filePath)
+          => KlakHap_DumpTrace(filePath);
+
+        // Discards the recorded spans.
+        public static void Clear()
+          => KlakHap_ClearTrace();
+
+        #endregion
+
+        #region Private members
+
+        static bool _enabled;
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_SetTraceEnabled(int enable);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_ClearTrace();
+
+        [DllImport(NativeLibrary.Name, CharSet = CharSet.Ansi)]
+        static extern int KlakHap_DumpTrace
+          ([MarshalAs(UnmanagedType.LPUTF8Str)] string filepath);
+
+        #endregion
+    }
+}
@@ -0,0 +1,28 @@
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Reads the frame tables of very long clips from the file on demand
+    // instead of keeping them in memory
+    public static class SampleTablePaging
+    {
+        #region Public methods
+
+        // Enables paging for clips with the given number of frames or more.
+        // The default value is an hour at 60 fps.
+        public static void Enable(int minFrameCount = 60 * 60 * 60)
+          => KlakHap_SetSampleTablePaging(minFrameCount);
+
+        public static void Disable()
+          => KlakHap_SetSampleTablePaging(0);
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_SetSampleTablePaging(int frameThreshold);
+
+        #endregion
+    }
+}
@@ -0,0 +1,165 @@
+using System;
+using System.Runtime.InteropServices;
+using UnityEngine;
+
+namespace Klak.Hap
+{
+    // Background thumbnail (scrub strip) generator
+    //
+    // Decodes every Nth frame of a clip on the native worker threads and
+    // collects the thumbnails into an RGBA32 atlas texture. The thumbnails
+    // fill in coarse-to-fine, so a scrub strip covers the whole clip early.
+    public sealed class ThumbnailGenerator : IDisposable
+    {
+        #region Public properties
+
+        public bool isValid { get { return _plugin != IntPtr.Zero; } }
+        public int count { get { return _count; } }
+        public int frameStep { get { return _frameStep; } }
+        public int thumbnailWidth { get { return _width; } }
+        public int thumbnailHeight { get { return _height; } }
+        public int columns { get { return _columns; } }
+        public int rows { get { return _rows; } }
+        public Texture2D atlas { get { return _atlas; } }
+
+        public int completedCount { get {
+            return isValid ? KlakHap_GetThumbnailerProgress(_plugin) : 0;
+        } }
+
+        #endregion
+
+        #region Initialization/finalization
+
+        public ThumbnailGenerator
+          (string filePath, int frameStep, int maxWidth = 128, int columns = 16)
+        {
+            _demuxer = new Demuxer(filePath);
+            if (!_demuxer.IsValid) return;
+
+            _frameStep = Mathf.Max(1, frameStep);
+            _plugin = KlakHap_CreateThumbnailer
+              (_demuxer.PluginPointer, _frameStep, maxWidth, columns);
+
+            KlakHap_GetThumbnailerLayout
+              (_plugin, out _count, out _width, out _height, out _columns, out _rows);
+
+            if (_count == 0)
+            {
+                // Unsupported format
+                Dispose();
+                return;
+            }
+
+            _atlas = new Texture2D
+              (_width * _columns, _height * _rows, TextureFormat.RGBA32, false);
+            _atlas.wrapMode = TextureWrapMode.Clamp;
+            _atlas.hideFlags = HideFlags.DontSave;
+        }
+
+        public void Dispose()
+        {
+            if (_plugin != IntPtr.Zero)
+            {
+                KlakHap_DestroyThumbnailer(_plugin);
+                _plugin = IntPtr.Zero;
+            }
+
+            if (_demuxer != null)
+            {
+                _demuxer.Dispose();
+                _demuxer = null;
+            }
+
+            Utility.Destroy(_atlas);
+            _atlas = null;
+        }
+
+        #endregion
+
+        #region Public methods
+
+        // Uploads the atlas when new thumbnails have been completed. Returns
+        // true when the texture was updated.
+        public bool Update()
+        {
+            if (!isValid) return false;
+
+            var updated = false;
+            while (KlakHap_DequeueThumbnail(_plugin) >= 0) updated = true;
+            if (!updated) return false;
+
+            _atlas.LoadRawTextureData
+              (KlakHap_LockThumbnailAtlas(_plugin),
+               KlakHap_GetThumbnailAtlasSize(_plugin));
+            _atlas.Apply();
+            KlakHap_UnlockThumbnailAtlas(_plugin);
+
+            return true;
+        }
+
+        // Stops generating the remaining thumbnails.
+        public void Cancel()
+        {
+            if (isValid) KlakHap_CancelThumbnailer(_plugin);
+        }
+
+        // UV rectangle of a thumbnail in the atlas
+        public Rect GetUVRect(int index)
+        {
+            var w = 1.0f / _columns;
+            var h = 1.0f / _rows;
+            var x = index % _columns;
+            var y = _rows - 1 - index / _columns;
+            return new Rect(x * w, y * h, w, h);
+        }
+
+        // Frame index of a thumbnail
+        public int GetFrameIndex(int index)
+          => index * _frameStep;
+
+        #endregion
+
+        #region Private members
+
+        Demuxer _demuxer;
+        IntPtr _plugin;
+        int _count, _frameStep, _width, _height, _columns, _rows;
+        Texture2D _atlas;
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport(NativeLibrary.Name)]
+        static extern IntPtr KlakHap_CreateThumbnailer
+          (IntPtr demuxer, int frameStep, int maxWidth, int columns);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_DestroyThumbnailer(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_CancelThumbnailer(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_GetThumbnailerLayout
+          (IntPtr thumbnailer, out int count, out int width, out int height,
+           out int columns, out int rows);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern int KlakHap_GetThumbnailerProgress(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern int KlakHap_DequeueThumbnail(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern IntPtr KlakHap_LockThumbnailAtlas(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern void KlakHap_UnlockThumbnailAtlas(IntPtr thumbnailer);
+
+        [DllImport(NativeLibrary.Name)]
+        static extern int KlakHap_GetThumbnailAtlasSize(IntPtr thumbnailer);
+
+        #endregion
+    }
+}
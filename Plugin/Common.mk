@@ -18,6 +18,21 @@ vpath %.cpp Source
 
 SRCS = $(SRCS_C) $(SRCS_CC) $(SRCS_CPP)
 
+#
+# CPU variants (x86-64): Snappy is also built for SSSE3 and AVX2+BMI2, and
+# the variant for the CPU is selected at run time (see CpuDispatch.h).
+#
+
+ifeq ($(ARCH), x86_64)
+  CPU_VARIANTS = ssse3 avx2
+  CPPFLAGS += -DKLAKHAP_CPU_DISPATCH -DHAP_SNAPPY_UNCOMPRESS=KlakHap_SnappyUncompress
+endif
+
+# The instruction sets are enabled inside SnappyVariant.cpp, not with -m
+# flags, so that nothing outside the Snappy code is built for them.
+VARIANT_FLAGS_ssse3 = -DSNAPPY_HAVE_SSSE3=1 -DSNAPPY_HAVE_BMI2=0
+VARIANT_FLAGS_avx2  = -DSNAPPY_HAVE_SSSE3=1 -DSNAPPY_HAVE_BMI2=1
+
 OBJ_DIR = build-$(PLATFORM)-$(ARCH)
 
 #
@@ -28,7 +43,9 @@ OBJS_C   = $(addprefix $(OBJ_DIR)/, $(notdir $(patsubst %.c,  %.o, $(SRCS_C)  ))
 OBJS_CC  = $(addprefix $(OBJ_DIR)/, $(notdir $(patsubst %.cc, %.o, $(SRCS_CC) )))
 OBJS_CPP = $(addprefix $(OBJ_DIR)/, $(notdir $(patsubst %.cpp,%.o, $(SRCS_CPP))))
 
-OBJS = $(OBJS_C) $(OBJS_CC) $(OBJS_CPP)
+OBJS_VARIANT = $(foreach v, $(CPU_VARIANTS), $(OBJ_DIR)/SnappyVariant-$(v).o)
+
+OBJS = $(OBJS_C) $(OBJS_CC) $(OBJS_CPP) $(OBJS_VARIANT)
 
 ifeq ($(TARGET_TYPE), dll)
   TARGET = $(OBJ_DIR)/$(PRODUCT).$(TARGET_TYPE)
@@ -98,5 +115,8 @@ $(OBJ_DIR)/%.o: %.cc | $(OBJ_DIR)
 $(OBJ_DIR)/%.o: %.cpp | $(OBJ_DIR)
 	$(CXX) $(CPPFLAGS) $(CXXFLAGS) -c -o $@ $<
 
+$(OBJ_DIR)/SnappyVariant-%.o: Source/SnappyVariant.cpp | $(OBJ_DIR)
+	$(CXX) $(CPPFLAGS) $(CXXFLAGS) -Wno-ignored-attributes $(VARIANT_FLAGS_$*) -DKLAKHAP_SNAPPY_NAMESPACE=snappy_$* -c -o $@ $<
+
 $(OBJ_DIR):
 	mkdir -p $(OBJ_DIR)
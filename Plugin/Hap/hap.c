@@ -33,6 +33,16 @@
 
 #define kHapUInt24Max 0x00FFFFFF
 
+/*
+ The Snappy decompressor can be replaced at build time with a function of the same signature (e.g. one which
+ dispatches to a build for the CPU)
+ */
+#ifdef HAP_SNAPPY_UNCOMPRESS
+snappy_status HAP_SNAPPY_UNCOMPRESS(const char *compressed, size_t compressed_length, char *uncompressed, size_t *uncompressed_length);
+#else
+#define HAP_SNAPPY_UNCOMPRESS snappy_uncompress
+#endif
+
 /*
  Hap Constants
  First four bits represent the compressor
@@ -99,6 +109,20 @@ typedef struct HapChunkDecodeInfo {
     size_t uncompressed_chunk_size;
 } HapChunkDecodeInfo;
 
+/*
+ A decode context keeps the chunk decode info storage between frames, and the uncompressed chunk lengths of the last
+ decoded range, which are the same in every frame of a stream. Cached lengths are validated by the decompression
+ itself; a mismatch invalidates the cache and the texture is decoded again with lengths read from the chunks.
+ */
+struct HapDecodeContext {
+    HapChunkDecodeInfo *chunk_info;
+    size_t *chunk_lengths;
+    unsigned int capacity;
+    unsigned int cached_section_type;
+    unsigned int cached_first_chunk;
+    unsigned int cached_chunk_range;
+};
+
 // TODO: rename the defines we use for codes used in stored frames
 // to better differentiate them from the enums used for the API
 
@@ -609,7 +633,7 @@ static void hap_decode_chunk(HapChunkDecodeInfo chunks[], unsigned int index)
     {
         if (chunks[index].compressor == kHapCompressorSnappy)
         {
-            snappy_status snappy_result = snappy_uncompress(chunks[index].compressed_chunk_data,
+            snappy_status snappy_result = HAP_SNAPPY_UNCOMPRESS(chunks[index].compressed_chunk_data,
                                                             chunks[index].compressed_chunk_size,
                                                             chunks[index].uncompressed_chunk_data,
                                                             &chunks[index].uncompressed_chunk_size);
@@ -729,12 +753,19 @@ static unsigned int hap_decode_header_complex_instructions(const void *texture_s
     return result;
 }
 
-unsigned int hap_decode_single_texture(const void *texture_section, uint32_t texture_section_length,
-                                       unsigned int texture_section_type,
-                                       HapDecodeCallback callback, void *info,
-                                       void *outputBuffer, unsigned long outputBufferBytes,
-                                       unsigned long *outputBufferBytesUsed,
-                                       unsigned int *outputBufferTextureFormat)
+/*
+ Decodes the chunks in [first_chunk, first_chunk + chunk_range) of a texture, or all the chunks when chunk_range is 0.
+ Only the decode instructions and the data of the decoded chunks are accessed.
+ context may be NULL, in which case the chunk decode info is allocated for this call.
+ */
+static unsigned int hap_decode_texture_chunks(HapDecodeContext *context,
+                                              const void *texture_section, uint32_t texture_section_length,
+                                              unsigned int texture_section_type,
+                                              unsigned int first_chunk, unsigned int chunk_range,
+                                              HapDecodeCallback callback, void *info,
+                                              void *outputBuffer, unsigned long outputBufferBytes,
+                                              unsigned long *outputBufferBytesUsed,
+                                              unsigned int *outputBufferTextureFormat)
 {
     int result = HapResult_No_Error;
     unsigned int textureFormat;
@@ -775,17 +806,58 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
             return result;
         }
 
+        if (chunk_range == 0)
+        {
+            first_chunk = 0;
+            chunk_range = chunk_count;
+        }
+        else if (first_chunk >= (unsigned int)chunk_count || chunk_range > (unsigned int)chunk_count - first_chunk)
+        {
+            return HapResult_Bad_Arguments;
+        }
+
         if (chunk_count > 0)
         {
             /*
              Step through the chunks, storing information for their decompression
              */
-            HapChunkDecodeInfo *chunk_info = (HapChunkDecodeInfo *)malloc(sizeof(HapChunkDecodeInfo) * chunk_count);
+            HapChunkDecodeInfo *chunk_info;
+            int use_cached_lengths = 0;
 
             size_t running_compressed_chunk_size = 0;
             size_t running_uncompressed_chunk_size = 0;
             int i;
 
+            if (context)
+            {
+                if (context->capacity < chunk_range)
+                {
+                    HapChunkDecodeInfo *grown_info = (HapChunkDecodeInfo *)realloc(context->chunk_info, sizeof(HapChunkDecodeInfo) * chunk_range);
+                    size_t *grown_lengths;
+                    if (grown_info == NULL)
+                    {
+                        return HapResult_Internal_Error;
+                    }
+                    context->chunk_info = grown_info;
+                    grown_lengths = (size_t *)realloc(context->chunk_lengths, sizeof(size_t) * chunk_range);
+                    if (grown_lengths == NULL)
+                    {
+                        return HapResult_Internal_Error;
+                    }
+                    context->chunk_lengths = grown_lengths;
+                    context->capacity = chunk_range;
+                    context->cached_chunk_range = 0;
+                }
+                use_cached_lengths = context->cached_chunk_range == chunk_range
+                                     && context->cached_first_chunk == first_chunk
+                                     && context->cached_section_type == texture_section_type;
+                chunk_info = context->chunk_info;
+            }
+            else
+            {
+                chunk_info = (HapChunkDecodeInfo *)malloc(sizeof(HapChunkDecodeInfo) * chunk_range);
+            }
+
             if (chunk_info == NULL)
             {
                 return HapResult_Internal_Error;
@@ -793,26 +865,43 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
 
             for (i = 0; i < chunk_count; i++) {
 
-                chunk_info[i].compressor = *(((uint8_t *)compressors) + i);
-
-                chunk_info[i].compressed_chunk_size = hap_read_4_byte_uint(((uint8_t *)chunk_sizes) + (i * 4));
+                HapChunkDecodeInfo *chunk;
+                size_t compressed_chunk_size = hap_read_4_byte_uint(((uint8_t *)chunk_sizes) + (i * 4));
+                const char *compressed_chunk_data;
 
                 if (chunk_offsets)
                 {
-                    chunk_info[i].compressed_chunk_data = frame_data + hap_read_4_byte_uint(((uint8_t *)chunk_offsets) + (i * 4));
+                    compressed_chunk_data = frame_data + hap_read_4_byte_uint(((uint8_t *)chunk_offsets) + (i * 4));
                 }
                 else
                 {
-                    chunk_info[i].compressed_chunk_data = frame_data + running_compressed_chunk_size;
+                    compressed_chunk_data = frame_data + running_compressed_chunk_size;
                 }
 
-                running_compressed_chunk_size += chunk_info[i].compressed_chunk_size;
+                running_compressed_chunk_size += compressed_chunk_size;
 
-                if (chunk_info[i].compressor == kHapCompressorSnappy)
+                /*
+                 Chunks outside the range are skipped without touching their data
+                 */
+                if ((unsigned int)i < first_chunk || (unsigned int)i >= first_chunk + chunk_range)
                 {
-                    snappy_status snappy_result = snappy_uncompressed_length(chunk_info[i].compressed_chunk_data,
-                        chunk_info[i].compressed_chunk_size,
-                        &(chunk_info[i].uncompressed_chunk_size));
+                    continue;
+                }
+
+                chunk = chunk_info + (i - (int)first_chunk);
+                chunk->compressor = *(((uint8_t *)compressors) + i);
+                chunk->compressed_chunk_size = compressed_chunk_size;
+                chunk->compressed_chunk_data = compressed_chunk_data;
+
+                if (chunk->compressor == kHapCompressorSnappy && use_cached_lengths)
+                {
+                    chunk->uncompressed_chunk_size = context->chunk_lengths[i - (int)first_chunk];
+                }
+                else if (chunk->compressor == kHapCompressorSnappy)
+                {
+                    snappy_status snappy_result = snappy_uncompressed_length(chunk->compressed_chunk_data,
+                        chunk->compressed_chunk_size,
+                        &(chunk->uncompressed_chunk_size));
 
                     if (snappy_result != SNAPPY_OK)
                     {
@@ -830,11 +919,11 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
                 }
                 else
                 {
-                    chunk_info[i].uncompressed_chunk_size = chunk_info[i].compressed_chunk_size;
+                    chunk->uncompressed_chunk_size = chunk->compressed_chunk_size;
                 }
 
-                chunk_info[i].uncompressed_chunk_data = (char *)(((uint8_t *)outputBuffer) + running_uncompressed_chunk_size);
-                running_uncompressed_chunk_size += chunk_info[i].uncompressed_chunk_size;
+                chunk->uncompressed_chunk_data = (char *)(((uint8_t *)outputBuffer) + running_uncompressed_chunk_size);
+                running_uncompressed_chunk_size += chunk->uncompressed_chunk_size;
             }
 
             if (result == HapResult_No_Error && running_uncompressed_chunk_size > outputBufferBytes)
@@ -849,7 +938,7 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
                  */
                 bytesUsed = running_uncompressed_chunk_size;
 
-                if (chunk_count == 1)
+                if (chunk_range == 1)
                 {
                     /*
                      We don't invoke the callback for one chunk, just decode it directly
@@ -858,13 +947,13 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
                 }
                 else
                 {
-                    callback((HapDecodeWorkFunction)hap_decode_chunk, chunk_info, chunk_count, info);
+                    callback((HapDecodeWorkFunction)hap_decode_chunk, chunk_info, chunk_range, info);
                 }
 
                 /*
                  Check to see if we encountered any errors and report one of them
                  */
-                for (i = 0; i < chunk_count; i++)
+                for (i = 0; i < (int)chunk_range; i++)
                 {
                     if (chunk_info[i].result != HapResult_No_Error)
                     {
@@ -874,7 +963,41 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
                 }
             }
 
-            free(chunk_info);
+            if (context == NULL)
+            {
+                free(chunk_info);
+            }
+            else if (use_cached_lengths)
+            {
+                /*
+                 The cached lengths are stale if any chunk failed or had another length: Decode the texture again
+                 */
+                for (i = 0; i < (int)chunk_range && result == HapResult_No_Error; i++)
+                {
+                    if (chunk_info[i].uncompressed_chunk_size != context->chunk_lengths[i])
+                    {
+                        result = HapResult_Bad_Frame;
+                    }
+                }
+                if (result != HapResult_No_Error)
+                {
+                    context->cached_chunk_range = 0;
+                    return hap_decode_texture_chunks(context, texture_section, texture_section_length, texture_section_type,
+                                                     first_chunk, chunk_range, callback, info,
+                                                     outputBuffer, outputBufferBytes,
+                                                     outputBufferBytesUsed, outputBufferTextureFormat);
+                }
+            }
+            else if (result == HapResult_No_Error)
+            {
+                for (i = 0; i < (int)chunk_range; i++)
+                {
+                    context->chunk_lengths[i] = chunk_info[i].uncompressed_chunk_size;
+                }
+                context->cached_section_type = texture_section_type;
+                context->cached_first_chunk = first_chunk;
+                context->cached_chunk_range = chunk_range;
+            }
 
             if (result != HapResult_No_Error)
             {
@@ -882,6 +1005,13 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
             }
         }
     }
+    else if (first_chunk != 0 || chunk_range > 1)
+    {
+        /*
+         Textures without chunks are treated as a single chunk
+         */
+        return HapResult_Bad_Arguments;
+    }
     else if (compressor == kHapCompressorSnappy)
     {
         /*
@@ -896,7 +1026,7 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
         {
             return HapResult_Buffer_Too_Small;
         }
-        snappy_result = snappy_uncompress((const char *)texture_section, texture_section_length, (char *)outputBuffer, &bytesUsed);
+        snappy_result = HAP_SNAPPY_UNCOMPRESS((const char *)texture_section, texture_section_length, (char *)outputBuffer, &bytesUsed);
         if (snappy_result != SNAPPY_OK)
         {
             return HapResult_Internal_Error;
@@ -929,6 +1059,19 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
     return HapResult_No_Error;
 }
 
+unsigned int hap_decode_single_texture(const void *texture_section, uint32_t texture_section_length,
+                                       unsigned int texture_section_type,
+                                       HapDecodeCallback callback, void *info,
+                                       void *outputBuffer, unsigned long outputBufferBytes,
+                                       unsigned long *outputBufferBytesUsed,
+                                       unsigned int *outputBufferTextureFormat)
+{
+    return hap_decode_texture_chunks(NULL, texture_section, texture_section_length, texture_section_type,
+                                     0, 0, callback, info,
+                                     outputBuffer, outputBufferBytes,
+                                     outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
 int hap_get_section_at_index(const void *input_buffer, uint32_t input_buffer_bytes,
                              unsigned int index,
                              const void **section, uint32_t *section_length, unsigned int *section_type)
@@ -990,12 +1133,39 @@ int hap_get_section_at_index(const void *input_buffer, uint32_t input_buffer_byt
     }
 }
 
+HapDecodeContext *HapCreateDecodeContext(void)
+{
+    return (HapDecodeContext *)calloc(1, sizeof(HapDecodeContext));
+}
+
+void HapDestroyDecodeContext(HapDecodeContext *context)
+{
+    if (context)
+    {
+        free(context->chunk_info);
+        free(context->chunk_lengths);
+        free(context);
+    }
+}
+
 unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
                        unsigned int index,
                        HapDecodeCallback callback, void *info,
                        void *outputBuffer, unsigned long outputBufferBytes,
                        unsigned long *outputBufferBytesUsed,
                        unsigned int *outputBufferTextureFormat)
+{
+    return HapDecodeWithContext(NULL, inputBuffer, inputBufferBytes, index, callback, info,
+                                outputBuffer, outputBufferBytes, outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
+unsigned int HapDecodeWithContext(HapDecodeContext *context,
+                                  const void *inputBuffer, unsigned long inputBufferBytes,
+                                  unsigned int index,
+                                  HapDecodeCallback callback, void *info,
+                                  void *outputBuffer, unsigned long outputBufferBytes,
+                                  unsigned long *outputBufferBytesUsed,
+                                  unsigned int *outputBufferTextureFormat)
 {
     int result = HapResult_No_Error;
     const void *section;
@@ -1026,9 +1196,70 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
         /*
          Decode the located texture
          */
-        result = hap_decode_single_texture(section,
+        result = hap_decode_texture_chunks(context,
+                                           section,
+                                           section_length,
+                                           section_type,
+                                           0, 0,
+                                           callback, info,
+                                           outputBuffer,
+                                           outputBufferBytes,
+                                           outputBufferBytesUsed,
+                                           outputBufferTextureFormat);
+    }
+
+    return result;
+}
+
+unsigned int HapDecodeChunks(const void *inputBuffer, unsigned long inputBufferBytes,
+                             unsigned int index,
+                             unsigned int firstChunk, unsigned int chunkCount,
+                             HapDecodeCallback callback, void *info,
+                             void *outputBuffer, unsigned long outputBufferBytes,
+                             unsigned long *outputBufferBytesUsed,
+                             unsigned int *outputBufferTextureFormat)
+{
+    return HapDecodeChunksWithContext(NULL, inputBuffer, inputBufferBytes, index, firstChunk, chunkCount, callback, info,
+                                      outputBuffer, outputBufferBytes, outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
+unsigned int HapDecodeChunksWithContext(HapDecodeContext *context,
+                                        const void *inputBuffer, unsigned long inputBufferBytes,
+                                        unsigned int index,
+                                        unsigned int firstChunk, unsigned int chunkCount,
+                                        HapDecodeCallback callback, void *info,
+                                        void *outputBuffer, unsigned long outputBufferBytes,
+                                        unsigned long *outputBufferBytesUsed,
+                                        unsigned int *outputBufferTextureFormat)
+{
+    int result = HapResult_No_Error;
+    const void *section;
+    uint32_t section_length;
+    unsigned int section_type;
+
+    /*
+     Check arguments
+     */
+    if (inputBuffer == NULL
+        || index > 1
+        || chunkCount == 0
+        || callback == NULL
+        || outputBuffer == NULL
+        || outputBufferTextureFormat == NULL
+        )
+    {
+        return HapResult_Bad_Arguments;
+    }
+
+    result = hap_get_section_at_index(inputBuffer, inputBufferBytes, index, &section, &section_length, &section_type);
+
+    if (result == HapResult_No_Error)
+    {
+        result = hap_decode_texture_chunks(context,
+                                           section,
                                            section_length,
                                            section_type,
+                                           firstChunk, chunkCount,
                                            callback, info,
                                            outputBuffer,
                                            outputBufferBytes,
@@ -1039,6 +1270,207 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
     return result;
 }
 
+unsigned int HapGetFrameHeaderLength(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index, unsigned long *headerLength)
+{
+    int result;
+    const void *section;
+    uint32_t section_length;
+    unsigned int section_type;
+
+    if (inputBuffer == NULL || index > 1 || headerLength == NULL)
+    {
+        return HapResult_Bad_Arguments;
+    }
+
+    result = hap_get_section_at_index(inputBuffer, inputBufferBytes, index, &section, &section_length, &section_type);
+
+    if (result != HapResult_No_Error)
+    {
+        return result;
+    }
+
+    *headerLength = (unsigned long)((const uint8_t *)section - (const uint8_t *)inputBuffer);
+
+    if (hap_top_4_bits(section_type) == kHapCompressorComplex)
+    {
+        /*
+         Only the header of the Decode Instructions Container is read
+         */
+        uint32_t instructions_header_length;
+        uint32_t instructions_length;
+        unsigned int instructions_type;
+
+        result = hap_read_section_header(section, section_length, &instructions_header_length, &instructions_length, &instructions_type);
+
+        if (result == HapResult_No_Error && instructions_type != kHapSectionDecodeInstructionsContainer)
+        {
+            result = HapResult_Bad_Frame;
+        }
+
+        *headerLength += instructions_header_length + instructions_length;
+    }
+
+    return result;
+}
+
+unsigned int HapGetFrameChunkDataRange(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index,
+                                       unsigned int firstChunk, unsigned int chunkCount,
+                                       unsigned long *dataOffset, unsigned long *dataLength)
+{
+    int result;
+    const void *section;
+    uint32_t section_length;
+    unsigned int section_type;
+
+    if (inputBuffer == NULL || index > 1 || chunkCount == 0 || dataOffset == NULL || dataLength == NULL)
+    {
+        return HapResult_Bad_Arguments;
+    }
+
+    result = hap_get_section_at_index(inputBuffer, inputBufferBytes, index, &section, &section_length, &section_type);
+
+    if (result != HapResult_No_Error)
+    {
+        return result;
+    }
+
+    if (hap_top_4_bits(section_type) == kHapCompressorComplex)
+    {
+        int chunk_count = 0;
+        const void *compressors = NULL;
+        const void *chunk_sizes = NULL;
+        const void *chunk_offsets = NULL;
+        const char *frame_data = NULL;
+        size_t running_offset = 0;
+        size_t range_start = ~(size_t)0;
+        size_t range_end = 0;
+        int i;
+
+        result = hap_decode_header_complex_instructions(section, section_length, &chunk_count, &compressors, &chunk_sizes, &chunk_offsets, &frame_data);
+
+        if (result != HapResult_No_Error)
+        {
+            return result;
+        }
+
+        if (firstChunk >= (unsigned int)chunk_count || chunkCount > (unsigned int)chunk_count - firstChunk)
+        {
+            return HapResult_Bad_Arguments;
+        }
+
+        for (i = 0; i < (int)(firstChunk + chunkCount); i++)
+        {
+            size_t size = hap_read_4_byte_uint(((uint8_t *)chunk_sizes) + (i * 4));
+            size_t offset = chunk_offsets ? hap_read_4_byte_uint(((uint8_t *)chunk_offsets) + (i * 4)) : running_offset;
+            running_offset += size;
+
+            if ((unsigned int)i >= firstChunk)
+            {
+                if (offset < range_start) range_start = offset;
+                if (offset + size > range_end) range_end = offset + size;
+            }
+        }
+
+        *dataOffset = (unsigned long)((frame_data - (const char *)inputBuffer) + range_start);
+        *dataLength = (unsigned long)(range_end - range_start);
+    }
+    else
+    {
+        if (firstChunk != 0 || chunkCount != 1)
+        {
+            return HapResult_Bad_Arguments;
+        }
+        *dataOffset = (unsigned long)((const uint8_t *)section - (const uint8_t *)inputBuffer);
+        *dataLength = section_length;
+    }
+
+    if (*dataOffset + *dataLength > inputBufferBytes)
+    {
+        return HapResult_Bad_Frame;
+    }
+
+    return HapResult_No_Error;
+}
+
+unsigned int HapGetFrameUncompressedRange(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index,
+                                          unsigned long *dataOffset, unsigned long *dataLength)
+{
+    int result;
+    const void *section;
+    uint32_t section_length;
+    unsigned int section_type;
+    unsigned int compressor;
+
+    if (inputBuffer == NULL || index > 1 || dataOffset == NULL || dataLength == NULL)
+    {
+        return HapResult_Bad_Arguments;
+    }
+
+    *dataOffset = 0;
+    *dataLength = 0;
+
+    result = hap_get_section_at_index(inputBuffer, inputBufferBytes, index, &section, &section_length, &section_type);
+
+    if (result != HapResult_No_Error)
+    {
+        return result;
+    }
+
+    compressor = hap_top_4_bits(section_type);
+
+    if (compressor == kHapCompressorComplex)
+    {
+        int chunk_count = 0;
+        const void *compressors = NULL;
+        const void *chunk_sizes = NULL;
+        const void *chunk_offsets = NULL;
+        const char *frame_data = NULL;
+        size_t running_offset = 0;
+        int i;
+
+        result = hap_decode_header_complex_instructions(section, section_length, &chunk_count, &compressors, &chunk_sizes, &chunk_offsets, &frame_data);
+
+        if (result != HapResult_No_Error)
+        {
+            return result;
+        }
+
+        /*
+         The chunks have to be uncompressed and stored in order without gaps
+         */
+        for (i = 0; i < chunk_count; i++)
+        {
+            size_t size = hap_read_4_byte_uint(((uint8_t *)chunk_sizes) + (i * 4));
+            if (((uint8_t *)compressors)[i] != kHapCompressorNone ||
+                (chunk_offsets && hap_read_4_byte_uint(((uint8_t *)chunk_offsets) + (i * 4)) != running_offset))
+            {
+                return HapResult_No_Error;
+            }
+            running_offset += size;
+        }
+
+        *dataOffset = (unsigned long)(frame_data - (const char *)inputBuffer);
+        *dataLength = (unsigned long)running_offset;
+    }
+    else if (compressor == kHapCompressorNone)
+    {
+        *dataOffset = (unsigned long)((const uint8_t *)section - (const uint8_t *)inputBuffer);
+        *dataLength = section_length;
+    }
+    else
+    {
+        return HapResult_No_Error;
+    }
+
+    if (*dataOffset + *dataLength > inputBufferBytes)
+    {
+        *dataLength = 0;
+        return HapResult_Bad_Frame;
+    }
+
+    return HapResult_No_Error;
+}
+
 unsigned int HapGetFrameTextureCount(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int *outputTextureCount)
 {
     int result;
@@ -136,6 +136,81 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
                        unsigned long *outputBufferBytesUsed,
                        unsigned int *outputBufferTextureFormat);
 
+/*
+ Decodes a range of chunks of a texture from inputBuffer which is a Hap frame.
+
+ Decodes the chunks in [firstChunk, firstChunk + chunkCount) and writes them contiguously to outputBuffer. Only the frame
+ header (see HapGetFrameHeaderLength()) and the data of these chunks (see HapGetFrameChunkDataRange()) are accessed, so
+ the rest of the frame doesn't have to be present in inputBuffer, although inputBufferBytes must be the full frame length.
+ A texture without chunks is treated as a single chunk. The other arguments are the same as HapDecode().
+ */
+unsigned int HapDecodeChunks(const void *inputBuffer, unsigned long inputBufferBytes,
+                             unsigned int index,
+                             unsigned int firstChunk, unsigned int chunkCount,
+                             HapDecodeCallback callback, void *info,
+                             void *outputBuffer, unsigned long outputBufferBytes,
+                             unsigned long *outputBufferBytesUsed,
+                             unsigned int *outputBufferTextureFormat);
+
+/*
+ A decode context holds scratch storage and the chunk layout of the last decoded texture, so that a stream of frames
+ can be decoded without heap allocations or a separate pass over the chunks to read their lengths. A context must not
+ be used by more than one thread at a time, and works best when it's used for a single texture index of a stream.
+ */
+typedef struct HapDecodeContext HapDecodeContext;
+
+/*
+ Returns a new decode context, or NULL if it can't be allocated.
+ */
+HapDecodeContext *HapCreateDecodeContext(void);
+
+/*
+ Frees a decode context. Passing NULL is allowed.
+ */
+void HapDestroyDecodeContext(HapDecodeContext *context);
+
+/*
+ The same as HapDecode() and HapDecodeChunks() but using a decode context. context may be NULL.
+ */
+unsigned int HapDecodeWithContext(HapDecodeContext *context,
+                                  const void *inputBuffer, unsigned long inputBufferBytes,
+                                  unsigned int index,
+                                  HapDecodeCallback callback, void *info,
+                                  void *outputBuffer, unsigned long outputBufferBytes,
+                                  unsigned long *outputBufferBytesUsed,
+                                  unsigned int *outputBufferTextureFormat);
+
+unsigned int HapDecodeChunksWithContext(HapDecodeContext *context,
+                                        const void *inputBuffer, unsigned long inputBufferBytes,
+                                        unsigned int index,
+                                        unsigned int firstChunk, unsigned int chunkCount,
+                                        HapDecodeCallback callback, void *info,
+                                        void *outputBuffer, unsigned long outputBufferBytes,
+                                        unsigned long *outputBufferBytesUsed,
+                                        unsigned int *outputBufferTextureFormat);
+
+/*
+ On return sets headerLength to the length of the frame header which is needed to locate the chunks of the texture at
+ index (the section headers and the decode instructions). Only the first 16 bytes of the texture section are read.
+ */
+unsigned int HapGetFrameHeaderLength(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index, unsigned long *headerLength);
+
+/*
+ On return sets dataOffset and dataLength to the byte range in the frame which contains the compressed data of the chunks
+ in [firstChunk, firstChunk + chunkCount) of the texture at index. Only the frame header has to be present in inputBuffer.
+ */
+unsigned int HapGetFrameChunkDataRange(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index,
+                                       unsigned int firstChunk, unsigned int chunkCount,
+                                       unsigned long *dataOffset, unsigned long *dataLength);
+
+/*
+ On return sets dataOffset and dataLength to the byte range in the frame which contains the texture data at index as is,
+ when it's stored without second-stage compression (all the chunks uncompressed, in order and without gaps). dataLength is
+ set to 0 when the texture has to be decoded.
+ */
+unsigned int HapGetFrameUncompressedRange(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index,
+                                          unsigned long *dataOffset, unsigned long *dataLength);
+
 /*
  If this returns HapResult_No_Error then outputTextureCount is set to the count of textures in the frame.
  */
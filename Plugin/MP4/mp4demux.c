@@ -26,6 +26,12 @@
 #   define MP4D_TRACE(x)
 #endif
 
+// Size of the buffered input window
+#define MP4D_READ_WINDOW_BYTES           (64*1024)
+
+// Top-level moov boxes up to this size are loaded with a single read
+#define MP4D_MAX_MOOV_PRELOAD_BYTES      (256*1024*1024)
+
 // Box type: ATOM box, or 'Object Descriptor' box inside the atom.
 typedef enum {BOX_ATOM, BOX_OD} mp4d_boxtype_t;
 
@@ -51,25 +57,87 @@ static off_t mp4d_fsize(FILE * f)
     return -1;
 }
 
+/**
+*   Buffered input window
+*   The box headers and the index tables are read from this window instead
+*   of the stdio stream, so the parser doesn't pay for a libc call per field.
+*/
+typedef struct
+{
+    FILE * file;
+    unsigned char * buf;
+    size_t capacity;
+    size_t pos;             // read position in the window
+    size_t len;             // valid bytes in the window
+    mp4d_size_t base;       // file position of the window head
+} mp4d_reader_t;
+
+static int mp4d_reader_init(mp4d_reader_t * r, FILE * f)
+{
+    r->file = f;
+    r->buf = malloc(MP4D_READ_WINDOW_BYTES);
+    r->capacity = r->buf ? MP4D_READ_WINDOW_BYTES : 0;
+    r->pos = r->len = 0;
+    r->base = 0;
+    return r->buf != NULL;
+}
+
+static void mp4d_reader_free(mp4d_reader_t * r)
+{
+    free(r->buf);
+    r->buf = NULL;
+    r->capacity = r->pos = r->len = 0;
+}
+
+/**
+*   Make at least nb bytes available in the window, growing it when needed.
+*   Returns 0 when the file ends (or memory runs out) before that.
+*/
+static int mp4d_reader_fill(mp4d_reader_t * r, size_t nb)
+{
+    size_t avail = r->len - r->pos;
+    if (avail >= nb)
+    {
+        return 1;
+    }
+    if (nb > r->capacity)
+    {
+        unsigned char * p = realloc(r->buf, nb);
+        if (!p)
+        {
+            return 0;
+        }
+        r->buf = p;
+        r->capacity = nb;
+    }
+    memmove(r->buf, r->buf + r->pos, avail);
+    r->base += r->pos;
+    r->pos = 0;
+    r->len = avail + fread(r->buf + avail, 1, r->capacity - avail, r->file);
+    return r->len >= nb;
+}
+
 /**
 *   Read given number of bytes from the file
 *   Used to read box headers
 */
-static unsigned mp4d_read(FILE * f, int nb, int * eof_flag)
+static unsigned mp4d_read(mp4d_reader_t * r, int nb, int * eof_flag)
 {
-    uint32_t v = 0; int last_byte;
-    switch (nb)
+    uint32_t v = 0;
+    const unsigned char * p;
+    int i;
+    if (r->len - r->pos < (size_t)nb && !mp4d_reader_fill(r, nb))
     {
-    case 4: v = (v << 8) | fgetc(f);
-    case 3: v = (v << 8) | fgetc(f);
-    case 2: v = (v << 8) | fgetc(f);
-    default:
-    case 1: v = (v << 8) | (last_byte = fgetc(f));
+        *eof_flag = 1;
+        r->pos = r->len;
+        return 0;
     }
-    if (last_byte == EOF)
+    p = r->buf + r->pos;
+    for (i = 0; i < nb; i++)
     {
-        *eof_flag = 1;
+        v = (v << 8) | p[i];
     }
+    r->pos += nb;
     return v;
 }
 
@@ -77,7 +145,7 @@ static unsigned mp4d_read(FILE * f, int nb, int * eof_flag)
 *   Read given number of bytes, but no more than *payload_bytes specifies...
 *   Used to read box payload
 */
-static uint32_t mp4d_read_payload(FILE * f, unsigned nb, mp4d_size_t * payload_bytes, int * eof_flag)
+static uint32_t mp4d_read_payload(mp4d_reader_t * r, unsigned nb, mp4d_size_t * payload_bytes, int * eof_flag)
 {
     if (*payload_bytes < nb)
     {
@@ -86,18 +154,92 @@ static uint32_t mp4d_read_payload(FILE * f, unsigned nb, mp4d_size_t * payload_b
     }
     *payload_bytes -= nb;
 
-    return mp4d_read(f, nb, eof_flag);
+    return mp4d_read(r, nb, eof_flag);
+}
+
+/**
+*   Read a table of big-endian 32-bit (wide == 0) or 64-bit (wide == 1)
+*   values. The table is converted in window-sized blocks. Entries beyond
+*   the payload or the end of file are zero-filled.
+*/
+static void mp4d_read_table(mp4d_reader_t * r, void * dst, unsigned count, int wide, mp4d_size_t * payload_bytes, int * eof_flag)
+{
+    unsigned entry_bytes = wide ? 8 : 4;
+    uint32_t * dst32 = (uint32_t *)dst;
+    mp4d_size_t * dst64 = (mp4d_size_t *)dst;
+    unsigned done = 0;
+
+    if (*payload_bytes / entry_bytes < count)
+    {
+        *eof_flag = 1;
+        count = (unsigned)(*payload_bytes / entry_bytes);
+    }
+    *payload_bytes -= (mp4d_size_t)count * entry_bytes;
+
+    while (done < count)
+    {
+        const unsigned char * p;
+        unsigned i, n;
+        if (r->len - r->pos < entry_bytes && !mp4d_reader_fill(r, entry_bytes))
+        {
+            *eof_flag = 1;
+            break;
+        }
+        n = (unsigned)((r->len - r->pos) / entry_bytes);
+        if (n > count - done)
+        {
+            n = count - done;
+        }
+        p = r->buf + r->pos;
+        if (wide)
+        {
+            for (i = 0; i < n; i++, p += 8)
+            {
+                dst64[done + i] =
+                    ((mp4d_size_t)p[0] << 56) | ((mp4d_size_t)p[1] << 48) |
+                    ((mp4d_size_t)p[2] << 40) | ((mp4d_size_t)p[3] << 32) |
+                    ((mp4d_size_t)p[4] << 24) | ((mp4d_size_t)p[5] << 16) |
+                    ((mp4d_size_t)p[6] <<  8) |  (mp4d_size_t)p[7];
+            }
+        }
+        else
+        {
+            for (i = 0; i < n; i++, p += 4)
+            {
+                dst32[done + i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                                  ((uint32_t)p[2] <<  8) |  (uint32_t)p[3];
+            }
+        }
+        r->pos += (size_t)n * entry_bytes;
+        done += n;
+    }
+
+    for (; done < count; done++)
+    {
+        if (wide) dst64[done] = 0; else dst32[done] = 0;
+    }
 }
 
 /**
 *   Skips given number of bytes.
 */
-static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
+static void mp4d_skip_bytes(mp4d_reader_t * r, mp4d_size_t skip, int * eof_flag)
 {
+    size_t avail = r->len - r->pos;
+    if (skip <= avail)
+    {
+        r->pos += (size_t)skip;
+        return;
+    }
+
+    // The stdio position is at the end of the window.
+    skip -= avail;
+    r->base += r->len + skip;
+    r->pos = r->len = 0;
     while (skip > 0)
     {
         long lpos = (long)(skip < (mp4d_size_t)LONG_MAX ? skip : LONG_MAX);
-        if (fseek(f, lpos, SEEK_CUR))
+        if (fseek(r->file, lpos, SEEK_CUR))
         {
             *eof_flag = 1;
             return;
@@ -107,8 +249,10 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
 }
 
 
-#define READ(n) mp4d_read_payload(f, n, &payload_bytes, &eof_flag)
-#define SKIP(n) {mp4d_size_t t = payload_bytes < (n) ? payload_bytes : (n); mp4d_skip_bytes(f, t, &eof_flag); payload_bytes -= t;}
+#define TELL() (rd.base + rd.pos)
+#define READ(n) mp4d_read_payload(&rd, n, &payload_bytes, &eof_flag)
+#define READ_TABLE(dst, count, wide) mp4d_read_table(&rd, dst, count, wide, &payload_bytes, &eof_flag)
+#define SKIP(n) {mp4d_size_t t = payload_bytes < (n) ? payload_bytes : (n); mp4d_skip_bytes(&rd, t, &eof_flag); payload_bytes -= t;}
 #define MP4D_MALLOC(p, size) p = malloc(size); if (!(p)) {MP4D_ERROR("out of memory");}
 #define MP4D_REALLOC(p, size) {void * r = realloc(p, size); if (!(r)) {MP4D_ERROR("out of memory");} else p = r;};
 
@@ -117,6 +261,7 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
 */
 #define MP4D_RETURN_ERROR(mess) {       \
     MP4D_TRACE(("\nMP4 ERROR: " mess)); \
+    mp4d_reader_free(&rd);              \
     fseek(f, 0, SEEK_SET);              \
     MP4D__close(mp4);                   \
     return 0;                           \
@@ -141,6 +286,14 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
 *   Parse given file as MP4 file.  Allocate and store data indexes.
 */
 int MP4D__open(MP4D_demux_t * mp4, FILE * f)
+{
+    return MP4D__open_ex(mp4, f, 0);
+}
+
+/**
+*   Parse given file as MP4 file with option flags.
+*/
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, unsigned flags)
 {
     int depth = 0;              // box stack size
 
@@ -156,6 +309,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
     } stack[MP4D_MAX_CHUNKS_DEPTH];
 
     off_t file_size = mp4d_fsize(f);
+    mp4d_reader_t rd;
     int eof_flag = 0;
     unsigned i;
     MP4D_track_t * tr = NULL;
@@ -179,6 +333,11 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
 
     memset(mp4, 0, sizeof(MP4D_demux_t));
 
+    if (!mp4d_reader_init(&rd, f))
+    {
+        return 0;
+    }
+
     stack[0].format = BOX_ATOM;   // start with atom box
     stack[0].bytes = 0;           // never accessed
 
@@ -250,7 +409,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
         // Read header box type and it's length
         if (stack[depth].format == BOX_ATOM)
         {
-            box_bytes = mp4d_read(f, 4, &eof_flag);
+            box_bytes = mp4d_read(&rd, 4, &eof_flag);
             if (eof_flag)
             {
                 break;  // normal exit
@@ -261,7 +420,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
                 MP4D_ERROR("invalid box size (broken file?)");
             }
 
-            box_name  = mp4d_read(f, 4, &eof_flag);
+            box_name  = mp4d_read(&rd, 4, &eof_flag);
             read_bytes = 8;
 
             // Decode box size
@@ -276,9 +435,9 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
 
             if (box_bytes == 1)           // 64-bit sizes
             {
-                box_bytes = mp4d_read(f, 4, &eof_flag);
+                box_bytes = mp4d_read(&rd, 4, &eof_flag);
                 box_bytes <<= 32;
-                box_bytes |= mp4d_read(f, 4, &eof_flag);
+                box_bytes |= mp4d_read(&rd, 4, &eof_flag);
                 if (box_bytes < 16)
                 {
                     MP4D_ERROR("invalid box size (broken file?)");
@@ -286,6 +445,15 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
                 payload_bytes = box_bytes - 16;
             }
 
+            // Load the whole top-level movie box with a single read, so
+            // the index tables are parsed from memory.
+            if (!depth && box_name == BOX_moov &&
+                payload_bytes <= (mp4d_size_t)file_size &&
+                payload_bytes <= MP4D_MAX_MOOV_PRELOAD_BYTES)
+            {
+                mp4d_reader_fill(&rd, (size_t)payload_bytes);
+            }
+
             // Read and check box version for some boxes
             for (i = 0; i < sizeof(g_fullbox)/sizeof(g_fullbox[0]); i++)
             {
@@ -308,7 +476,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
         else // stack[depth].format == BOX_OD
         {
             int val;
-            box_name = OD_BASE + mp4d_read(f, 1, &eof_flag);     // 1-byte box type
+            box_name = OD_BASE + mp4d_read(&rd, 1, &eof_flag);     // 1-byte box type
             read_bytes += 1;
             if (eof_flag)
             {
@@ -319,7 +487,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
             box_bytes = 1;
             do
             {
-                val = mp4d_read(f, 1, &eof_flag);
+                val = mp4d_read(&rd, 1, &eof_flag);
                 read_bytes += 1;
                 if (eof_flag)
                 {
@@ -360,12 +528,27 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
                 int carry_size = 0;
                 uint32_t sample_size = READ(4);
                 tr->sample_count = READ(4);
+                if (box_name == BOX_stsz)
+                {
+                    tr->sample_size = sample_size;
+                    if (flags & MP4D_OPEN_LAZY_TABLES)
+                    {
+                        // Leave the table in the file.
+                        tr->entry_size_pos = sample_size ? 0 : TELL();
+                        break;
+                    }
+                }
                 MP4D_MALLOC(tr->entry_size, tr->sample_count*4);
+                if (box_name == BOX_stsz && !sample_size)
+                {
+                    READ_TABLE(tr->entry_size, tr->sample_count, 0);
+                    break;
+                }
                 for (i = 0; i < tr->sample_count; i++)
                 {
                     if (box_name == BOX_stsz)
                     {
-                       tr->entry_size[i] = (sample_size?sample_size:READ(4));
+                       tr->entry_size[i] = sample_size;
                     }
                     else
                     {
@@ -409,14 +592,26 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
             {
                 unsigned count = READ(4);
                 unsigned j, k = 0, ts = 0, ts_count = count;
-                MP4D_MALLOC(tr->timestamp, ts_count*4);
-                MP4D_MALLOC(tr->duration, ts_count*4);
+                int expand = !(flags & MP4D_OPEN_LAZY_TABLES);
+                tr->time_to_sample_count = count;
+                MP4D_MALLOC(tr->time_to_sample, count*sizeof(tr->time_to_sample[0]));
+                if (expand)
+                {
+                    MP4D_MALLOC(tr->timestamp, ts_count*4);
+                    MP4D_MALLOC(tr->duration, ts_count*4);
+                }
 
                 for (i = 0; i < count; i++)
                 {
                     unsigned sc = READ(4);
                     int d =  READ(4);
                     MP4D_TRACE(("sample %8d count %8d duration %8d\n",i,sc,d));
+                    tr->time_to_sample[i].sample_count = sc;
+                    tr->time_to_sample[i].sample_delta = d;
+                    if (!expand)
+                    {
+                        continue;
+                    }
                     if (k + sc > ts_count)
                     {
                         ts_count = k + sc;
@@ -450,15 +645,28 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
         case BOX_stco:  //ISO/IEC 14496-12 Page 39. Section 8.19 - Chunk Offset Box.
         case BOX_co64:
             tr->chunk_count = READ(4);
+            tr->chunk_offset_bytes = (box_name == BOX_co64) ? 8 : 4;
+            if (flags & MP4D_OPEN_LAZY_TABLES)
+            {
+                // Leave the table in the file.
+                tr->chunk_offset_pos = TELL();
+                break;
+            }
             MP4D_MALLOC(tr->chunk_offset, tr->chunk_count*sizeof(mp4d_size_t));
-            for (i = 0; i < tr->chunk_count; i++)
+            if (box_name == BOX_co64)
+            {
+                // 64-bit chunk_offset 
+                READ_TABLE(tr->chunk_offset, tr->chunk_count, 1);
+            }
+            else
             {
-                tr->chunk_offset[i] = READ(4);
-                if (box_name == BOX_co64)
+                // 32-bit offsets are converted in place from the tail, so
+                // the wider entries don't overwrite unconverted ones.
+                uint32_t * offset32 = (uint32_t *)tr->chunk_offset;
+                READ_TABLE(offset32, tr->chunk_count, 0);
+                for (i = tr->chunk_count; i-- > 0;)
                 {
-                    // 64-bit chunk_offset 
-                    tr->chunk_offset[i] <<= 32;
-                    tr->chunk_offset[i] |= READ(4);
+                    tr->chunk_offset[i] = offset32[i];
                 }
             }
             break;
@@ -654,7 +862,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
                 MP4D_MALLOC(tr->dsi, (int)payload_bytes);
                 for (i = 0; i < payload_bytes; i++)
                 {
-                    tr->dsi[i] = mp4d_read(f, 1, &eof_flag);    // These bytes available due to check above
+                    tr->dsi[i] = mp4d_read(&rd, 1, &eof_flag);    // These bytes available due to check above
                 }
                 tr->dsi_bytes = i;
                 payload_bytes -= i;
@@ -734,6 +942,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
     {
         MP4D_RETURN_ERROR("no tracks found");
     }
+    mp4d_reader_free(&rd);
     fseek(f, 0, SEEK_SET);
     return 1;
 }
@@ -822,6 +1031,7 @@ void MP4D__close(MP4D_demux_t * mp4)
         FREE(tr->duration);
         FREE(tr->sample_to_chunk);
         FREE(tr->chunk_offset);
+        FREE(tr->time_to_sample);
         FREE(tr->dsi);
     }
     FREE(mp4->track);
@@ -3,7 +3,8 @@
 *
 *   Portability note: this module uses:
 *   - Dynamic memory allocation (malloc(), realloc() and free()
-*   - Direct file access (fgetc(), fread() & fseek())
+*   - Direct file access (fread() & fseek()) through a buffered window;
+*     the top-level 'moov' box is loaded with a single read
 *   - File size (fstat())
 *
 *   This module provide functions to decode mp4 indexes, and retrieve
@@ -70,6 +71,12 @@ typedef struct
     unsigned         samples_per_chunk;
 } MP4D_sample_to_chunk_t;
 
+typedef struct
+{
+    unsigned         sample_count;
+    unsigned         sample_delta;
+} MP4D_time_to_sample_t;
+
 
 typedef struct
 {
@@ -174,6 +181,19 @@ typedef struct
     unsigned chunk_count;
     mp4d_size_t * chunk_offset;  // [chunk_count]
 
+    unsigned time_to_sample_count;
+    MP4D_time_to_sample_t * time_to_sample;     // [time_to_sample_count]
+
+    // Constant sample size (0 when the sizes are given with the table)
+    unsigned sample_size;
+
+    // Lazy tables (MP4D_OPEN_LAZY_TABLES): file positions of the sample
+    // size (32-bit) and chunk offset entries, which are left in the file.
+    // Zero when the table is loaded into the arrays above.
+    mp4d_size_t entry_size_pos;
+    mp4d_size_t chunk_offset_pos;
+    unsigned chunk_offset_bytes;    // 4 (stco) or 8 (co64)
+
 } MP4D_track_t;
 
 
@@ -224,6 +244,17 @@ typedef struct MP4D_demux_tag
 */
 int MP4D__open(MP4D_demux_t * mp4, FILE * f);
 
+/**
+*   MP4D__open() with option flags.
+*   MP4D_OPEN_LAZY_TABLES - Don't load the sample size (stsz) and chunk
+*       offset (stco/co64) tables, and don't expand the timestamps into
+*       per-sample arrays. The table positions are stored instead, and
+*       MP4D__frame_offset() can't be used with the track.
+*/
+#define MP4D_OPEN_LAZY_TABLES 1
+
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, unsigned flags);
+
 
 /**
 *   Return position and size for given sample from given track. The 'sample' is a
@@ -0,0 +1,450 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include "BlockScaler.h"
+
+namespace KlakHap
+{
+    //
+    // DXT to ASTC 4x4 block transcoder
+    //
+    // A DXT block maps onto a single-partition ASTC block with a 4x4 grid of
+    // 2-bit weights, which are close to the 1/3 steps of the DXT palette:
+    //
+    // - DXT1: LDR RGB direct endpoints (8-bit)
+    // - DXT5: LDR RGBA direct endpoints (48 levels) with a second weight
+    //   plane for alpha, which reduces the eight alpha levels to four
+    //
+    // The endpoints are least-squares fitted to the DXT palette entries
+    // weighted by their index counts, and each palette entry is remapped to
+    // the nearest ASTC weight, so the pixels are never decoded.
+    //
+    // The channels are transcoded as they are, so HAP Q (scaled YCoCg) stays
+    // in YCoCg and still needs the shader conversion.
+    //
+    class AstcBlock
+    {
+    public:
+
+        #pragma region Block transcoding
+
+        // DXT1 color block (8 bytes) to ASTC block (16 bytes)
+        static void TranscodeColor(const uint8_t* dxt, uint8_t* astc)
+        {
+            int palette[4][4], counts[4] = {}, indices[16];
+            BlockScaler::ColorPalette(dxt, false, palette);
+            GetColorIndices(dxt, indices, counts);
+
+            // Endpoint fitting and ordering
+            int e[2][4];
+            FitColor(palette, counts, e);
+            for (auto i = 0; i < 2; i++)
+                for (auto ch = 0; ch < 3; ch++) e[i][ch] = Clamp(e[i][ch], 0, 255);
+            e[0][3] = e[1][3] = 255;
+            if (IsSwapped(e[0], e[1])) std::swap(e[0], e[1]);
+
+            int map[4];
+            MapColors(palette, counts, e, map);
+
+            Block block;
+            block.Write(0, 11, kModeSinglePlane);
+            block.Write(13, 4, 8); // LDR RGB direct
+            for (auto ch = 0; ch < 3; ch++)
+            {
+                block.Write(17 + ch * 16, 8, e[0][ch]);
+                block.Write(25 + ch * 16, 8, e[1][ch]);
+            }
+            for (auto i = 0; i < 16; i++) block.WriteWeight(i, map[indices[i]]);
+            block.Store(astc);
+        }
+
+        // DXT5 block (16 bytes, BC4 alpha + DXT1 color) to ASTC block (16
+        // bytes)
+        static void TranscodeColorAlpha(const uint8_t* dxt5, uint8_t* astc)
+        {
+            int palette[4][4], counts[4] = {}, indices[16];
+            BlockScaler::ColorPalette(dxt5 + 8, true, palette);
+            GetColorIndices(dxt5 + 8, indices, counts);
+
+            int alphas[8], alphaCounts[8] = {}, alphaIndices[16];
+            BlockScaler::AlphaPalette(dxt5, alphas);
+            auto bits = BlockScaler::AlphaIndices(dxt5);
+            for (auto i = 0; i < 16; i++, bits >>= 3)
+            {
+                alphaIndices[i] = static_cast<int>(bits & 7);
+                alphaCounts[alphaIndices[i]]++;
+            }
+
+            // Endpoint fitting and quantization (codes and values)
+            int e[2][4], codes[2][4];
+            FitColor(palette, counts, e);
+            FitAlpha(alphas, alphaCounts, e[0][3], e[1][3]);
+            for (auto i = 0; i < 2; i++)
+            {
+                for (auto ch = 0; ch < 4; ch++)
+                {
+                    codes[i][ch] = QuantizeTrit48(Clamp(e[i][ch], 0, 255));
+                    e[i][ch] = UnquantizeTrit48(codes[i][ch]);
+                }
+            }
+            if (IsSwapped(e[0], e[1]))
+            {
+                std::swap(e[0], e[1]);
+                std::swap(codes[0], codes[1]);
+            }
+
+            int map[4], alphaMap[8];
+            MapColors(palette, counts, e, map);
+            MapAlphas(alphas, e[0][3], e[1][3], alphaMap);
+
+            Block block;
+            block.Write(0, 11, kModeDualPlane);
+            block.Write(13, 4, 12); // LDR RGBA direct
+
+            // Endpoint values (r0 r1 g0 g1 b0 b1 a0 a1) in two trit groups
+            int values[8];
+            for (auto ch = 0; ch < 4; ch++)
+                values[ch * 2] = codes[0][ch], values[ch * 2 + 1] = codes[1][ch];
+            auto position = WriteTrits(block, 17, values, 5);
+            WriteTrits(block, position, values + 5, 3);
+
+            block.Write(62, 2, 3); // The second plane is alpha.
+            for (auto i = 0; i < 16; i++)
+            {
+                block.WriteWeight(i * 2 + 0, map[indices[i]]);
+                block.WriteWeight(i * 2 + 1, alphaMap[alphaIndices[i]]);
+            }
+            block.Store(astc);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Block layout
+
+        // Block modes: a 4x4 weight grid with 2-bit weights (R = 4, H = 0),
+        // with and without the second plane
+        static constexpr int kModeSinglePlane = 0x042;
+        static constexpr int kModeDualPlane = 0x442;
+
+        // Unquantized 2-bit weights (out of 64)
+        static constexpr int kWeights[4] = {0, 21, 43, 64};
+
+        // 128-bit block builder: Fields are written from the bottom (LSB
+        // first), weights from the top in reverse bit order.
+        struct Block
+        {
+            uint64_t words[2] = {};
+
+            void Write(int position, int bits, int value)
+            {
+                for (auto i = 0; i < bits; i++)
+                {
+                    auto p = position + i;
+                    words[p >> 6] |= static_cast<uint64_t>((value >> i) & 1) << (p & 63);
+                }
+            }
+
+            void WriteWeight(int index, int value)
+            {
+                for (auto i = 0; i < 2; i++)
+                {
+                    auto p = 127 - (index * 2 + i);
+                    words[p >> 6] |= static_cast<uint64_t>((value >> i) & 1) << (p & 63);
+                }
+            }
+
+            void Store(uint8_t* output) const
+            {
+                for (auto i = 0; i < 16; i++)
+                    output[i] = static_cast<uint8_t>(words[i >> 3] >> ((i & 7) * 8));
+            }
+        };
+
+        #pragma endregion
+
+        #pragma region Endpoint fitting
+
+        static void GetColorIndices(const uint8_t* dxt, int* indices, int* counts)
+        {
+            auto bits = BlockScaler::ColorIndices(dxt);
+            for (auto i = 0; i < 16; i++, bits >>= 2)
+            {
+                indices[i] = static_cast<int>(bits & 3);
+                counts[indices[i]]++;
+            }
+        }
+
+        // RGB endpoints fitted to the used palette entries: The entries are
+        // placed on the 1/3 steps of the line between the farthest two and
+        // the endpoints are solved in the least-squares sense. This gives
+        // the DXT endpoints as they are for four-color blocks.
+        static void FitColor(const int palette[4][4], const int counts[4], int e[2][4])
+        {
+            // The farthest pair of the used entries
+            int a = -1, b = -1, farthest = -1;
+            for (auto i = 0; i < 4; i++)
+            {
+                if (counts[i] == 0) continue;
+                if (a < 0) a = b = i;
+                for (auto j = i + 1; j < 4; j++)
+                {
+                    if (counts[j] == 0) continue;
+                    auto d = Distance(palette[i], palette[j]);
+                    if (d > farthest) farthest = d, a = i, b = j;
+                }
+            }
+
+            for (auto ch = 0; ch < 3; ch++) e[0][ch] = palette[a][ch], e[1][ch] = palette[b][ch];
+            if (a == b) return;
+
+            // Steps on the line and the normal equations
+            double aa = 0, ab = 0, bb = 0, pa[3] = {}, pb[3] = {};
+            for (auto k = 0; k < 4; k++)
+            {
+                if (counts[k] == 0) continue;
+                auto dot = 0;
+                for (auto ch = 0; ch < 3; ch++)
+                    dot += (palette[k][ch] - palette[a][ch]) * (palette[b][ch] - palette[a][ch]);
+                auto step = Clamp(static_cast<int>(std::lround(3.0 * dot / farthest)), 0, 3);
+                double beta = step / 3.0, alpha = 1 - beta;
+                aa += counts[k] * alpha * alpha;
+                ab += counts[k] * alpha * beta;
+                bb += counts[k] * beta * beta;
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    pa[ch] += counts[k] * alpha * palette[k][ch];
+                    pb[ch] += counts[k] * beta * palette[k][ch];
+                }
+            }
+
+            auto det = aa * bb - ab * ab;
+            if (det < 1e-6) return;
+
+            for (auto ch = 0; ch < 3; ch++)
+            {
+                e[0][ch] = static_cast<int>(std::lround((bb * pa[ch] - ab * pb[ch]) / det));
+                e[1][ch] = static_cast<int>(std::lround((aa * pb[ch] - ab * pa[ch]) / det));
+            }
+        }
+
+        // Alpha endpoints fitted to the used levels in the same way
+        static void FitAlpha(const int alphas[8], const int counts[8], int& e0, int& e1)
+        {
+            auto lo = 255, hi = 0;
+            for (auto k = 0; k < 8; k++)
+                if (counts[k] > 0) lo = std::min(lo, alphas[k]), hi = std::max(hi, alphas[k]);
+
+            e0 = lo, e1 = hi;
+            if (hi == lo) return;
+
+            double aa = 0, ab = 0, bb = 0, pa = 0, pb = 0;
+            for (auto k = 0; k < 8; k++)
+            {
+                if (counts[k] == 0) continue;
+                auto step = static_cast<int>(std::lround(3.0 * (alphas[k] - lo) / (hi - lo)));
+                double beta = step / 3.0, alpha = 1 - beta;
+                aa += counts[k] * alpha * alpha;
+                ab += counts[k] * alpha * beta;
+                bb += counts[k] * beta * beta;
+                pa += counts[k] * alpha * alphas[k];
+                pb += counts[k] * beta * alphas[k];
+            }
+
+            auto det = aa * bb - ab * ab;
+            if (det < 1e-6) return;
+
+            e0 = static_cast<int>(std::lround((bb * pa - ab * pb) / det));
+            e1 = static_cast<int>(std::lround((aa * pb - ab * pa) / det));
+        }
+
+        // The decoder swaps the endpoints (with blue contraction) when the
+        // second one has the smaller RGB sum, so they're stored in order.
+        static bool IsSwapped(const int* e0, const int* e1)
+        {
+            return e1[0] + e1[1] + e1[2] < e0[0] + e0[1] + e0[2];
+        }
+
+        // Interpolation as done by the decoder (LDR, 16-bit intermediate)
+        static int Interpolate(int e0, int e1, int weight)
+        {
+            return ((e0 * 257 * (64 - weight) + e1 * 257 * weight + 32) >> 6) >> 8;
+        }
+
+        // Palette entry -> nearest weight
+        static void MapColors(const int palette[4][4], const int counts[4], const int e[2][4], int* map)
+        {
+            for (auto k = 0; k < 4; k++)
+            {
+                auto nearest = INT_MAX;
+                map[k] = 0;
+                if (counts[k] == 0) continue;
+                for (auto w = 0; w < 4; w++)
+                {
+                    int color[3];
+                    for (auto ch = 0; ch < 3; ch++)
+                        color[ch] = Interpolate(e[0][ch], e[1][ch], kWeights[w]);
+                    auto d = Distance(palette[k], color);
+                    if (d < nearest) nearest = d, map[k] = w;
+                }
+            }
+        }
+
+        static void MapAlphas(const int alphas[8], int e0, int e1, int* map)
+        {
+            for (auto k = 0; k < 8; k++)
+            {
+                auto nearest = INT_MAX;
+                for (auto w = 0; w < 4; w++)
+                {
+                    auto d = std::abs(alphas[k] - Interpolate(e0, e1, kWeights[w]));
+                    if (d < nearest) nearest = d, map[k] = w;
+                }
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Integer sequence encoding (trits)
+
+        // 48-level endpoint values: A trit and four bits each
+
+        static int UnquantizeTrit48(int code)
+        {
+            auto trit = code >> 4, bits = code & 15;
+            auto a = bits & 1 ? 0x1ff : 0;
+            auto dcb = (bits >> 1) & 7;
+            auto b = (dcb << 6) | dcb;
+            auto t = (trit * 22 + b) ^ a;
+            return (a & 0x80) | (t >> 2);
+        }
+
+        static int QuantizeTrit48(int value)
+        {
+            static const auto table = []
+            {
+                std::array<uint8_t, 256> t;
+                for (auto v = 0; v < 256; v++)
+                {
+                    auto nearest = INT_MAX;
+                    for (auto code = 0; code < 48; code++)
+                    {
+                        auto d = std::abs(UnquantizeTrit48(code) - v);
+                        if (d < nearest) nearest = d, t[v] = static_cast<uint8_t>(code);
+                    }
+                }
+                return t;
+            }();
+            return table[value];
+        }
+
+        // Five trits from an 8-bit packed value
+        static void UnpackTrits(int t, int* trits)
+        {
+            auto bit = [](int x, int i) { return (x >> i) & 1; };
+            int c;
+            if (((t >> 2) & 7) == 7)
+            {
+                c = (((t >> 5) & 7) << 2) | (t & 3);
+                trits[4] = 2;
+                trits[3] = 2;
+            }
+            else
+            {
+                c = t & 0x1f;
+                if (((t >> 5) & 3) == 3)
+                {
+                    trits[4] = 2;
+                    trits[3] = bit(t, 7);
+                }
+                else
+                {
+                    trits[4] = bit(t, 7);
+                    trits[3] = (t >> 5) & 3;
+                }
+            }
+
+            if ((c & 3) == 3)
+            {
+                trits[2] = 2;
+                trits[1] = bit(c, 4);
+                trits[0] = (bit(c, 3) << 1) | (bit(c, 2) & ~bit(c, 3) & 1);
+            }
+            else if (((c >> 2) & 3) == 3)
+            {
+                trits[2] = 2;
+                trits[1] = 2;
+                trits[0] = c & 3;
+            }
+            else
+            {
+                trits[2] = bit(c, 4);
+                trits[1] = (c >> 2) & 3;
+                trits[0] = (bit(c, 1) << 1) | (bit(c, 0) & ~bit(c, 1) & 1);
+            }
+        }
+
+        // Five trits to an 8-bit packed value (the inverse of UnpackTrits)
+        static int PackTrits(const int* trits)
+        {
+            static const auto table = []
+            {
+                std::array<uint8_t, 243> t = {};
+                std::array<bool, 243> found = {};
+                for (auto packed = 0; packed < 256; packed++)
+                {
+                    int u[5];
+                    UnpackTrits(packed, u);
+                    auto index = u[0] + u[1] * 3 + u[2] * 9 + u[3] * 27 + u[4] * 81;
+                    if (!found[index]) found[index] = true, t[index] = static_cast<uint8_t>(packed);
+                }
+                return t;
+            }();
+            return table[trits[0] + trits[1] * 3 + trits[2] * 9 + trits[3] * 27 + trits[4] * 81];
+        }
+
+        // Writes a group of up to five 48-level values and returns the next
+        // bit position. The packed trits are interleaved with the bits of
+        // the values (2, 2, 1, 2, 1 bits after each value).
+        static int WriteTrits(Block& block, int position, const int* values, int count)
+        {
+            int trits[5] = {};
+            for (auto i = 0; i < count; i++) trits[i] = values[i] >> 4;
+            auto packed = PackTrits(trits);
+
+            static constexpr int kTritBits[5] = {2, 2, 1, 2, 1};
+            auto shift = 0;
+            for (auto i = 0; i < count; i++)
+            {
+                block.Write(position, 4, values[i] & 15);
+                position += 4;
+                block.Write(position, kTritBits[i], packed >> shift);
+                position += kTritBits[i];
+                shift += kTritBits[i];
+            }
+            return position;
+        }
+
+        #pragma endregion
+
+        #pragma region Utility functions
+
+        static int Distance(const int* a, const int* b)
+        {
+            auto dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+            return dr * dr + dg * dg + db * db;
+        }
+
+        static int Clamp(int x, int lo, int hi)
+        {
+            return std::min(std::max(x, lo), hi);
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,427 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace KlakHap
+{
+    //
+    // Reduced-resolution decode mode (the values are shared with the C# side)
+    //
+    enum class DecodeScale : int
+    {
+        Full = 0,        // Full resolution
+        Half = 1,        // 1/2 width and height (compressed)
+        Quarter = 2,     // 1/4 width and height (compressed)
+        BlockAverage = 3 // One RGBA32 pixel per 4x4 block (1/16 of the pixels)
+    };
+
+    //
+    // Compressed-domain downscaler for DXT1/DXT5/BC4 textures
+    //
+    // Half: Each 2x2 group of blocks is decoded, box-filtered and encoded
+    // into a single block. Quarter and BlockAverage: The block averages are
+    // computed from the endpoint palettes and the index counts without
+    // decoding pixels; Quarter encodes 4x4 groups of them into a block.
+    //
+    class BlockScaler
+    {
+    public:
+
+        #pragma region Format queries
+
+        static bool IsSupported(int typeID)
+        {
+            switch (typeID & 0xf)
+            {
+            case 0xb: case 0xe: case 0xf: case 0x1: return true;
+            }
+            return false;
+        }
+
+        // Output dimensions in pixels for a given input size. The compressed
+        // outputs are padded to the block grid.
+        static void GetScaledSize(DecodeScale scale, int width, int height,
+                                  int& outWidth, int& outHeight)
+        {
+            auto bx = (width + 3) / 4, by = (height + 3) / 4;
+            switch (scale)
+            {
+            case DecodeScale::Half:
+                outWidth = (bx + 1) / 2 * 4; outHeight = (by + 1) / 2 * 4; break;
+            case DecodeScale::Quarter:
+                outWidth = (bx + 3) / 4 * 4; outHeight = (by + 3) / 4 * 4; break;
+            case DecodeScale::BlockAverage:
+                outWidth = bx; outHeight = by; break;
+            default:
+                outWidth = width; outHeight = height; break;
+            }
+        }
+
+        // Output buffer size in bytes
+        static size_t GetScaledBufferSize(DecodeScale scale, int width, int height, int typeID)
+        {
+            int w, h;
+            GetScaledSize(scale, width, height, w, h);
+            if (scale == DecodeScale::BlockAverage) return static_cast<size_t>(w) * h * 4;
+            return static_cast<size_t>(w / 4) * (h / 4) * GetFormat(typeID).blockBytes;
+        }
+
+        #pragma endregion
+
+        #pragma region Scaling operation
+
+        static void Scale(DecodeScale scale, int typeID,
+                          const uint8_t* input, int width, int height, uint8_t* output)
+        {
+            auto format = GetFormat(typeID);
+            auto bx = (width + 3) / 4, by = (height + 3) / 4;
+
+            if (scale == DecodeScale::Half)
+                ScaleHalf(format, input, bx, by, output);
+            else if (scale == DecodeScale::Quarter)
+                ScaleQuarter(format, input, bx, by, output);
+            else if (scale == DecodeScale::BlockAverage)
+                for (auto i = 0; i < bx * by; i++)
+                    AverageBlock(format, input + static_cast<size_t>(i) * format.blockBytes, output + i * 4);
+        }
+
+        #pragma endregion
+
+        // The block format description and the block decoding functions are
+        // shared with the output format transcoders (Transcoder.h).
+
+        #pragma region Block format description
+
+        struct Format
+        {
+            size_t blockBytes;
+            bool hasColor;    // DXT1 color block (at the end of the block)
+            int alphaChannel; // Channel of the BC4 alpha block (-1 = none)
+        };
+
+        static Format GetFormat(int typeID)
+        {
+            switch (typeID & 0xf)
+            {
+            case 0xb: return Format{8, true, -1};   // DXT1
+            case 0xe:
+            case 0xf: return Format{16, true, 3};   // DXT5/YCoCg
+            case 0x1: return Format{8, false, 0};   // BC4
+            }
+            return Format{0, false, -1};
+        }
+
+        using Pixels = uint8_t[16][4];
+
+        #pragma endregion
+
+        #pragma region Block decoding
+
+        static void ColorPalette(const uint8_t* block, bool forceFourColor, int palette[4][4])
+        {
+            auto c0 = block[0] | (block[1] << 8);
+            auto c1 = block[2] | (block[3] << 8);
+            Unpack565(c0, palette[0]);
+            Unpack565(c1, palette[1]);
+            palette[0][3] = palette[1][3] = 255;
+
+            for (auto ch = 0; ch < 3; ch++)
+            {
+                if (forceFourColor || c0 > c1)
+                {
+                    palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+                    palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+                }
+                else
+                {
+                    palette[2][ch] = (palette[0][ch] + palette[1][ch]) / 2;
+                    palette[3][ch] = 0;
+                }
+            }
+
+            palette[2][3] = 255;
+            palette[3][3] = (forceFourColor || c0 > c1) ? 255 : 0;
+        }
+
+        static void AlphaPalette(const uint8_t* block, int palette[8])
+        {
+            int a0 = block[0], a1 = block[1];
+            palette[0] = a0;
+            palette[1] = a1;
+            if (a0 > a1)
+            {
+                for (auto k = 2; k < 8; k++) palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+            }
+            else
+            {
+                for (auto k = 2; k < 6; k++) palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+        }
+
+        static uint64_t AlphaIndices(const uint8_t* block)
+        {
+            uint64_t bits = 0;
+            for (auto i = 7; i >= 2; i--) bits = (bits << 8) | block[i];
+            return bits;
+        }
+
+        static uint32_t ColorIndices(const uint8_t* block)
+        {
+            return block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+        }
+
+        static void DecodeBlock(const Format& format, const uint8_t* block, Pixels& pixels)
+        {
+            for (auto i = 0; i < 16; i++)
+                pixels[i][0] = pixels[i][1] = pixels[i][2] = 0, pixels[i][3] = 255;
+
+            if (format.alphaChannel >= 0)
+            {
+                int palette[8];
+                AlphaPalette(block, palette);
+                auto bits = AlphaIndices(block);
+                for (auto i = 0; i < 16; i++, bits >>= 3)
+                    pixels[i][format.alphaChannel] = static_cast<uint8_t>(palette[bits & 7]);
+            }
+
+            if (format.hasColor)
+            {
+                auto color = block + format.blockBytes - 8;
+                int palette[4][4];
+                ColorPalette(color, format.alphaChannel >= 0, palette);
+                auto bits = ColorIndices(color);
+                for (auto i = 0; i < 16; i++, bits >>= 2)
+                {
+                    auto& p = palette[bits & 3];
+                    for (auto ch = 0; ch < 3; ch++) pixels[i][ch] = static_cast<uint8_t>(p[ch]);
+                    if (format.alphaChannel != 3) pixels[i][3] = static_cast<uint8_t>(p[3]);
+                }
+            }
+        }
+
+        // Block average from the palettes and the index counts
+        static void AverageBlock(const Format& format, const uint8_t* block, uint8_t* rgba)
+        {
+            int sum[4] = {0, 0, 0, 255 * 16};
+
+            if (format.alphaChannel >= 0)
+            {
+                int palette[8], counts[8] = {};
+                AlphaPalette(block, palette);
+                auto bits = AlphaIndices(block);
+                for (auto i = 0; i < 16; i++, bits >>= 3) counts[bits & 7]++;
+                sum[format.alphaChannel] = 0;
+                for (auto k = 0; k < 8; k++) sum[format.alphaChannel] += counts[k] * palette[k];
+            }
+
+            if (format.hasColor)
+            {
+                auto color = block + format.blockBytes - 8;
+                int palette[4][4], counts[4] = {};
+                ColorPalette(color, format.alphaChannel >= 0, palette);
+                auto bits = ColorIndices(color);
+                for (auto i = 0; i < 16; i++, bits >>= 2) counts[bits & 3]++;
+                auto channels = format.alphaChannel == 3 ? 3 : 4;
+                for (auto ch = 0; ch < channels; ch++)
+                {
+                    sum[ch] = 0;
+                    for (auto k = 0; k < 4; k++) sum[ch] += counts[k] * palette[k][ch];
+                }
+            }
+
+            for (auto ch = 0; ch < 4; ch++) rgba[ch] = static_cast<uint8_t>((sum[ch] + 8) / 16);
+        }
+
+        static void Unpack565(int c, int* rgb)
+        {
+            auto r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Block encoding
+
+        static void EncodeBlock(const Format& format, const Pixels& pixels, uint8_t* block)
+        {
+            if (format.alphaChannel >= 0) EncodeAlpha(pixels, format.alphaChannel, block);
+            if (format.hasColor) EncodeColor(pixels, block + format.blockBytes - 8);
+        }
+
+        // Bounding box fit in the 8-value mode
+        static void EncodeAlpha(const Pixels& pixels, int channel, uint8_t* block)
+        {
+            int lo = 255, hi = 0;
+            for (auto i = 0; i < 16; i++)
+            {
+                lo = std::min<int>(lo, pixels[i][channel]);
+                hi = std::max<int>(hi, pixels[i][channel]);
+            }
+
+            block[0] = static_cast<uint8_t>(hi);
+            block[1] = static_cast<uint8_t>(lo);
+
+            uint64_t bits = 0;
+            if (hi > lo)
+            {
+                for (auto i = 15; i >= 0; i--)
+                {
+                    auto s = ((pixels[i][channel] - lo) * 14 + (hi - lo)) / (2 * (hi - lo));
+                    auto index = s == 7 ? 0 : (s == 0 ? 1 : 8 - s);
+                    bits = (bits << 3) | static_cast<uint64_t>(index);
+                }
+            }
+
+            for (auto i = 2; i < 8; i++, bits >>= 8) block[i] = static_cast<uint8_t>(bits);
+        }
+
+        // Endpoints at the extremes along the principal axis (found with a
+        // few power iterations on the covariance), four-color mode
+        static void EncodeColor(const Pixels& pixels, uint8_t* block)
+        {
+            float mean[3] = {};
+            for (auto i = 0; i < 16; i++)
+                for (auto ch = 0; ch < 3; ch++) mean[ch] += pixels[i][ch] / 16.0f;
+
+            float cov[6] = {};
+            for (auto i = 0; i < 16; i++)
+            {
+                auto r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+                cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+                cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+            }
+
+            float axis[3] = {1, 1, 1};
+            for (auto iter = 0; iter < 4; iter++)
+            {
+                float v[3] = {
+                    cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                    cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                    cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+                };
+                auto m = std::max(std::max(std::abs(v[0]), std::abs(v[1])), std::abs(v[2]));
+                if (m < 1e-6f) break;
+                for (auto ch = 0; ch < 3; ch++) axis[ch] = v[ch] / m;
+            }
+
+            auto lo = 0, hi = 0;
+            float loDot = 1e30f, hiDot = -1e30f;
+            for (auto i = 0; i < 16; i++)
+            {
+                auto dot = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+                if (dot < loDot) { loDot = dot; lo = i; }
+                if (dot > hiDot) { hiDot = dot; hi = i; }
+            }
+
+            int maxColor[3] = {pixels[hi][0], pixels[hi][1], pixels[hi][2]};
+            int minColor[3] = {pixels[lo][0], pixels[lo][1], pixels[lo][2]};
+            auto c0 = Pack565(maxColor), c1 = Pack565(minColor);
+            if (c0 < c1) std::swap(c0, c1);
+
+            uint32_t bits = 0;
+            if (c0 != c1)
+            {
+                int e0[3], e1[3], delta[3];
+                Unpack565(c0, e0);
+                Unpack565(c1, e1);
+                for (auto ch = 0; ch < 3; ch++) delta[ch] = e0[ch] - e1[ch];
+                auto length = delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2];
+
+                for (auto i = 15; i >= 0; i--)
+                {
+                    // Projection onto the endpoint line (0 = c1, 3 = c0)
+                    auto dot = 0;
+                    for (auto ch = 0; ch < 3; ch++) dot += (pixels[i][ch] - e1[ch]) * delta[ch];
+                    auto s = std::min(std::max((dot * 6 + length) / (2 * length), 0), 3);
+                    static const uint32_t kIndex[4] = {1, 3, 2, 0};
+                    bits = (bits << 2) | kIndex[s];
+                }
+            }
+
+            block[0] = static_cast<uint8_t>(c0);
+            block[1] = static_cast<uint8_t>(c0 >> 8);
+            block[2] = static_cast<uint8_t>(c1);
+            block[3] = static_cast<uint8_t>(c1 >> 8);
+            for (auto i = 4; i < 8; i++, bits >>= 8) block[i] = static_cast<uint8_t>(bits);
+        }
+
+        static int Pack565(const int* rgb)
+        {
+            return ((rgb[0] * 31 + 127) / 255 << 11) |
+                   ((rgb[1] * 63 + 127) / 255 << 5) |
+                    (rgb[2] * 31 + 127) / 255;
+        }
+
+        #pragma endregion
+
+        #pragma region Scaling implementation
+
+        static void ScaleHalf(const Format& format, const uint8_t* input, int bx, int by, uint8_t* output)
+        {
+            auto ox = (bx + 1) / 2, oy = (by + 1) / 2;
+            Pixels quad[4], out;
+
+            for (auto y = 0; y < oy; y++)
+            {
+                for (auto x = 0; x < ox; x++)
+                {
+                    // Source 2x2 blocks (clamped at the edges)
+                    for (auto k = 0; k < 4; k++)
+                    {
+                        auto sx = std::min(x * 2 + (k & 1), bx - 1);
+                        auto sy = std::min(y * 2 + (k >> 1), by - 1);
+                        DecodeBlock(format, input + (static_cast<size_t>(sy) * bx + sx) * format.blockBytes, quad[k]);
+                    }
+
+                    // 2x2 box filter
+                    for (auto i = 0; i < 16; i++)
+                    {
+                        auto px = (i & 3) * 2, py = (i >> 2) * 2;
+                        auto& src = quad[(px >> 2) + (py >> 2) * 2];
+                        auto p = (px & 3) + (py & 3) * 4;
+                        for (auto ch = 0; ch < 4; ch++)
+                            out[i][ch] = static_cast<uint8_t>((src[p][ch] + src[p + 1][ch] +
+                                                               src[p + 4][ch] + src[p + 5][ch] + 2) / 4);
+                    }
+
+                    EncodeBlock(format, out, output);
+                    output += format.blockBytes;
+                }
+            }
+        }
+
+        static void ScaleQuarter(const Format& format, const uint8_t* input, int bx, int by, uint8_t* output)
+        {
+            auto ox = (bx + 3) / 4, oy = (by + 3) / 4;
+            Pixels out;
+
+            for (auto y = 0; y < oy; y++)
+            {
+                for (auto x = 0; x < ox; x++)
+                {
+                    // One pixel per source block (clamped at the edges)
+                    for (auto i = 0; i < 16; i++)
+                    {
+                        auto sx = std::min(x * 4 + (i & 3), bx - 1);
+                        auto sy = std::min(y * 4 + (i >> 2), by - 1);
+                        AverageBlock(format, input + (static_cast<size_t>(sy) * bx + sx) * format.blockBytes, out[i]);
+                    }
+
+                    EncodeBlock(format, out, output);
+                    output += format.blockBytes;
+                }
+            }
+        }
+
+        #pragma endregion
+    };
+}
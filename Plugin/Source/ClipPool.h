@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include "ClipSource.h"
+#include "WorkerPool.h"
+
+namespace KlakHap
+{
+    //
+    // Prewarmed clip pool
+    //
+    // Keeps a bounded LRU list of clips that the host expects to play
+    // soon (e.g. the next entries of a playlist). A hinted clip is opened,
+    // parsed (and indexed when the frame index is enabled) on the shared
+    // worker pool, and its first frames are read into the OS page cache.
+    // The pool holds references to the shared clips (see ClipSource), so
+    // opening a demuxer of a warm clip doesn't touch the file at all.
+    //
+    // Opening a warm clip moves it to the head of the list. The least
+    // recently used clips are released when the pool is over capacity;
+    // they stay open while demuxers are using them.
+    //
+    class ClipPool
+    {
+    public:
+
+        #pragma region Shared instance
+
+        // Process-wide pool. It's never destroyed, as prewarming tasks on
+        // the worker pool can outlive the callers.
+        static ClipPool& GetShared()
+        {
+            static auto pool = new ClipPool;
+            return *pool;
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        // Maximum number of warm clips (zero disables prewarming)
+        void SetCapacity(int capacity)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capacity_ = static_cast<size_t>(std::max(capacity, 0));
+            Trim();
+        }
+
+        // Opens a clip in the background and keeps it warm.
+        void Prewarm(const char* path)
+        {
+            uint64_t generation;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (capacity_ == 0 || !pending_.insert(path).second) return;
+                generation = generation_;
+            }
+
+            std::string key(path);
+            WorkerPool::GetShared().Enqueue([this, key, generation]
+            {
+                auto source = ClipSource::Open(key.c_str());
+                if (source != nullptr) source->ReadAhead(kReadAheadFrames);
+
+                // A task discarded by Clear() doesn't own the pending entry
+                // anymore (the path may have been hinted again since).
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (generation != generation_) return;
+                pending_.erase(key);
+                if (source != nullptr) Insert(std::move(source));
+            });
+        }
+
+        // Moves a warm clip to the head of the list (called on open).
+        void Touch(const std::shared_ptr<ClipSource>& source)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find(clips_.begin(), clips_.end(), source);
+            if (it != clips_.end()) clips_.splice(clips_.begin(), clips_, it);
+        }
+
+        // Releases the warm clips. Pending prewarming is discarded.
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            clips_.clear();
+            pending_.clear();
+            generation_++;
+        }
+
+        void GetState(int& warm, int& pending)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            warm = static_cast<int>(clips_.size());
+            pending = static_cast<int>(pending_.size());
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        // Frames read into the page cache per clip
+        static constexpr int kReadAheadFrames = 4;
+
+        std::mutex mutex_;
+        std::list<std::shared_ptr<ClipSource>> clips_; // Most recent first
+        std::set<std::string> pending_;
+        size_t capacity_ = 8;
+        uint64_t generation_ = 0;
+
+        ClipPool() = default;
+
+        void Insert(std::shared_ptr<ClipSource> source)
+        {
+            auto it = std::find(clips_.begin(), clips_.end(), source);
+            if (it != clips_.end())
+                clips_.splice(clips_.begin(), clips_, it);
+            else
+                clips_.push_front(std::move(source));
+            Trim();
+        }
+
+        void Trim()
+        {
+            while (clips_.size() > capacity_) clips_.pop_back();
+        }
+
+        #pragma endregion
+    };
+}
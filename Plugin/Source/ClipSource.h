@@ -0,0 +1,473 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "mp4demux.h"
+#include "hap.h"
+#include "FileReader.h"
+#include "FrameIndex.h"
+#include "PagedSampleTable.h"
+#include "ReadBuffer.h"
+#include "SampleTable.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // Parsed clip shared between demuxers
+    //
+    // The video properties, the frame table (compact, paged, or mapped
+    // from the frame index) and the file handle of a clip. The instances
+    // are shared through a registry keyed by the canonical path and the
+    // identity of the file (device/inode or volume/file index, size and
+    // modification time), so playing the same clip many times parses it
+    // once. A modified or replaced file gets a new instance.
+    //
+    // The instances are immutable after loading except for the paged
+    // table cache, which is guarded by a lock, so they can be used from
+    // any thread.
+    //
+    class ClipSource
+    {
+    public:
+
+        #pragma region Shared instances
+
+        // Returns the shared instance for a file, loading it when there's
+        // no live one. Returns null when the file can't be opened or parsed.
+        static std::shared_ptr<ClipSource> Open(const char* path)
+        {
+            Key key;
+            if (!GetKey(path, key)) return Load(path);
+
+            {
+                std::lock_guard<std::mutex> lock(GetRegistryMutex());
+                auto it = GetRegistry().find(key);
+                if (it != GetRegistry().end())
+                    if (auto source = it->second.lock()) return source;
+            }
+
+            // Loaded without the lock, so other clips can be opened
+            // meanwhile. The first one registered wins a race.
+            auto source = Load(path);
+            if (source == nullptr) return nullptr;
+
+            std::lock_guard<std::mutex> lock(GetRegistryMutex());
+            auto& registry = GetRegistry();
+            for (auto it = registry.begin(); it != registry.end();)
+                it = it->second.expired() ? registry.erase(it) : std::next(it);
+
+            auto& entry = registry[key];
+            if (auto existing = entry.lock()) return existing;
+            entry = source;
+            return source;
+        }
+
+        // Number of live shared instances
+        static int GetSharedCount()
+        {
+            std::lock_guard<std::mutex> lock(GetRegistryMutex());
+            auto count = 0;
+            for (const auto& entry : GetRegistry()) if (!entry.second.expired()) count++;
+            return count;
+        }
+
+        #pragma endregion
+
+        #pragma region Constructor/destructor
+
+        explicit ClipSource(const char* path)
+          : file_(path)
+        {
+            if (!file_.IsValid()) return;
+
+            // Try the sidecar frame index first.
+            auto useIndex = FrameIndex::IsEnabled();
+            if (useIndex && OpenIndex(path)) { valid_ = true; return; }
+
+            // Paged tables are only used when the clip isn't indexed.
+            auto threshold = useIndex ? 0 : PagedSampleTable::GetThreshold();
+
+            MP4D_demux_t demux;
+            std::memset(&demux, 0, sizeof(MP4D_demux_t));
+
+            auto flags = threshold > 0 ? MP4D_OPEN_LAZY_TABLES : 0u;
+            if (!MP4D__open_ex(&demux, file_.GetStdioHandle(), flags)) return;
+
+            // The MP4 sample tables are converted into the compact form and
+            // released right after that.
+            valid_ = LoadTrack(demux.track[0], threshold);
+            MP4D__close(&demux);
+
+            // Lazy tables can't be paged with some layouts (e.g. stz2).
+            // Retry with the tables loaded.
+            if (!valid_ && flags != 0 &&
+                MP4D__open_ex(&demux, file_.GetStdioHandle(), 0))
+            {
+                valid_ = LoadTrack(demux.track[0], 0);
+                MP4D__close(&demux);
+            }
+
+            if (valid_ && useIndex) BuildIndex(path);
+        }
+
+        ClipSource(const ClipSource&) = delete;
+        ClipSource& operator=(const ClipSource&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsValid() const
+        {
+            return valid_;
+        }
+
+        bool IsIndexed() const
+        {
+            return index_.IsValid();
+        }
+
+        bool IsPaged() const
+        {
+            return paged_.IsValid();
+        }
+
+        const VideoProperties& GetProperties() const
+        {
+            return props_;
+        }
+
+        // The file of the clip (readers are created from it, see FileReader)
+        const FileReader& GetFile() const
+        {
+            return file_;
+        }
+
+        #pragma endregion
+
+        #pragma region Frame table
+
+        // Frame data location (clamped to the last frame)
+        void Locate(int index, uint64_t& offset, uint32_t& size)
+        {
+            auto count = props_.frameCount;
+            auto i = static_cast<uint32_t>(index) < count ? static_cast<uint32_t>(index) : count - 1;
+
+            if (paged_.IsValid())
+            {
+                std::lock_guard<std::mutex> lock(pageLock_);
+                paged_.Locate(file_, i, offset, size);
+            }
+            else
+            {
+                table_.Locate(i, offset, size);
+            }
+        }
+
+        // Upper bound of the frame sizes (zero when unknown, as with paged
+        // tables)
+        size_t GetMaxFrameSize() const
+        {
+            return paged_.IsValid() ? 0 : table_.GetMaxSizeBound();
+        }
+
+        // Reads the first frames, so that they're in the OS page cache
+        // when the playback starts.
+        void ReadAhead(int frameCount)
+        {
+            std::vector<uint8_t> buffer;
+            auto count = std::min(static_cast<uint32_t>(std::max(frameCount, 0)), props_.frameCount);
+            for (auto i = 0u; i < count; i++)
+            {
+                uint64_t offset;
+                uint32_t size;
+                Locate(static_cast<int>(i), offset, size);
+                buffer.resize(size);
+                file_.ReadRaw(offset, buffer.data(), size);
+            }
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        FileReader file_;
+        FrameIndex index_;
+        SampleTable table_;
+        PagedSampleTable paged_;
+        VideoProperties props_ = {};
+        std::mutex pageLock_;
+        bool valid_ = false;
+
+        static std::shared_ptr<ClipSource> Load(const char* path)
+        {
+            auto source = std::make_shared<ClipSource>(path);
+            return source->IsValid() ? source : nullptr;
+        }
+
+        #pragma endregion
+
+        #pragma region Registry
+
+        struct Key
+        {
+            std::string path;
+            uint64_t device, file, size;
+            int64_t time;
+
+            bool operator<(const Key& other) const
+            {
+                return std::tie(path, device, file, size, time) <
+                       std::tie(other.path, other.device, other.file, other.size, other.time);
+            }
+        };
+
+        using Registry = std::map<Key, std::weak_ptr<ClipSource>>;
+
+        static Registry& GetRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        static std::mutex& GetRegistryMutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        #pragma endregion
+
+        #pragma region Table setup
+
+        bool LoadTrack(const MP4D_track_t& track, uint32_t pagingThreshold)
+        {
+            if (track.sample_count == 0) return false;
+
+            props_.frameCount = track.sample_count;
+            props_.width = track.SampleDescription.video.width;
+            props_.height = track.SampleDescription.video.height;
+            props_.timescale = track.timescale;
+            props_.duration = (static_cast<uint64_t>(track.duration_hi) << 32) | track.duration_lo;
+
+            auto runs = SampleTable::BuildRuns(track);
+
+            if (track.chunk_offset_pos != 0)
+            {
+                // Lazy tables: Keep them paged for long clips, or convert
+                // them into the compact form by locating the frames in
+                // order (each step continues from the paged table's cursor
+                // instead of summing the chunk from its head).
+                if (!paged_.Init(track)) return false;
+                if (props_.frameCount < pagingThreshold)
+                {
+                    uint32_t i = 0;
+                    table_.Build(props_.frameCount, [&](uint64_t& offset, uint32_t& size)
+                                 { paged_.Locate(file_, i++, offset, size); }, runs);
+                    paged_.Reset();
+                }
+            }
+            else
+            {
+                table_.Build(props_.frameCount, TrackReader(track), runs);
+            }
+
+            // Video type field in the first frame
+            uint64_t offset;
+            uint32_t size;
+            Locate(0, offset, size);
+            uint8_t type = 0;
+            file_.ReadRaw(offset + 3, &type, 1);
+            props_.videoType = type;
+
+            return true;
+        }
+
+        // Sequential frame reader for the MP4 sample tables: The same
+        // mapping as MP4D__frame_offset without the per-frame chunk search.
+        struct TrackReader
+        {
+            const MP4D_track_t& track;
+            bool started = false;
+            unsigned chunk = 0, group = 0, perChunk = 0, inChunk = 0, sample = 0;
+            uint64_t offset = 0;
+
+            TrackReader(const MP4D_track_t& t) : track(t) {}
+
+            bool NextChunk()
+            {
+                if (started) chunk++;
+                started = true;
+                if (chunk >= track.chunk_count) return false;
+
+                if (track.chunk_count <= 1)
+                    perChunk = track.sample_count;
+                else
+                {
+                    if (group + 1 < track.sample_to_chunk_count &&
+                        chunk + 1 == track.sample_to_chunk[group + 1].first_chunk) group++;
+                    perChunk = track.sample_to_chunk[group].samples_per_chunk;
+                }
+
+                offset = track.chunk_offset[chunk];
+                inChunk = 0;
+                return true;
+            }
+
+            void operator()(uint64_t& outOffset, uint32_t& outSize)
+            {
+                outOffset = 0;
+                outSize = 0;
+
+                while (!started || inChunk == perChunk)
+                    if (!NextChunk()) return;
+
+                outOffset = offset;
+                outSize = track.entry_size ? track.entry_size[sample] : track.sample_size;
+                offset += outSize;
+                inChunk++;
+                sample++;
+            }
+        };
+
+        #pragma endregion
+
+        #pragma region Frame index support
+
+        bool OpenIndex(const char* path)
+        {
+            uint64_t size;
+            int64_t time;
+            if (!FrameIndex::GetSourceStamp(file_.GetStdioHandle(), size, time)) return false;
+            if (!index_.Open(FrameIndex::GetPath(path), size, time)) return false;
+
+            const auto& header = index_.GetHeader();
+            if (!table_.Attach(header.table, index_.GetTableData(), index_.GetTableDataSize()))
+                return false;
+
+            props_ = header.video;
+            return true;
+        }
+
+        // Writes the sample table as a sidecar file. When it succeeds, the
+        // table is switched to the mapped file.
+        void BuildIndex(const char* path)
+        {
+            FrameIndex::Header header = {};
+            std::memcpy(header.magic, "KHIX", 4);
+            header.version = FrameIndex::kVersion;
+            if (!FrameIndex::GetSourceStamp(file_.GetStdioHandle(),
+                                            header.sourceSize, header.sourceTime)) return;
+
+            // Hap chunk count of the first frame
+            uint64_t offset;
+            uint32_t size;
+            Locate(0, offset, size);
+            ReadBuffer first;
+            file_.Read(offset, size, first);
+            int chunkCount = 0;
+            if (HapGetFrameTextureChunkCount(first.data(), static_cast<unsigned long>(first.size()),
+                                             0, &chunkCount) == HapResult_No_Error)
+                props_.chunkCount = static_cast<uint32_t>(chunkCount);
+
+            header.video = props_;
+            header.table = table_.GetLayout();
+
+            auto indexPath = FrameIndex::GetPath(path);
+            if (!FrameIndex::Write(indexPath, header, table_.GetData())) return;
+            if (!index_.Open(indexPath, header.sourceSize, header.sourceTime)) return;
+
+            table_.Attach(header.table, index_.GetTableData(), index_.GetTableDataSize());
+        }
+
+        #pragma endregion
+
+        #pragma region Platform-dependent implementation
+
+    #ifdef _WIN32
+
+        static std::wstring Widen(const char* path)
+        {
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+            if (wlen <= 0) return std::wstring();
+            std::wstring wpath(wlen, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path, -1, &wpath[0], wlen);
+            wpath.resize(wlen - 1);
+            return wpath;
+        }
+
+        static std::string Narrow(const wchar_t* path)
+        {
+            int len = WideCharToMultiByte(CP_UTF8, 0, path, -1, nullptr, 0, nullptr, nullptr);
+            if (len <= 0) return std::string();
+            std::string result(len, '\0');
+            WideCharToMultiByte(CP_UTF8, 0, path, -1, &result[0], len, nullptr, nullptr);
+            result.resize(len - 1);
+            return result;
+        }
+
+        // Canonical path and identity of a file
+        static bool GetKey(const char* path, Key& key)
+        {
+            auto file = CreateFileW(Widen(path).c_str(), 0,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return false;
+
+            BY_HANDLE_FILE_INFORMATION info;
+            wchar_t buffer[MAX_PATH * 4];
+            auto valid = GetFileInformationByHandle(file, &info) != 0;
+            auto length = GetFinalPathNameByHandleW(file, buffer, MAX_PATH * 4, FILE_NAME_NORMALIZED);
+            CloseHandle(file);
+            if (!valid || length == 0 || length >= MAX_PATH * 4) return false;
+
+            key.path = Narrow(buffer);
+            key.device = info.dwVolumeSerialNumber;
+            key.file = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+            key.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+            key.time = (static_cast<int64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+                       info.ftLastWriteTime.dwLowDateTime;
+            return true;
+        }
+
+    #else
+
+        // Canonical path and identity of a file
+        static bool GetKey(const char* path, Key& key)
+        {
+            auto canonical = realpath(path, nullptr);
+            if (canonical == nullptr) return false;
+            key.path = canonical;
+            free(canonical);
+
+            struct stat st;
+            if (stat(key.path.c_str(), &st) != 0) return false;
+
+            key.device = static_cast<uint64_t>(st.st_dev);
+            key.file = static_cast<uint64_t>(st.st_ino);
+            key.size = static_cast<uint64_t>(st.st_size);
+            key.time = FrameIndex::GetModificationTime(st);
+            return true;
+        }
+
+    #endif
+
+        #pragma endregion
+    };
+}
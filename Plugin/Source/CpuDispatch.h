@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include "snappy-c.h"
+
+#if defined(KLAKHAP_CPU_DISPATCH)
+
+#include <cpuid.h>
+#include "snappy.h"
+
+// Snappy builds for the instruction set variants (SnappyVariant.cpp)
+namespace snappy_ssse3
+{
+    bool RawUncompress(const char* compressed, size_t length, char* uncompressed);
+}
+
+namespace snappy_avx2
+{
+    bool RawUncompress(const char* compressed, size_t length, char* uncompressed);
+}
+
+#endif
+
+namespace KlakHap
+{
+    enum class CpuVariant { Baseline = 0, SSSE3 = 1, AVX2 = 2 };
+
+    //
+    // Runtime CPU feature dispatch
+    //
+    // On x86-64, the Snappy decompressor is also built for SSSE3 and
+    // AVX2+BMI2. The best variant for the CPU is selected on first use.
+    // The KLAKHAP_CPU_VARIANT environment variable (baseline, ssse3, avx2)
+    // caps the selection for troubleshooting. Other architectures only
+    // have the baseline build.
+    //
+    class CpuDispatch
+    {
+    public:
+
+        #pragma region Public methods
+
+        static CpuVariant GetVariant()
+        {
+            static const auto variant = SelectVariant();
+            return variant;
+        }
+
+        static const char* GetVariantName(CpuVariant variant)
+        {
+            switch (variant)
+            {
+            case CpuVariant::SSSE3: return "ssse3";
+            case CpuVariant::AVX2: return "avx2";
+            default: return "baseline";
+            }
+        }
+
+        // Drop-in replacement for snappy_uncompress
+        static snappy_status SnappyUncompress(const char* compressed, size_t compressedLength,
+                                              char* uncompressed, size_t* uncompressedLength)
+        {
+        #if defined(KLAKHAP_CPU_DISPATCH)
+            size_t length;
+            if (!snappy::GetUncompressedLength(compressed, compressedLength, &length))
+                return SNAPPY_INVALID_INPUT;
+            if (*uncompressedLength < length) return SNAPPY_BUFFER_TOO_SMALL;
+            if (!GetRawUncompress()(compressed, compressedLength, uncompressed))
+                return SNAPPY_INVALID_INPUT;
+            *uncompressedLength = length;
+            return SNAPPY_OK;
+        #else
+            return snappy_uncompress(compressed, compressedLength, uncompressed, uncompressedLength);
+        #endif
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Variant selection
+
+        static CpuVariant SelectVariant()
+        {
+            auto variant = DetectVariant();
+            auto limit = std::getenv("KLAKHAP_CPU_VARIANT");
+            if (limit == nullptr) return variant;
+            if (std::strcmp(limit, "baseline") == 0) return CpuVariant::Baseline;
+            if (std::strcmp(limit, "ssse3") == 0 && variant > CpuVariant::SSSE3) return CpuVariant::SSSE3;
+            return variant;
+        }
+
+        static CpuVariant DetectVariant()
+        {
+        #if defined(KLAKHAP_CPU_DISPATCH)
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return CpuVariant::Baseline;
+            if (!(ecx & bit_SSSE3)) return CpuVariant::Baseline;
+
+            // AVX2 needs the OS to save the YMM registers.
+            if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return CpuVariant::SSSE3;
+            unsigned int xcr0, xcr0High;
+            __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+            if ((xcr0 & 6) != 6) return CpuVariant::SSSE3;
+
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return CpuVariant::SSSE3;
+            if (!(ebx & bit_AVX2) || !(ebx & bit_BMI2)) return CpuVariant::SSSE3;
+
+            return CpuVariant::AVX2;
+        #else
+            return CpuVariant::Baseline;
+        #endif
+        }
+
+        #if defined(KLAKHAP_CPU_DISPATCH)
+
+        using RawUncompressFunc = bool (*)(const char*, size_t, char*);
+
+        static RawUncompressFunc GetRawUncompress()
+        {
+            static const auto func = SelectRawUncompress();
+            return func;
+        }
+
+        static RawUncompressFunc SelectRawUncompress()
+        {
+            switch (GetVariant())
+            {
+            case CpuVariant::SSSE3: return snappy_ssse3::RawUncompress;
+            case CpuVariant::AVX2: return snappy_avx2::RawUncompress;
+            default: return snappy::RawUncompress;
+            }
+        }
+
+        #endif
+
+        #pragma endregion
+    };
+}
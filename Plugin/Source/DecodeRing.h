@@ -0,0 +1,378 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Decoder.h"
+#include "Demuxer.h"
+#include "FrameBuffer.h"
+#include "ReadBuffer.h"
+#include "Trace.h"
+
+namespace KlakHap
+{
+    //
+    // Decode-ahead ring
+    //
+    // Keeps a ring of fully decoded frames ahead of the playhead. A worker
+    // thread reads and decodes the frames that the playback is going to
+    // show, following the same schedule as the C# stream reader (a start
+    // time and a time step per update). Presenting a frame swaps its slot
+    // with the decoder's output buffer, so the texture update paths work
+    // unchanged and no frame data is copied.
+    //
+    // The ring replaces the decoder's own frame decoding; DecodeFrame
+    // shouldn't be called while a ring is attached.
+    //
+    // Seeking is asynchronous: Seek() restarts the schedule and returns
+    // immediately, and Present() without waiting keeps the current frame
+    // until the target frame is decoded. A newer seek supersedes the
+    // older ones; frames read for a superseded schedule aren't decoded.
+    //
+    class DecodeRing
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        DecodeRing(Demuxer& demuxer, Decoder& decoder, int capacity)
+          : demuxer_(demuxer), decoder_(decoder)
+        {
+            frameCount_ = static_cast<int>(demuxer.GetFrameCount());
+            auto duration = demuxer.GetDuration();
+            frameRate_ = duration > 0 ? frameCount_ / duration : 0;
+
+            slots_.resize(std::max(2, capacity));
+            for (auto& slot : slots_) slot.data.resize(decoder.GetBufferSize());
+
+            thread_ = std::thread([this] { WorkerThread(); });
+        }
+
+        ~DecodeRing()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            thread_.join();
+        }
+
+        DecodeRing(const DecodeRing&) = delete;
+        DecodeRing& operator=(const DecodeRing&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        int GetCapacity() const
+        {
+            return static_cast<int>(slots_.size());
+        }
+
+        // Number of decoded frames waiting to be presented
+        int GetReadyCount()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto count = 0;
+            for (const auto& slot : slots_)
+                if (slot.state == State::Ready && IsScheduled(slot) && slot.seq > presentedSeq_) count++;
+            return count;
+        }
+
+        // Read statistics: frames read from the file, frames passed over by
+        // the schedule (not shown at this speed), and frames decoded but
+        // dropped without being shown
+        void GetStats(int& read, int& skipped, int& dropped)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            read = readCount_;
+            skipped = skippedCount_;
+            dropped = droppedCount_;
+        }
+
+        // Restarts decoding from a given time with a time step per update.
+        // Decoded frames that are still on the new schedule are kept.
+        void Restart(double time, double delta)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                RestartLocked(time, delta);
+            }
+            wake_.notify_all();
+        }
+
+        // Restarts decoding for a seek. It's the same as Restart() but marks
+        // the ring as seeking until a frame on the new schedule is presented.
+        void Seek(double time, double delta)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                RestartLocked(time, delta);
+                seeking_ = true;
+            }
+            wake_.notify_all();
+        }
+
+        bool IsSeeking()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return seeking_;
+        }
+
+        // Presents the frame for a given time. Returns true when the
+        // decoder's output buffer was replaced with a new frame.
+        //
+        // When the frame isn't decoded yet, it waits for it (wait = true) or
+        // presents the latest decoded frame behind the playhead, dropping
+        // the frames before it (wait = false). A time far off the schedule
+        // restarts it.
+        bool Present(double time, bool wait)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            auto position = time * frameRate_;
+            auto frame = GetFrameAt(position);
+            if (frame == presentedFrame_) return false;
+
+            // Position on the schedule (in updates)
+            auto n = (position - origin_) / step_;
+            if (n < -1 || n > nextSeq_ + GetCapacity()) RestartLocked(time, delta_);
+
+            while (true)
+            {
+                auto slot = FindSlot(frame);
+
+                if (slot != nullptr && slot->state == State::Ready)
+                    return PresentSlot(*slot, frame);
+
+                if (slot == nullptr)
+                {
+                    // The ring is behind the playhead.
+                    if (!wait)
+                    {
+                        auto latest = FindLatestBehind((position - origin_) / step_);
+                        return latest != nullptr && PresentSlot(*latest, latest->frame);
+                    }
+                    RestartLocked(time, delta_);
+                }
+                else if (!wait)
+                {
+                    return false;
+                }
+
+                wake_.notify_all();
+                TraceScope trace("PresentWait", frame);
+                filled_.wait(lock);
+            }
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        enum class State { Free, Decoding, Ready };
+
+        struct Slot
+        {
+            FrameBuffer data;
+            State state = State::Free;
+            bool valid = false;
+            int64_t seq = 0;
+            int frame = -1;
+            uint64_t generation = 0;
+        };
+
+        Demuxer& demuxer_;
+        Decoder& decoder_;
+        std::vector<Slot> slots_;
+        int frameCount_ = 0;
+        double frameRate_ = 0;
+
+        // Schedule: The n-th frame is at (origin + n * step) in frames.
+        double origin_ = 0, step_ = 1, delta_ = 0;
+        int64_t nextSeq_ = 0;
+        int64_t presentedSeq_ = -1;
+        int presentedFrame_ = -1;
+        uint64_t generation_ = 0;
+
+        std::mutex mutex_;
+        std::condition_variable wake_, filled_;
+        std::thread thread_;
+        bool stop_ = false;
+        bool seeking_ = false;
+
+        int readCount_ = 0, skippedCount_ = 0, droppedCount_ = 0;
+
+        // Time (in frames) to frame number with the same rounding and
+        // wrapping as the C# stream reader
+        int GetFrameAt(double position) const
+        {
+            if (frameCount_ <= 0) return 0;
+            auto frame = static_cast<int64_t>(std::floor(position + 1e-3)) % frameCount_;
+            return static_cast<int>(frame < 0 ? frame + frameCount_ : frame);
+        }
+
+        int GetScheduledFrame(int64_t seq) const
+        {
+            return GetFrameAt(origin_ + seq * step_);
+        }
+
+        // Unwrapped frame count of a scheduled frame
+        int64_t GetScheduledFrameCount(int64_t seq) const
+        {
+            return static_cast<int64_t>(std::floor(origin_ + seq * step_ + 1e-3));
+        }
+
+        // Slots on the current schedule (not freed or outdated)
+        bool IsScheduled(const Slot& slot) const
+        {
+            return slot.state != State::Free && slot.generation == generation_;
+        }
+
+        Slot* FindSlot(int frame)
+        {
+            Slot* found = nullptr;
+            for (auto& slot : slots_)
+                if (IsScheduled(slot) && slot.frame == frame && slot.seq > presentedSeq_ &&
+                    (found == nullptr || slot.seq < found->seq)) found = &slot;
+            return found;
+        }
+
+        // Latest decoded frame at or behind a position on the schedule
+        Slot* FindLatestBehind(double n)
+        {
+            Slot* found = nullptr;
+            for (auto& slot : slots_)
+                if (IsScheduled(slot) && slot.state == State::Ready &&
+                    slot.seq > presentedSeq_ && slot.seq <= n + 1e-3 &&
+                    (found == nullptr || slot.seq > found->seq)) found = &slot;
+            return found;
+        }
+
+        bool PresentSlot(Slot& slot, int frame)
+        {
+            auto presented = slot.valid && decoder_.SwapBuffer(slot.data);
+            presentedSeq_ = slot.seq;
+            presentedFrame_ = frame;
+            seeking_ = false;
+
+            // Frames up to the presented one aren't needed anymore.
+            for (auto& s : slots_)
+            {
+                if (s.state != State::Ready || s.seq > presentedSeq_) continue;
+                if (&s != &slot) droppedCount_++;
+                s.state = State::Free;
+            }
+
+            wake_.notify_all();
+            return presented;
+        }
+
+        bool HasSeq(int64_t seq) const
+        {
+            for (const auto& slot : slots_)
+                if (IsScheduled(slot) && slot.seq == seq) return true;
+            return false;
+        }
+
+        void RestartLocked(double time, double delta)
+        {
+            // At least a frame per update, like the stream reader
+            auto step = delta * frameRate_;
+            step = std::max(std::abs(step), 1.0) * (step < 0 ? -1 : 1);
+
+            origin_ = time * frameRate_;
+            step_ = step;
+            delta_ = delta;
+            nextSeq_ = 0;
+            presentedSeq_ = -1;
+            presentedFrame_ = -1;
+            generation_++;
+
+            // Keep the decoded frames that are on the new schedule.
+            std::vector<bool> taken(slots_.size(), false);
+            for (auto& slot : slots_)
+            {
+                if (slot.state != State::Ready) continue;
+                slot.state = State::Free;
+                for (auto n = 0; n < static_cast<int>(slots_.size()); n++)
+                {
+                    if (taken[n] || GetScheduledFrame(n) != slot.frame) continue;
+                    taken[n] = true;
+                    slot.seq = n;
+                    slot.state = State::Ready;
+                    slot.generation = generation_;
+                    break;
+                }
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Worker thread
+
+        void WorkerThread()
+        {
+            Tracer::GetShared().NameThread("DecodeRing");
+            ReadBuffer input;
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (true)
+            {
+                Slot* slot = nullptr;
+                wake_.wait(lock, [&]
+                {
+                    if (stop_) return true;
+                    for (auto& s : slots_) if (s.state == State::Free) { slot = &s; break; }
+                    return slot != nullptr;
+                });
+                if (stop_) break;
+
+                while (HasSeq(nextSeq_)) nextSeq_++;
+
+                slot->state = State::Decoding;
+                slot->seq = nextSeq_++;
+                slot->frame = GetScheduledFrame(slot->seq);
+                slot->generation = generation_;
+
+                // The frames between the steps are never shown, so they
+                // aren't read.
+                if (slot->seq > 0)
+                {
+                    auto gap = std::abs(GetScheduledFrameCount(slot->seq) -
+                                        GetScheduledFrameCount(slot->seq - 1)) - 1;
+                    skippedCount_ += static_cast<int>(std::max<int64_t>(gap, 0));
+                }
+                readCount_++;
+
+                lock.unlock();
+
+                demuxer_.ReadFrame(slot->frame, input);
+
+                // Superseded by a restart (e.g. a newer seek) while reading:
+                // Skip decoding.
+                lock.lock();
+                auto stale = slot->generation != generation_;
+                lock.unlock();
+
+                auto valid = !stale && decoder_.DecodeFrameInto(input, slot->data.data(), slot->data.size(), 0);
+
+                lock.lock();
+
+                // Drop the frame when the schedule was restarted meanwhile.
+                slot->state = slot->generation == generation_ ? State::Ready : State::Free;
+                slot->valid = valid;
+                filled_.notify_all();
+            }
+        }
+
+        #pragma endregion
+    };
+}
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <cstring>
+#include <memory>
 #include <mutex>
-#include <vector>
+#include "FrameBuffer.h"
 #include "ReadBuffer.h"
+#include "BlockScaler.h"
 #include "hap.h"
 #include "PlatformConverter.h"
+#include "TextureRegion.h"
+#include "Trace.h"
+#include "Transcoder.h"
 
 namespace KlakHap
 {
@@ -15,41 +21,111 @@ namespace KlakHap
 
         #pragma region Constructor/destructor
 
-        Decoder(int width, int height, int typeID)
-            : width_(width), height_(height), typeID_(typeID)
+        Decoder(int width, int height, int typeID, DecodeScale scale = DecodeScale::Full)
+            : width_(width), height_(height), typeID_(typeID),
+              scale_(BlockScaler::IsSupported(typeID) ? scale : DecodeScale::Full)
         {
-            if (Platform::ShouldUseFormatConversion())
-            {
-                // For mobile platforms, allocate RGBA32 buffer
-                buffer_.resize(Platform::GetRGBA32BufferSize(width, height));
-                // Allocate temporary DXT buffer for HAP decoding
-                dxtBuffer_.resize(width * height * GetBppFromTypeID(typeID) / 8);
-            }
-            else
-            {
-                // Standard DXT buffer
-                buffer_.resize(width * height * GetBppFromTypeID(typeID) / 8);
-            }
+            AllocateBuffers();
         }
 
         #pragma endregion
 
         #pragma region Public accessors
 
+        // The frame data can be in a mapped file (see MapFrame).
         const void* LockBuffer()
         {
-            bufferLock_.lock();
-            return buffer_.data();
+            {
+                TraceScope trace("LockWait");
+                bufferLock_.lock();
+            }
+            lockedAt_ = Tracer::IsEnabled() ? Tracer::Now() : 0;
+            return mapped_ != nullptr ? mapped_ : buffer_.data();
         }
 
         void UnlockBuffer()
         {
+            auto lockedAt = lockedAt_;
             bufferLock_.unlock();
+            if (lockedAt != 0) Tracer::GetShared().Record("BufferLocked", lockedAt, Tracer::Now(), -1);
         }
 
         size_t GetBufferSize() const
         {
-            return buffer_.size();
+            return outputSize_;
+        }
+
+        // Exchanges the output buffer with a decoded one of the same size
+        // (e.g. a slot in a decode-ahead ring).
+        bool SwapBuffer(FrameBuffer& other)
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            if (other.size() != buffer_.size()) return false;
+            buffer_.swap(other);
+            DropMappedFrame();
+            return true;
+        }
+
+        // Region of interest: The output buffer only contains the region,
+        // which is snapped to the 4x4 block grid. An empty rectangle
+        // resets it to the whole frame.
+        void SetRegion(int x, int y, int width, int height)
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            std::lock_guard<std::mutex> decodeLock(decodeLock_);
+            region_ = TextureRegion::Align(x, y, width, height, width_, height_);
+            DropMappedFrame();
+            AllocateBuffers();
+        }
+
+        void GetRegion(int& x, int& y, int& width, int& height) const
+        {
+            if (region_.IsFull())
+            {
+                x = y = 0;
+                width = width_;
+                height = height_;
+            }
+            else
+            {
+                x = region_.x;
+                y = region_.y;
+                width = region_.width;
+                height = region_.height;
+            }
+        }
+
+        // Decode scale actually applied (unsupported formats are decoded
+        // in full resolution).
+        DecodeScale GetScale() const
+        {
+            return scale_;
+        }
+
+        // Output format: Returns the format actually applied (the default
+        // format when the codec or the decode scale doesn't support it).
+        OutputFormat SetOutputFormat(OutputFormat format)
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            std::lock_guard<std::mutex> decodeLock(decodeLock_);
+            auto supported = scale_ != DecodeScale::BlockAverage && Transcoder::IsSupported(format, typeID_);
+            format_ = supported ? format : OutputFormat::Default;
+            DropMappedFrame();
+            AllocateBuffers();
+            return format_;
+        }
+
+        OutputFormat GetOutputFormat() const
+        {
+            return format_;
+        }
+
+        // Dimensions of the output buffer
+        void GetOutputSize(int& width, int& height) const
+        {
+            int x, y;
+            GetRegion(x, y, width, height);
+            BlockScaler::GetScaledSize(scale_, width, height, width, height);
         }
 
         #pragma endregion
@@ -58,77 +134,304 @@ namespace KlakHap
 
         void DecodeFrame(const ReadBuffer& input)
         {
+            TraceScope trace("DecodeFrame");
             std::lock_guard<std::mutex> lock(bufferLock_);
+            std::lock_guard<std::mutex> decodeLock(decodeLock_);
+            if (!MapFrame(input)) DecodeInto(input, buffer_.data());
+        }
+
+        // Decodes a frame straight into an external buffer (e.g. the raw
+        // data of a texture), skipping the internal buffer and the copy
+        // from it. The layout is the same as the internal buffer except
+        // for the row pitch: bytes between block rows for compressed
+        // output or between pixel rows for RGBA32 output; zero means
+        // tightly packed. Returns false when nothing was written. The output
+        // buffer isn't locked, so this can run on another thread while the
+        // current frame is being uploaded.
+        bool DecodeFrameInto(const ReadBuffer& input, void* dest, size_t destSize, size_t rowPitch)
+        {
+            TraceScope trace("DecodeFrame");
+            std::lock_guard<std::mutex> decodeLock(decodeLock_);
+
+            size_t rowBytes;
+            int rows;
+            GetOutputRows(rowBytes, rows);
+
+            if (rowPitch == 0) rowPitch = rowBytes;
+            if (dest == nullptr || rows == 0 || rowPitch < rowBytes ||
+                destSize < rowPitch * (rows - 1) + rowBytes) return false;
+
+            auto output = static_cast<uint8_t*>(dest);
+            if (rowPitch == rowBytes) return DecodeInto(input, output);
+
+            // Padded rows: The decoding steps only write packed data, so
+            // it's staged in a temporary buffer.
+            pitchBuffer_.resize(outputSize_);
+            if (!DecodeInto(input, pitchBuffer_.data())) return false;
+            for (auto row = 0; row < rows; row++)
+                std::memcpy(output + row * rowPitch, pitchBuffer_.data() + row * rowBytes, rowBytes);
+            return true;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Internal-use members
+
+        FrameBuffer buffer_;
+        FrameBuffer dxtBuffer_;  // Temporary DXT buffer for iOS conversion
+        FrameBuffer chunkBuffer_; // Decoded chunks for region cropping
+        FrameBuffer scaledBuffer_; // Downscaled DXT buffer for conversion
+        FrameBuffer pitchBuffer_; // Packed output for padded rows
+
+        // Size of the output buffer. buffer_ itself can be swapped on
+        // another thread (SwapBuffer), so the decoding steps refer to this.
+        size_t outputSize_ = 0;
+
+        std::mutex bufferLock_;
+        std::mutex decodeLock_; // Staging buffers (locked after bufferLock_)
+        uint64_t lockedAt_ = 0; // Trace timestamp of LockBuffer
+        int width_, height_, typeID_;
+
+        // Chunk decode storage reused between frames
+        std::unique_ptr<HapDecodeContext, void (*)(HapDecodeContext*)>
+            context_{HapCreateDecodeContext(), HapDestroyDecodeContext};
+        DecodeScale scale_;
+        TextureRegion region_;
+        OutputFormat format_ = OutputFormat::Default;
+
+        // Current frame in a mapped file (zero-copy path)
+        const uint8_t* mapped_ = nullptr;
+        std::shared_ptr<const void> mappedOwner_;
+
+        // Post-processes after decoding: Transcoding into the output format
+        // or the RGBA32 conversion for mobile platforms (default format)
+        bool IsTranscoded() const
+        {
+            return format_ != OutputFormat::Default;
+        }
+
+        bool IsConverted() const
+        {
+            return !IsTranscoded() && Platform::ShouldUseFormatConversion();
+        }
+
+        void AllocateBuffers()
+        {
+            int x, y, width, height, outWidth, outHeight;
+            GetRegion(x, y, width, height);
+            BlockScaler::GetScaledSize(scale_, width, height, outWidth, outHeight);
+
+            auto post = IsTranscoded() || IsConverted();
+            auto dxtSize = static_cast<size_t>(width) * height * GetBppFromTypeID(typeID_) / 8;
+            auto scaledSize = BlockScaler::GetScaledBufferSize(scale_, width, height, typeID_);
+
+            // Staging buffers for the post-processes
+            dxtBuffer_.resize(post || scale_ != DecodeScale::Full ? dxtSize : 0);
+            scaledBuffer_.resize(post && scale_ != DecodeScale::Full ? scaledSize : 0);
+
+            if (scale_ == DecodeScale::BlockAverage)
+                buffer_.resize(scaledSize);
+            else if (IsTranscoded())
+                buffer_.resize(Transcoder::GetBufferSize(format_, typeID_, outWidth, outHeight));
+            else if (IsConverted())
+                // For mobile platforms, allocate RGBA32 buffer
+                buffer_.resize(Platform::GetRGBA32BufferSize(outWidth, outHeight));
+            else
+                // Standard DXT buffer
+                buffer_.resize(scale_ == DecodeScale::Full ? dxtSize : scaledSize);
+
+            outputSize_ = buffer_.size();
+        }
+
+        #pragma endregion
+
+        #pragma region Decoding steps
+
+        // Row layout of the output: Block rows for compressed formats,
+        // pixel rows for RGBA32.
+        void GetOutputRows(size_t& rowBytes, int& rows) const
+        {
+            int width, height;
+            GetOutputSize(width, height);
+            auto rgba = scale_ == DecodeScale::BlockAverage || IsConverted() ||
+                        Transcoder::IsUncompressed(format_);
+            rows = rgba ? height : (height + 3) / 4;
+            rowBytes = rows > 0 ? outputSize_ / rows : 0;
+        }
+
+        // Runs the decoding steps with the final output written into a
+        // given buffer, which has to be as large as the internal buffer.
+        bool DecodeInto(const ReadBuffer& input, uint8_t* output)
+        {
+            auto post = IsTranscoded() || IsConverted();
+
+            // The compressed frame is staged when it's post-processed.
+            auto staged = post || scale_ != DecodeScale::Full;
+            auto target = staged ? dxtBuffer_.data() : output;
+            auto targetSize = staged ? dxtBuffer_.size() : outputSize_;
+            {
+                TraceScope trace("Decompress");
+                if (!DecodeCompressed(input, target, targetSize)) return false;
+            }
+
+            if (!staged) return true;
+
+            TraceScope trace("Convert");
+            int width, height, x, y;
+            GetRegion(x, y, width, height);
+            const uint8_t* dxt = target;
+
+            if (scale_ == DecodeScale::BlockAverage)
+            {
+                // RGBA32 output: No format conversion needed except YCoCg.
+                BlockScaler::Scale(scale_, typeID_, dxt, width, height, output);
+                if ((typeID_ & 0xf) == 0xf) PixelExpander::ConvertYCoCg(output, outputSize_ / 4);
+                return true;
+            }
+
+            if (scale_ != DecodeScale::Full)
+            {
+                // Compressed-domain downscaling
+                auto scaled = post ? scaledBuffer_.data() : output;
+                BlockScaler::Scale(scale_, typeID_, dxt, width, height, scaled);
+                BlockScaler::GetScaledSize(scale_, width, height, width, height);
+                dxt = scaled;
+            }
+
+            if (IsTranscoded())
+                Transcoder::Transcode(format_, typeID_, dxt, width, height, output);
+            else if (IsConverted())
+                ConvertToRGBA32(dxt, width, height, output);
+            return true;
+        }
+
+        // Zero-copy path: A frame stored without second-stage compression
+        // in a mapped file is already the output texture, so the output
+        // refers to the mapping instead of copying it into the buffer.
+        bool MapFrame(const ReadBuffer& input)
+        {
+            DropMappedFrame();
+
+            if (input.mapped == nullptr || !region_.IsFull() || scale_ != DecodeScale::Full ||
+                IsTranscoded() || IsConverted()) return false;
+
+            unsigned long offset, length;
+            if (HapGetFrameUncompressedRange(input.data(), static_cast<unsigned long>(input.size()),
+                                             0, &offset, &length) != HapResult_No_Error ||
+                length != outputSize_) return false;
+
+            mapped_ = input.data() + offset;
+            mappedOwner_ = input.owner;
+            return true;
+        }
+
+        void DropMappedFrame()
+        {
+            mapped_ = nullptr;
+            mappedOwner_.reset();
+        }
+
+        // Decodes the frame (or the region) into a compressed texture.
+        bool DecodeCompressed(const ReadBuffer& input, uint8_t* output, size_t outputSize)
+        {
+            if (!region_.IsFull()) return DecodeRegion(input, output);
 
             unsigned int format;
+            return HapDecodeWithContext(
+                context_.get(),
+                input.data(),
+                static_cast<unsigned long>(input.size()),
+                0, hap_callback, nullptr,
+                output,
+                static_cast<unsigned long>(outputSize),
+                nullptr, &format
+            ) == HapResult_No_Error;
+        }
 
-            if (Platform::ShouldUseFormatConversion())
+        // Converts DXT to RGBA32 for mobile platforms.
+        void ConvertToRGBA32(const uint8_t* dxt, int width, int height, uint8_t* output)
+        {
+            int formatType = typeID_ & 0xf;
+            if (formatType == 0xb)  // DXT1
             {
-                // Decode HAP to DXT format first
-                HapDecode(
-                    input.storage.data(),
-                    static_cast<unsigned long>(input.storage.size()),
-                    0, hap_callback, nullptr,
-                    dxtBuffer_.data(),
-                    static_cast<unsigned long>(dxtBuffer_.size()),
-                    nullptr, &format
-                );
-                
-                // Convert DXT to RGBA32 for mobile platforms
-                int formatType = typeID_ & 0xf;
-                if (formatType == 0xb)  // DXT1
-                {
-                    Platform::ConvertDXT1ToRGBA32(
-                        dxtBuffer_.data(), 
-                        buffer_.data(), 
-                        width_, height_
-                    );
-                }
-                else if (formatType == 0xe || formatType == 0xf)  // DXT5/YCoCg
-                {
-                    Platform::ConvertDXT5ToRGBA32(
-                        dxtBuffer_.data(), 
-                        buffer_.data(), 
-                        width_, height_
-                    );
-                }
+                Platform::ConvertDXT1ToRGBA32(dxt, output, width, height);
             }
-            else
+            else if (formatType == 0xe)  // DXT5
+            {
+                Platform::ConvertDXT5ToRGBA32(dxt, output, width, height);
+            }
+            else if (formatType == 0xf)  // YCoCg: Converted into RGB in the same pass
             {
-                // Standard HAP decoding
-                HapDecode(
-                    input.storage.data(),
-                    static_cast<unsigned long>(input.storage.size()),
-                    0, hap_callback, nullptr,
-                    buffer_.data(),
-                    static_cast<unsigned long>(buffer_.size()),
-                    nullptr, &format
-                );
+                Transcoder::Transcode(OutputFormat::RGBA32, typeID_, dxt, width, height, output);
             }
         }
 
         #pragma endregion
 
-    private:
+        #pragma region Region decoding
 
-        #pragma region Internal-use members
+        // Decodes the chunks covering the region and crops them into the
+        // output. The input can be a partial read; frames that don't
+        // contain the needed chunks are skipped.
+        bool DecodeRegion(const ReadBuffer& input, uint8_t* output)
+        {
+            auto data = input.data();
+            auto size = static_cast<unsigned long>(input.size());
 
-        std::vector<uint8_t> buffer_;
-        std::vector<uint8_t> dxtBuffer_;  // Temporary DXT buffer for iOS conversion
-        std::mutex bufferLock_;
-        int width_, height_, typeID_;
+            int chunkCount;
+            if (HapGetFrameTextureChunkCount(data, size, 0, &chunkCount) != HapResult_No_Error)
+                return false;
 
-        static size_t GetBppFromTypeID(int typeID)
+            uint32_t first, count;
+            size_t chunkBytes;
+            unsigned int format;
+            unsigned long used = 0;
+
+            if (region_.GetChunkRange(width_, height_, typeID_, chunkCount, first, count, chunkBytes))
+            {
+                if (first < input.chunkBegin || first + count > input.chunkEnd) return false;
+
+                chunkBuffer_.resize(chunkBytes * count);
+                auto result = HapDecodeChunksWithContext(context_.get(), data, size, 0, first, count,
+                                              hap_callback, nullptr,
+                                              chunkBuffer_.data(),
+                                              static_cast<unsigned long>(chunkBuffer_.size()),
+                                              &used, &format);
+                if (result == HapResult_No_Error && used == chunkBuffer_.size())
+                {
+                    CropRegion(chunkBuffer_.data(), first * chunkBytes, output);
+                    return true;
+                }
+            }
+
+            // Uneven chunks: Decode the whole frame if it's available.
+            if (input.chunkBegin != 0 || input.chunkEnd != ReadBuffer::kAllChunks) return false;
+
+            auto rowBytes = TextureRegion::GetRowBytes(width_, typeID_);
+            chunkBuffer_.resize(rowBytes * ((height_ + 3) / 4));
+            if (HapDecodeWithContext(context_.get(), data, size, 0, hap_callback, nullptr,
+                          chunkBuffer_.data(), static_cast<unsigned long>(chunkBuffer_.size()),
+                          nullptr, &format) != HapResult_No_Error) return false;
+
+            CropRegion(chunkBuffer_.data(), 0, output);
+            return true;
+        }
+
+        // Copies the region from texture data starting at a given offset
+        void CropRegion(const uint8_t* source, size_t sourceOffset, uint8_t* output) const
         {
-            switch (typeID & 0xf)
+            auto bpp = GetBppFromTypeID(typeID_);
+            auto rowBytes = TextureRegion::GetRowBytes(width_, typeID_);
+            auto cropBytes = static_cast<size_t>(region_.width) * 4 * bpp / 8;
+            auto left = static_cast<size_t>(region_.x) * 4 * bpp / 8;
+
+            for (auto row = region_.y / 4; row < (region_.y + region_.height) / 4; row++)
             {
-            case 0xb: return 4; // DXT1
-            case 0xe: return 8; // DXT5
-            case 0xf: return 8; // DXT5
-            case 0xc: return 8; // BC7
-            case 0x1: return 4; // BC4
+                std::memcpy(output, source + row * rowBytes + left - sourceOffset, cropBytes);
+                output += cropBytes;
             }
-            return 0;
         }
 
         #pragma endregion
@@ -141,7 +444,11 @@ namespace KlakHap
         )
         {
             // FIXME: This should be threaded.
-            for (auto i = 0u; i < count; i++) work(p, i);
+            for (auto i = 0u; i < count; i++)
+            {
+                TraceScope trace("DecodeChunk", static_cast<int32_t>(i));
+                work(p, i);
+            }
         }
 
         #pragma endregion
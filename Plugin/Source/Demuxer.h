@@ -1,13 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <algorithm>
 #include <cstring>
-#include "mp4demux.h"
+#include <memory>
+#include <mutex>
+#include "hap.h"
+#include "ClipPool.h"
+#include "ClipSource.h"
+#include "FileReader.h"
 #include "ReadBuffer.h"
-
-#ifdef _WIN32
-#include <windows.h>
-#endif
+#include "TextureRegion.h"
+#include "Trace.h"
 
 namespace KlakHap
 {
@@ -17,39 +21,16 @@ namespace KlakHap
 
         #pragma region Constructor/destructor
 
+        // The clip is shared with the other demuxers of the same file
+        // (see ClipSource). The I/O policy and the region are per demuxer.
         Demuxer(const char* path)
+          : source_(ClipSource::Open(path)),
+            file_(source_ != nullptr ? source_->GetFile() : FileReader())
         {
-            std::memset(&demux_, 0, sizeof(MP4D_demux_t));
-
-        #ifdef _WIN32
-            // Convert UTF-8 to wide character for Windows
-            int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
-            if (wlen <= 0) return;
-
-            wchar_t* wpath = new wchar_t[wlen];
-            MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, wlen);
-
-            if (_wfopen_s(&file_, wpath, L"rb") != 0) {
-                delete[] wpath;
-                return;
-            }
-            delete[] wpath;
-        #else
-            file_ = fopen(path, "rb");
-            if (file_ == nullptr) return;
-        #endif
-
-            if (MP4D__open(&demux_, file_) == 0)
-            {
-                fclose(file_);
-                file_ = nullptr;
-            }
-        }
-
-        ~Demuxer()
-        {
-            MP4D__close(&demux_);
-            if (file_ != nullptr) fclose(file_);
+            if (source_ == nullptr) return;
+            props_ = source_->GetProperties();
+            maxFrameSize_ = source_->GetMaxFrameSize();
+            ClipPool::GetShared().Touch(source_);
         }
 
         #pragma endregion
@@ -58,12 +39,55 @@ namespace KlakHap
 
         bool IsValid() const
         {
-            return file_ != nullptr;
+            return source_ != nullptr;
+        }
+
+        bool IsIndexed() const
+        {
+            return source_ != nullptr && source_->IsIndexed();
+        }
+
+        IOPolicy GetIOPolicy() const
+        {
+            return file_.GetPolicy();
+        }
+
+        IOPolicy SetIOPolicy(IOPolicy policy)
+        {
+            return file_.SetPolicy(policy);
+        }
+
+        bool IsPaged() const
+        {
+            return source_ != nullptr && source_->IsPaged();
+        }
+
+        uint32_t GetFrameCount() const
+        {
+            return props_.frameCount;
+        }
+
+        double GetDuration() const
+        {
+            return static_cast<double>(props_.duration) / props_.timescale;
         }
 
-        const MP4D_track_t& GetVideoTrack() const
+        uint32_t GetWidth() const
         {
-            return demux_.track[0];
+            return props_.width;
+        }
+
+        uint32_t GetHeight() const
+        {
+            return props_.height;
+        }
+
+        // Region of interest: Only the chunks covering the region are read.
+        // This has to be set before starting reading frames.
+        void SetRegion(int x, int y, int width, int height)
+        {
+            region_ = TextureRegion::Align(x, y, width, height,
+                                           props_.width, props_.height);
         }
 
         #pragma endregion
@@ -72,32 +96,34 @@ namespace KlakHap
 
         uint8_t ReadVideoTypeField()
         {
-            // Data offset for the first frame
-            unsigned int size;
-            auto offs = MP4D__frame_offset(&demux_, 0, 0, &size, nullptr, nullptr);
-
-            // Read to a temporary buffer.
-            uint8_t temp;
-            fseek(file_, (long)offs + 3, SEEK_SET);
-            fread(&temp, 1, 1, file_);
-
-            return temp;
+            return static_cast<uint8_t>(props_.videoType);
         }
 
-        void ReadFrame(int index, ReadBuffer& buffer)
+        // Frame reads are serialized, so a demuxer can be shared between
+        // the playback and background jobs (e.g. thumbnail generation).
+        // Background jobs should read whole frames regardless of the region.
+        void ReadFrame(int index, ReadBuffer& buffer, bool useRegion = true)
         {
+            TraceScope trace("ReadFrame", index);
+            std::lock_guard<std::mutex> lock(readLock_);
+
             // Frame data offset
-            unsigned int inSize, timestamp, duration;
-            auto inOffs = MP4D__frame_offset(&demux_, 0, index, &inSize, &timestamp, &duration);
+            uint64_t inOffs;
+            uint32_t inSize;
+            LocateFrame(index, inOffs, inSize);
+
+            // Size the buffer for the largest frame up front, so it isn't
+            // regrown as the frame sizes fluctuate.
+            if (maxFrameSize_ > 0 && file_.GetPolicy() != IOPolicy::Mapped)
+                buffer.storage.reserve(maxFrameSize_ + kReadSlack);
+
+            // Partial read for the region (a mapped file is accessed in
+            // place, so only the pages of the chunks are touched anyway)
+            if (useRegion && !region_.IsFull() && file_.GetPolicy() != IOPolicy::Mapped &&
+                ReadRegion(inOffs, inSize, buffer)) return;
 
             // Frame data read
-        #if defined(_WIN32)
-            _fseeki64(file_, inOffs, SEEK_SET);
-        #else
-            fseek(file_, inOffs, SEEK_SET);
-        #endif
-            buffer.storage.resize(inSize);
-            fread(buffer.storage.data(), inSize, 1, file_);
+            file_.Read(inOffs, inSize, buffer);
         }
 
         #pragma endregion
@@ -106,8 +132,73 @@ namespace KlakHap
 
         #pragma region Private members
 
-        FILE* file_ = nullptr;
-        MP4D_demux_t demux_;
+        std::shared_ptr<ClipSource> source_;
+        FileReader file_;
+        VideoProperties props_ = {};
+        size_t maxFrameSize_ = 0;
+
+        // Room for the alignment of unbuffered reads
+        static constexpr size_t kReadSlack = 2 * 4096;
+        TextureRegion region_;
+        std::mutex readLock_;
+
+        // Initial read length for the frame header in partial reads
+        static constexpr size_t kHeaderReadBytes = 4096;
+
+        void LocateFrame(int index, uint64_t& offset, uint32_t& size)
+        {
+            offset = 0;
+            size = 0;
+            if (source_ != nullptr) source_->Locate(index, offset, size);
+        }
+
+        #pragma endregion
+
+        #pragma region Partial read
+
+        // Reads the frame header and the chunks covering the region. The
+        // rest of the buffer is left uninitialized. Returns false when the
+        // frame can't be read partially; it should be read in full then.
+        bool ReadRegion(uint64_t offset, uint32_t size, ReadBuffer& buffer)
+        {
+            buffer.Unmap();
+            buffer.storage.resize(size);
+            buffer.offset = 0;
+            buffer.length = size;
+
+            auto data = buffer.storage.data();
+            auto head = std::min<size_t>(size, kHeaderReadBytes);
+            if (file_.ReadRaw(offset, data, head) != head) return false;
+
+            unsigned long headerLength;
+            if (HapGetFrameHeaderLength(data, size, 0, &headerLength) != HapResult_No_Error ||
+                headerLength > size) return false;
+
+            if (headerLength > head &&
+                file_.ReadRaw(offset + head, data + head, headerLength - head) != headerLength - head)
+                return false;
+
+            int chunkCount;
+            if (HapGetFrameTextureChunkCount(data, size, 0, &chunkCount) != HapResult_No_Error)
+                return false;
+
+            uint32_t first, count;
+            size_t chunkBytes;
+            if (!region_.GetChunkRange(props_.width, props_.height, props_.videoType,
+                                       chunkCount, first, count, chunkBytes)) return false;
+
+            unsigned long dataOffset, dataLength;
+            if (HapGetFrameChunkDataRange(data, size, 0, first, count,
+                                          &dataOffset, &dataLength) != HapResult_No_Error)
+                return false;
+
+            if (file_.ReadRaw(offset + dataOffset, data + dataOffset, dataLength) != dataLength)
+                return false;
+
+            buffer.chunkBegin = first;
+            buffer.chunkEnd = first + count;
+            return true;
+        }
 
         #pragma endregion
     };
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <climits>
+#include "BlockScaler.h"
+
+namespace KlakHap
+{
+    //
+    // DXT to ETC2 block transcoder
+    //
+    // A DXT block is re-expressed in ETC2 from its endpoint palette instead
+    // of being re-encoded from pixels: each candidate ETC2 mode (individual
+    // and differential with both subblock layouts, T and H) is fitted to the
+    // four palette colors weighted by their index counts, and the best one
+    // is written with the DXT indices remapped through a palette-to-ETC
+    // lookup. DXT5 alpha blocks are remapped from their eight-level palette
+    // into EAC blocks in the same way.
+    //
+    // The channels are transcoded as they are, so HAP Q (scaled YCoCg) stays
+    // in YCoCg and still needs the shader conversion.
+    //
+    class EtcBlock
+    {
+    public:
+
+        #pragma region Block transcoding
+
+        // DXT1 color block (8 bytes) to ETC2 RGB block (8 bytes)
+        static void TranscodeColor(const uint8_t* dxt, bool forceFourColor, uint8_t* etc)
+        {
+            int palette[4][4];
+            BlockScaler::ColorPalette(dxt, forceFourColor, palette);
+
+            // Palette index of each pixel (row-major) and the index counts
+            // in each subblock of each layout: [flip][subblock][index]
+            int indices[16], counts[2][2][4] = {}, total[4] = {};
+            auto bits = BlockScaler::ColorIndices(dxt);
+            for (auto i = 0; i < 16; i++, bits >>= 2)
+            {
+                auto k = static_cast<int>(bits & 3);
+                indices[i] = k;
+                counts[0][(i & 3) >> 1][k]++;
+                counts[1][i >> 3][k]++;
+                total[k]++;
+            }
+
+            Candidate best;
+            for (auto flip = 0; flip < 2; flip++) FitSubblocks(palette, counts[flip], flip, best);
+            FitH(palette, total, best);
+            FitT(palette, total, best);
+
+            Write(best.Encode(indices), etc);
+        }
+
+        // BC4 alpha block (8 bytes, the first half of a DXT5 block) to EAC
+        // alpha block (8 bytes)
+        static void TranscodeAlpha(const uint8_t* bc4, uint8_t* eac)
+        {
+            int palette[8], counts[8] = {}, indices[16];
+            BlockScaler::AlphaPalette(bc4, palette);
+            auto bits = BlockScaler::AlphaIndices(bc4);
+            for (auto i = 0; i < 16; i++, bits >>= 3)
+            {
+                indices[i] = static_cast<int>(bits & 7);
+                counts[indices[i]]++;
+            }
+
+            // Range of the levels in use
+            auto lo = 255, hi = 0;
+            for (auto k = 0; k < 8; k++)
+                if (counts[k] > 0) lo = std::min(lo, palette[k]), hi = std::max(hi, palette[k]);
+
+            // Flat block: The zero modifier of table 13 gives the base value.
+            int base = lo, multiplier = 1, table = 13, map[8] = {4, 4, 4, 4, 4, 4, 4, 4};
+
+            if (hi > lo)
+            {
+                auto bestError = INT_MAX;
+                for (auto t = 0; t < 16; t++)
+                {
+                    // Fit the table span to the range, then try the
+                    // neighboring multipliers.
+                    auto span = kAlphaTable[t][7] - kAlphaTable[t][3];
+                    auto fit = (hi - lo + span / 2) / span;
+                    for (auto m = std::max(1, fit - 1); m <= std::min(15, fit + 1); m++)
+                    {
+                        auto b = Clamp(lo - kAlphaTable[t][3] * m, 0, 255);
+                        int error = 0, tmap[8];
+                        for (auto k = 0; k < 8; k++)
+                        {
+                            auto e = NearestAlpha(palette[k], b, t, m, tmap[k]);
+                            error += counts[k] * e;
+                        }
+                        if (error < bestError)
+                        {
+                            bestError = error;
+                            base = b, multiplier = m, table = t;
+                            std::copy(tmap, tmap + 8, map);
+                        }
+                    }
+                }
+            }
+
+            uint64_t word = (static_cast<uint64_t>(base) << 56) |
+                            (static_cast<uint64_t>(multiplier) << 52) |
+                            (static_cast<uint64_t>(table) << 48);
+            for (auto x = 0; x < 4; x++)
+                for (auto y = 0; y < 4; y++)
+                    word |= static_cast<uint64_t>(map[indices[y * 4 + x]]) << (45 - 3 * (x * 4 + y));
+
+            Write(word, eac);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Tables
+
+        // Intensity modifiers (individual/differential modes): +a, +b for
+        // the pixel index values 0, 1 and -a, -b for 2, 3
+        static constexpr int kIntensity[8][2] =
+            {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+        // Distances (T and H modes)
+        static constexpr int kDistance[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+        // EAC alpha modifiers
+        static constexpr int kAlphaTable[16][8] =
+        {
+            {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+            {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+            {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+            {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+            {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+            {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+            {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+            {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+        };
+
+        #pragma endregion
+
+        #pragma region Candidate encodings
+
+        enum class Mode { Individual, Differential, T, H };
+
+        // An encoding with the ETC index of each DXT palette entry (per
+        // subblock for the individual/differential modes)
+        struct Candidate
+        {
+            Mode mode = Mode::Individual;
+            int error = INT_MAX;
+            int flip = 0;
+            int colors[2][3] = {};  // Quantized base colors (4 or 5 bits)
+            int tables[2] = {};     // Intensity tables or the distance index
+            int map[2][4] = {};     // DXT palette index -> ETC index value
+
+            uint64_t Encode(const int* indices) const
+            {
+                uint64_t word = 0;
+
+                if (mode == Mode::Individual || mode == Mode::Differential)
+                {
+                    for (auto ch = 0; ch < 3; ch++)
+                    {
+                        auto shift = 56 - ch * 8;
+                        if (mode == Mode::Individual)
+                            word |= static_cast<uint64_t>((colors[0][ch] << 4) | colors[1][ch]) << shift;
+                        else
+                            word |= static_cast<uint64_t>((colors[0][ch] << 3) |
+                                                          ((colors[1][ch] - colors[0][ch]) & 7)) << shift;
+                    }
+                    word |= static_cast<uint64_t>((tables[0] << 5) | (tables[1] << 2) |
+                                                  (mode == Mode::Differential ? 2 : 0) | flip) << 32;
+                }
+                else if (mode == Mode::T)
+                {
+                    auto r1 = colors[0][0];
+                    auto ra = r1 >> 2, rb = r1 & 3;
+                    // Red overflow selects the T mode.
+                    uint64_t force = ra + rb >= 4 ? 0x7 << 5 : 0x1 << 2;
+                    word |= (force | static_cast<uint64_t>((ra << 3) | rb)) << 56;
+                    word |= static_cast<uint64_t>((colors[0][1] << 4) | colors[0][2]) << 48;
+                    word |= static_cast<uint64_t>((colors[1][0] << 4) | colors[1][1]) << 40;
+                    word |= static_cast<uint64_t>((colors[1][2] << 4) | ((tables[0] >> 1) << 2) |
+                                                  2 | (tables[0] & 1)) << 32;
+                }
+                else
+                {
+                    auto r1 = colors[0][0], g1 = colors[0][1], b1 = colors[0][2];
+                    auto ga = g1 >> 1, gb = g1 & 1, ba = b1 >> 3, bb = b1 & 7;
+
+                    // Red mustn't overflow (T mode), green must (H mode).
+                    auto dr = ga >= 4 ? ga - 8 : ga;
+                    auto x = (gb << 1) | ba, y = bb >> 1;
+                    uint64_t hi = r1 + dr < 0 ? 0x80 : 0;
+                    uint64_t force = x + y >= 4 ? 0xe0 : 0x04;
+
+                    auto d = tables[0];
+                    word |= (hi | static_cast<uint64_t>((r1 << 3) | ga)) << 56;
+                    word |= static_cast<uint64_t>((force & 0xe0) | (gb << 4) | (ba << 3) |
+                                                  (force & 0x04) | (bb >> 1)) << 48;
+                    word |= static_cast<uint64_t>(((bb & 1) << 7) | (colors[1][0] << 3) |
+                                                  (colors[1][1] >> 1)) << 40;
+                    word |= static_cast<uint64_t>(((colors[1][1] & 1) << 7) | (colors[1][2] << 3) |
+                                                  ((d >> 2) << 2) | 2 | ((d >> 1) & 1)) << 32;
+                }
+
+                // Pixel indices: column-major, MSBs in the upper half
+                for (auto x = 0; x < 4; x++)
+                {
+                    for (auto y = 0; y < 4; y++)
+                    {
+                        auto sub = (flip ? y : x) >> 1;
+                        if (mode == Mode::T || mode == Mode::H) sub = 0;
+                        auto value = map[sub][indices[y * 4 + x]];
+                        auto p = x * 4 + y;
+                        word |= static_cast<uint64_t>(value >> 1) << (16 + p);
+                        word |= static_cast<uint64_t>(value & 1) << p;
+                    }
+                }
+
+                return word;
+            }
+        };
+
+        // Individual/differential modes: A base color and an intensity
+        // table per subblock. The differential mode is used when the 5-bit
+        // bases are close enough; the individual mode is tried either way.
+        static void FitSubblocks(const int palette[4][4], const int counts[2][4], int flip, Candidate& best)
+        {
+            for (auto mode : {Mode::Differential, Mode::Individual})
+            {
+                Candidate c;
+                c.mode = mode;
+                c.flip = flip;
+                c.error = 0;
+
+                auto max = mode == Mode::Individual ? 15 : 31;
+                for (auto s = 0; s < 2; s++)
+                    c.error += FitSubblock(palette, counts[s], max, c.colors[s], c.tables[s], c.map[s]);
+
+                if (mode == Mode::Differential)
+                {
+                    auto valid = true;
+                    for (auto ch = 0; ch < 3; ch++)
+                    {
+                        auto delta = c.colors[1][ch] - c.colors[0][ch];
+                        valid = valid && delta >= -4 && delta <= 3;
+                    }
+                    if (!valid) continue;
+                }
+
+                if (c.error < best.error) best = c;
+            }
+        }
+
+        // Fits a subblock base color (quantized to 0..max) and an intensity
+        // table. The base starts from the count-weighted palette average
+        // and is refined once per table with the mapped modifiers removed.
+        static int FitSubblock(const int palette[4][4], const int counts[4], int max,
+                               int* color, int& table, int* map)
+        {
+            int mean[3];
+            for (auto ch = 0; ch < 3; ch++)
+            {
+                auto sum = 0;
+                for (auto k = 0; k < 4; k++) sum += counts[k] * palette[k][ch];
+                mean[ch] = (sum + 4) / 8;
+            }
+
+            auto bestError = INT_MAX;
+            for (auto t = 0; t < 8; t++)
+            {
+                int q[3], tmap[4], error = 0;
+                for (auto ch = 0; ch < 3; ch++) q[ch] = Quantize(mean[ch], max);
+
+                for (auto pass = 0; pass < 2; pass++)
+                {
+                    error = MapSubblock(palette, counts, q, max, t, tmap);
+                    if (pass == 1) break;
+
+                    // Refined base: the average of the colors with their
+                    // modifiers removed
+                    for (auto ch = 0; ch < 3; ch++)
+                    {
+                        auto sum = 0;
+                        for (auto k = 0; k < 4; k++)
+                            sum += counts[k] * (palette[k][ch] - Modifier(t, tmap[k]));
+                        q[ch] = Quantize(Clamp((sum + 4) / 8, 0, 255), max);
+                    }
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    table = t;
+                    std::copy(q, q + 3, color);
+                    std::copy(tmap, tmap + 4, map);
+                }
+            }
+            return bestError;
+        }
+
+        static int MapSubblock(const int palette[4][4], const int counts[4], const int* color, int max,
+                               int table, int* map)
+        {
+            int paint[4][3];
+            for (auto v = 0; v < 4; v++)
+            {
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    auto base = max == 15 ? Expand4(color[ch]) : Expand5(color[ch]);
+                    paint[v][ch] = Clamp(base + Modifier(table, v), 0, 255);
+                }
+            }
+            return MapPalette(palette, counts, paint, map);
+        }
+
+        static int Modifier(int table, int index)
+        {
+            return kIntensity[table][index & 1] * (index & 2 ? -1 : 1);
+        }
+
+        // H mode: Two base colors each with +/- distance. The palette line
+        // is split into its two halves (0 and 2, 3 and 1).
+        static void FitH(const int palette[4][4], const int counts[4], Candidate& best)
+        {
+            int c1[3], c2[3];
+            GroupMean(palette, counts, 0, 2, c1);
+            GroupMean(palette, counts, 3, 1, c2);
+
+            Candidate c;
+            c.mode = Mode::H;
+            for (auto ch = 0; ch < 3; ch++)
+            {
+                c.colors[0][ch] = Quantize(c1[ch], 15);
+                c.colors[1][ch] = Quantize(c2[ch], 15);
+            }
+
+            for (auto d = 0; d < 8; d++)
+            {
+                // The LSB of the distance index is given by the order of
+                // the base colors, so they're swapped as needed.
+                Candidate h = c;
+                auto v1 = (h.colors[0][0] << 8) | (h.colors[0][1] << 4) | h.colors[0][2];
+                auto v2 = (h.colors[1][0] << 8) | (h.colors[1][1] << 4) | h.colors[1][2];
+                if ((v1 >= v2) != ((d & 1) != 0))
+                {
+                    if (v1 == v2) continue;
+                    std::swap(h.colors[0], h.colors[1]);
+                }
+                h.tables[0] = d;
+
+                int paint[4][3];
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    auto a = Expand4(h.colors[0][ch]), b = Expand4(h.colors[1][ch]);
+                    paint[0][ch] = Clamp(a + kDistance[d], 0, 255);
+                    paint[1][ch] = Clamp(a - kDistance[d], 0, 255);
+                    paint[2][ch] = Clamp(b + kDistance[d], 0, 255);
+                    paint[3][ch] = Clamp(b - kDistance[d], 0, 255);
+                }
+
+                h.error = MapPalette(palette, counts, paint, h.map[0]);
+                if (h.error < best.error) best = h;
+            }
+        }
+
+        // T mode: A single color and a base color with +/- distance. Either
+        // end of the palette line can be the single color.
+        static void FitT(const int palette[4][4], const int counts[4], Candidate& best)
+        {
+            for (auto end = 0; end < 2; end++)
+            {
+                // The single color and the mean of the other three entries
+                int single = end == 0 ? 0 : 1, sum[3] = {}, n = 0;
+                for (auto k = 0; k < 4; k++)
+                {
+                    if (k == single) continue;
+                    for (auto ch = 0; ch < 3; ch++) sum[ch] += counts[k] * palette[k][ch];
+                    n += counts[k];
+                }
+                if (n == 0) continue; // Covered by the individual modes
+
+                Candidate c;
+                c.mode = Mode::T;
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    c.colors[0][ch] = Quantize(palette[single][ch], 15);
+                    c.colors[1][ch] = Quantize((sum[ch] + n / 2) / n, 15);
+                }
+
+                for (auto d = 0; d < 8; d++)
+                {
+                    int paint[4][3];
+                    for (auto ch = 0; ch < 3; ch++)
+                    {
+                        auto a = Expand4(c.colors[0][ch]), b = Expand4(c.colors[1][ch]);
+                        paint[0][ch] = a;
+                        paint[1][ch] = Clamp(b + kDistance[d], 0, 255);
+                        paint[2][ch] = b;
+                        paint[3][ch] = Clamp(b - kDistance[d], 0, 255);
+                    }
+
+                    c.tables[0] = d;
+                    c.error = MapPalette(palette, counts, paint, c.map[0]);
+                    if (c.error < best.error) best = c;
+                }
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Utility functions
+
+        // Maps each palette entry to the nearest paint color and returns the
+        // count-weighted squared error.
+        static int MapPalette(const int palette[4][4], const int counts[4], const int paint[4][3], int* map)
+        {
+            auto total = 0;
+            for (auto k = 0; k < 4; k++)
+            {
+                auto nearest = INT_MAX;
+                map[k] = 0;
+                for (auto v = 0; v < 4; v++)
+                {
+                    auto dr = palette[k][0] - paint[v][0];
+                    auto dg = palette[k][1] - paint[v][1];
+                    auto db = palette[k][2] - paint[v][2];
+                    auto e = dr * dr + dg * dg + db * db;
+                    if (e < nearest) nearest = e, map[k] = v;
+                }
+                total += counts[k] * nearest;
+            }
+            return total;
+        }
+
+        // Count-weighted mean of two palette entries (plain mean when
+        // neither is used)
+        static void GroupMean(const int palette[4][4], const int counts[4], int i, int j, int* mean)
+        {
+            auto unused = counts[i] + counts[j] == 0;
+            auto wi = unused ? 1 : counts[i], wj = unused ? 1 : counts[j];
+            for (auto ch = 0; ch < 3; ch++)
+                mean[ch] = (wi * palette[i][ch] + wj * palette[j][ch] + (wi + wj) / 2) / (wi + wj);
+        }
+
+        static int NearestAlpha(int value, int base, int table, int multiplier, int& index)
+        {
+            auto nearest = INT_MAX;
+            for (auto v = 0; v < 8; v++)
+            {
+                auto e = value - Clamp(base + kAlphaTable[table][v] * multiplier, 0, 255);
+                if (e * e < nearest) nearest = e * e, index = v;
+            }
+            return nearest;
+        }
+
+        static int Quantize(int value, int max)
+        {
+            return (value * max + 127) / 255;
+        }
+
+        static int Expand4(int x) { return x * 17; }
+        static int Expand5(int x) { return (x << 3) | (x >> 2); }
+
+        static int Clamp(int x, int lo, int hi)
+        {
+            return std::min(std::max(x, lo), hi);
+        }
+
+        // 64-bit word to a big-endian block
+        static void Write(uint64_t word, uint8_t* block)
+        {
+            for (auto i = 0; i < 8; i++) block[i] = static_cast<uint8_t>(word >> (56 - i * 8));
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,544 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ReadBuffer.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // File I/O policy (the values are shared with the C# side)
+    //
+    enum class IOPolicy : int
+    {
+        Buffered = 0,  // Plain reads through the page cache
+        Prefetch = 1,  // Read-ahead hints driven by the playback direction
+        Streaming = 2, // Prefetch + dropping consumed frames from the cache
+        Direct = 3,    // Unbuffered (O_DIRECT) reads with aligned buffers
+        Mapped = 4     // Memory-mapped file without copying frame data
+    };
+
+    //
+    // Positional file reader with a selectable I/O policy
+    //
+    // The stdio handle is only used for parsing the container. Frame data is
+    // read with positional reads, so it doesn't depend on the stdio file
+    // position.
+    //
+    // Readers of the same file share the file handle (see the copy
+    // constructor) while keeping their own I/O policies. The hints that
+    // affect the whole file (the access pattern and dropping consumed
+    // pages from the cache) are only given while a single reader is using
+    // the handle, so one reader can't override or evict another's.
+    //
+    // The mapped policy maps the whole file and points the read buffers
+    // into the mapping instead of copying the frame data. The mapping is
+    // reference counted, so buffers (and decoded frames referring to them)
+    // stay valid after the policy is changed or the reader is destroyed.
+    //
+    // Backward access (reverse playback) defeats the OS read-ahead, so the
+    // buffered policies read a large span ending at the requested frame
+    // and serve the following (preceding) frames from the span.
+    //
+    class FileReader
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        // An invalid reader (no file)
+        FileReader() = default;
+
+        FileReader(const char* path)
+        {
+            FILE* file = nullptr;
+        #ifdef _WIN32
+            // Convert UTF-8 to wide character for Windows
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+            if (wlen <= 0) return;
+
+            wpath_.resize(wlen);
+            MultiByteToWideChar(CP_UTF8, 0, path, -1, &wpath_[0], wlen);
+            wpath_.resize(wlen - 1);
+
+            if (_wfopen_s(&file, wpath_.c_str(), L"rb") != 0) file = nullptr;
+        #else
+            file = fopen(path, "rb");
+            path_ = path;
+        #endif
+            if (file == nullptr) return;
+            file_.reset(file, fclose);
+            readers_ = std::make_shared<std::atomic<int>>(0);
+        }
+
+        // Another reader of the same file: The file handle is shared, and
+        // the reader starts with the buffered policy and its own state.
+        FileReader(const FileReader& other)
+          : file_(other.file_), readers_(other.readers_), isCopy_(true)
+        {
+        #ifdef _WIN32
+            wpath_ = other.wpath_;
+        #else
+            path_ = other.path_;
+        #endif
+
+            // The access pattern hinted by the first reader would apply to
+            // both of them now. Reset it to the default.
+            if (readers_ != nullptr && ++*readers_ == 2) AdviseNormal();
+        }
+
+        FileReader& operator=(const FileReader&) = delete;
+
+        ~FileReader()
+        {
+            CloseDirectHandle();
+            if (isCopy_ && readers_ != nullptr) --*readers_;
+        }
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsValid() const
+        {
+            return file_ != nullptr;
+        }
+
+        FILE* GetStdioHandle() const
+        {
+            return file_.get();
+        }
+
+        IOPolicy GetPolicy() const
+        {
+            return policy_;
+        }
+
+        // Changes the I/O policy and returns the policy actually applied.
+        // It falls back to the buffered policy when unbuffered I/O is
+        // unavailable (e.g. tmpfs doesn't support O_DIRECT) or the file
+        // can't be mapped (e.g. the address space is too small).
+        IOPolicy SetPolicy(IOPolicy policy)
+        {
+            if (file_ == nullptr) return policy_;
+
+            CloseDirectHandle();
+            mapping_.reset();
+            mappedSize_ = 0;
+
+            if (policy == IOPolicy::Direct && !OpenDirectHandle())
+                policy = IOPolicy::Buffered;
+
+            if (policy == IOPolicy::Mapped && !MapFile())
+                policy = IOPolicy::Buffered;
+
+            policy_ = policy;
+            lastOffset_ = kNoOffset;
+            forward_ = true;
+            DropSpan();
+
+            // Reset the access pattern hint to the default.
+            AdviseAccessPattern();
+
+            return policy_;
+        }
+
+        #pragma endregion
+
+        #pragma region Read methods
+
+        // Reads a byte range without applying the I/O policy.
+        size_t ReadRaw(uint64_t offset, void* dest, size_t size)
+        {
+            return PositionalRead(GetHandle(), dest, size, offset);
+        }
+
+        // Reads a frame into a read buffer with applying the I/O policy.
+        void Read(uint64_t offset, size_t size, ReadBuffer& buffer)
+        {
+            buffer.chunkBegin = 0;
+            buffer.chunkEnd = ReadBuffer::kAllChunks;
+
+            if (policy_ == IOPolicy::Mapped && offset + size <= mappedSize_)
+            {
+                buffer.mapped = mapping_.get() + offset;
+                buffer.owner = mapping_;
+                buffer.length = size;
+                return;
+            }
+
+            buffer.Unmap();
+
+            if (policy_ == IOPolicy::Direct && ReadDirect(offset, size, buffer))
+                return;
+
+            buffer.storage.resize(size);
+            buffer.offset = 0;
+            buffer.length = size;
+
+            auto seek = TrackDirection(offset, size);
+
+            if (forward_)
+            {
+                DropSpan();
+                PositionalRead(GetHandle(), buffer.storage.data(), size, offset);
+            }
+            else
+            {
+                ReadBackward(offset, size, buffer.storage.data());
+            }
+
+            if (policy_ == IOPolicy::Prefetch || policy_ == IOPolicy::Streaming)
+                AdviseAfterRead(offset, size, seek);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        static constexpr uint64_t kNoOffset = ~0ull;
+
+        // Alignment for unbuffered I/O (covers 512/4K sector devices)
+        static constexpr size_t kDirectAlignment = 4096;
+
+        // Read-ahead window length in frames
+        static constexpr size_t kPrefetchFrames = 8;
+
+        // Backward read span length (in frames, and its limits in bytes)
+        static constexpr size_t kSpanFrames = 16;
+        static constexpr size_t kMinSpanBytes = 1 << 20;
+        static constexpr size_t kMaxSpanBytes = 32 << 20;
+
+        std::shared_ptr<FILE> file_;
+
+        // Number of the copies (readers) sharing the handle
+        std::shared_ptr<std::atomic<int>> readers_;
+        bool isCopy_ = false;
+        IOPolicy policy_ = IOPolicy::Buffered;
+
+        // Access pattern tracking for the read-ahead hints
+        uint64_t lastOffset_ = kNoOffset;
+        uint64_t prefetchEdge_ = 0;
+        bool forward_ = true;
+
+        // Backward read span
+        std::vector<uint8_t> span_;
+        uint64_t spanOffset_ = 0;
+        size_t spanLength_ = 0;
+
+        // Whole-file mapping (mapped policy)
+        std::shared_ptr<const uint8_t> mapping_;
+        uint64_t mappedSize_ = 0;
+
+    #ifdef _WIN32
+        using Handle = HANDLE;
+        std::wstring wpath_;
+        HANDLE direct_ = INVALID_HANDLE_VALUE;
+    #else
+        using Handle = int;
+        std::string path_;
+        int direct_ = -1;
+    #endif
+
+        #pragma endregion
+
+        #pragma region Platform-dependent implementation
+
+        Handle GetHandle() const
+        {
+        #ifdef _WIN32
+            return reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file_.get())));
+        #else
+            return fileno(file_.get());
+        #endif
+        }
+
+        static size_t PositionalRead(Handle handle, void* dest, size_t size, uint64_t offset)
+        {
+            auto ptr = static_cast<uint8_t*>(dest);
+            size_t total = 0;
+
+            while (total < size)
+            {
+            #ifdef _WIN32
+                OVERLAPPED ov = {};
+                ov.Offset = static_cast<DWORD>(offset + total);
+                ov.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+                auto request = static_cast<DWORD>(std::min<size_t>(size - total, 0x40000000));
+                DWORD done = 0;
+                if (!ReadFile(handle, ptr + total, request, &done, &ov)) break;
+            #else
+                auto done = pread(handle, ptr + total, size - total,
+                                  static_cast<off_t>(offset + total));
+                if (done < 0) break;
+            #endif
+                if (done == 0) break; // EOF
+                total += static_cast<size_t>(done);
+            }
+
+            return total;
+        }
+
+        bool OpenDirectHandle()
+        {
+        #if defined(_WIN32)
+            direct_ = CreateFileW(wpath_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+            return direct_ != INVALID_HANDLE_VALUE;
+        #elif defined(__APPLE__)
+            direct_ = open(path_.c_str(), O_RDONLY);
+            if (direct_ < 0) return false;
+            fcntl(direct_, F_NOCACHE, 1);
+            return true;
+        #elif defined(O_DIRECT)
+            direct_ = open(path_.c_str(), O_RDONLY | O_DIRECT);
+            return direct_ >= 0;
+        #else
+            return false;
+        #endif
+        }
+
+        void CloseDirectHandle()
+        {
+        #ifdef _WIN32
+            if (direct_ != INVALID_HANDLE_VALUE) CloseHandle(direct_);
+            direct_ = INVALID_HANDLE_VALUE;
+        #else
+            if (direct_ >= 0) close(direct_);
+            direct_ = -1;
+        #endif
+        }
+
+        // Unbuffered read: Both the file range and the destination have to be
+        // aligned, so we read the enclosing aligned range into an aligned
+        // position in the storage and point the frame data inside it.
+        bool ReadDirect(uint64_t offset, size_t size, ReadBuffer& buffer)
+        {
+            auto head = static_cast<size_t>(offset & (kDirectAlignment - 1));
+            auto length = AlignUp(head + size, kDirectAlignment);
+
+            buffer.storage.resize(length + kDirectAlignment);
+
+            auto address = reinterpret_cast<uintptr_t>(buffer.storage.data());
+            auto pad = AlignUp(address, kDirectAlignment) - address;
+            auto dest = buffer.storage.data() + pad;
+
+            // The read can be short at the end of the file.
+            auto read = PositionalRead(direct_, dest, length, offset - head);
+
+            if (read < head + size)
+            {
+                // Unbuffered reads are rejected (the filesystem doesn't
+                // support it, etc.). Fall back to the buffered policy.
+                SetPolicy(IOPolicy::Buffered);
+                return false;
+            }
+
+            buffer.offset = pad + head;
+            buffer.length = size;
+            return true;
+        }
+
+        // Maps the whole file read-only. The view is released when the last
+        // reference to it is dropped.
+        bool MapFile()
+        {
+        #ifdef _WIN32
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(GetHandle(), &size) || size.QuadPart <= 0 ||
+                static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) return false;
+
+            auto mapping = CreateFileMappingW(GetHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) return false;
+            auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (view == nullptr) return false;
+
+            mapping_.reset(static_cast<const uint8_t*>(view),
+                           [](const uint8_t* p) { UnmapViewOfFile(p); });
+            mappedSize_ = static_cast<uint64_t>(size.QuadPart);
+        #else
+            struct stat st;
+            if (fstat(GetHandle(), &st) != 0 || st.st_size <= 0 ||
+                static_cast<uint64_t>(st.st_size) > SIZE_MAX) return false;
+
+            auto length = static_cast<size_t>(st.st_size);
+            auto view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, GetHandle(), 0);
+            if (view == MAP_FAILED) return false;
+
+            mapping_.reset(static_cast<const uint8_t*>(view), [length](const uint8_t* p)
+                           { munmap(const_cast<uint8_t*>(p), length); });
+            mappedSize_ = length;
+        #endif
+            return true;
+        }
+
+        static size_t AlignUp(size_t x, size_t align)
+        {
+            return (x + align - 1) & ~(align - 1);
+        }
+
+        // Whole-file access pattern hint: Sequential for forward playback
+        // with the prefetch policies, random for backward access (the span
+        // reads are explicit, and the kernel read-ahead only goes forward).
+        // It's stored on the shared file description, so it's skipped while
+        // other readers are using the handle.
+        void AdviseAccessPattern()
+        {
+        #if defined(POSIX_FADV_SEQUENTIAL)
+            if (IsShared()) return;
+            auto prefetch = policy_ == IOPolicy::Prefetch || policy_ == IOPolicy::Streaming;
+            auto advice = !forward_ ? POSIX_FADV_RANDOM :
+                          (prefetch ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+            posix_fadvise(GetHandle(), 0, 0, advice);
+        #endif
+        }
+
+        void AdviseNormal()
+        {
+        #if defined(POSIX_FADV_NORMAL)
+            posix_fadvise(GetHandle(), 0, 0, POSIX_FADV_NORMAL);
+        #endif
+        }
+
+        bool IsShared() const
+        {
+            return readers_ != nullptr && readers_->load() > 1;
+        }
+
+        void AdviseWillNeed(uint64_t offset, uint64_t length)
+        {
+        #if defined(POSIX_FADV_WILLNEED)
+            posix_fadvise(GetHandle(), static_cast<off_t>(offset),
+                          static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+        #elif defined(F_RDADVISE)
+            radvisory ra;
+            ra.ra_offset = static_cast<off_t>(offset);
+            ra.ra_count = static_cast<int>(std::min<uint64_t>(length, INT32_MAX));
+            fcntl(GetHandle(), F_RDADVISE, &ra);
+        #endif
+        }
+
+        void AdviseDontNeed(uint64_t offset, uint64_t length)
+        {
+        #if defined(POSIX_FADV_DONTNEED)
+            posix_fadvise(GetHandle(), static_cast<off_t>(offset),
+                          static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+        #endif
+        }
+
+        #pragma endregion
+
+        #pragma region Backward span reads
+
+        // Playback direction detection: A large jump is a seek or a
+        // wrap-around, which doesn't change the direction. Returns true on a
+        // seek or a direction change.
+        bool TrackDirection(uint64_t offset, size_t size)
+        {
+            auto window = static_cast<uint64_t>(size) * kPrefetchFrames;
+
+            auto seek = lastOffset_ == kNoOffset;
+            if (!seek)
+            {
+                auto forward = offset >= lastOffset_;
+                auto distance = forward ? offset - lastOffset_ : lastOffset_ - offset;
+                if (distance > window * 2)
+                    seek = true;
+                else if (forward != forward_)
+                {
+                    forward_ = forward;
+                    seek = true;
+                    AdviseAccessPattern();
+                }
+            }
+
+            lastOffset_ = offset;
+            return seek;
+        }
+
+        // Serves a frame from the span, or reads a new span that ends at the
+        // frame when it's outside the current one.
+        void ReadBackward(uint64_t offset, size_t size, uint8_t* dest)
+        {
+            if (offset < spanOffset_ || offset + size > spanOffset_ + spanLength_)
+            {
+                auto length = std::min(std::max(size * kSpanFrames, kMinSpanBytes), kMaxSpanBytes);
+                length = std::max(length, size);
+
+                auto end = offset + size;
+                spanOffset_ = end > length ? end - length : 0;
+                span_.resize(length);
+                spanLength_ = PositionalRead(GetHandle(), span_.data(),
+                                             static_cast<size_t>(end - spanOffset_), spanOffset_);
+            }
+
+            if (offset >= spanOffset_ && offset + size <= spanOffset_ + spanLength_)
+                std::memcpy(dest, span_.data() + (offset - spanOffset_), size);
+            else
+                PositionalRead(GetHandle(), dest, size, offset); // Short read
+        }
+
+        void DropSpan()
+        {
+            spanLength_ = 0;
+        }
+
+        #pragma endregion
+
+        #pragma region Read-ahead hints
+
+        void AdviseAfterRead(uint64_t offset, size_t size, bool seek)
+        {
+            // Backward: Prefetch the next span too.
+            auto window = static_cast<uint64_t>(size) * kPrefetchFrames;
+            if (!forward_) window = std::max<uint64_t>(window, span_.size() * 2);
+
+            if (seek) prefetchEdge_ = forward_ ? offset + size : offset;
+
+            // Extend the prefetched range up to the window length.
+            if (forward_)
+            {
+                auto end = offset + size + window;
+                if (end > prefetchEdge_)
+                {
+                    AdviseWillNeed(prefetchEdge_, end - prefetchEdge_);
+                    prefetchEdge_ = end;
+                }
+            }
+            else
+            {
+                auto begin = offset > window ? offset - window : 0;
+                if (begin < prefetchEdge_)
+                {
+                    AdviseWillNeed(begin, prefetchEdge_ - begin);
+                    prefetchEdge_ = begin;
+                }
+            }
+
+            // The frame has been consumed; Drop it from the page cache. The
+            // pages are of the file, so other readers may still need them.
+            if (policy_ == IOPolicy::Streaming && !IsShared()) AdviseDontNeed(offset, size);
+        }
+
+        #pragma endregion
+    };
+}
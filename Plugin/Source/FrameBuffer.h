@@ -0,0 +1,293 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // Frame memory pool
+    //
+    // Frame-sized blocks (read buffers, decoder outputs and staging buffers)
+    // are allocated directly from the OS as page-aligned, uninitialized
+    // memory. Released blocks are kept in the pool up to a byte limit and
+    // reused by the next buffers of a similar size, so a newly opened clip
+    // doesn't page-fault its frame memory in again on the first frame.
+    //
+    // Blocks of 2MB or larger can be backed by transparent huge pages
+    // (Linux/Android) and can be pre-faulted on allocation. Both are off by
+    // default.
+    //
+    class BufferPool
+    {
+    public:
+
+        #pragma region Shared instance
+
+        // Process-wide pool. It's never destroyed, as buffers can be
+        // released while unloading the library.
+        static BufferPool& GetShared()
+        {
+            static auto pool = new BufferPool;
+            return *pool;
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        static constexpr size_t kPageSize = 4096;
+        static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+        // Allocates a block of the given size or larger. The capacity is
+        // set to the actual block size. Returns nullptr on failure.
+        void* Acquire(size_t size, size_t& capacity)
+        {
+            capacity = RoundUp(size);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                // Reuse a cached block unless it's more than twice as large.
+                auto it = blocks_.lower_bound(capacity);
+                if (it != blocks_.end() && it->first <= capacity * 2)
+                {
+                    auto data = it->second;
+                    capacity = it->first;
+                    cached_ -= capacity;
+                    blocks_.erase(it);
+                    return data;
+                }
+            }
+
+            return Map(capacity);
+        }
+
+        void Release(void* data, size_t capacity)
+        {
+            if (data == nullptr) return;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (cached_ + capacity <= limit_)
+                {
+                    blocks_.emplace(capacity, data);
+                    cached_ += capacity;
+                    return;
+                }
+            }
+
+            Unmap(data, capacity);
+        }
+
+        // Byte limit of the cached blocks (zero disables caching)
+        void Configure(size_t limit, bool hugePages, bool prefault)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            limit_ = limit;
+            hugePages_ = hugePages;
+            prefault_ = prefault;
+            Evict(limit_);
+        }
+
+        // Returns the cached blocks to the OS.
+        void Trim()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Evict(0);
+        }
+
+        void GetState(size_t& cachedBytes, int& cachedBlocks)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cachedBytes = cached_;
+            cachedBlocks = static_cast<int>(blocks_.size());
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        std::mutex mutex_;
+        std::multimap<size_t, void*> blocks_; // Capacity -> block
+        size_t cached_ = 0;
+        size_t limit_ = 256 * 1024 * 1024;
+        bool hugePages_ = false;
+        bool prefault_ = false;
+
+        BufferPool() = default;
+
+        // Large blocks are rounded to the huge page size, so that frames of
+        // slightly different sizes share the same blocks.
+        static size_t RoundUp(size_t size)
+        {
+            auto unit = size >= kHugePageSize ? kHugePageSize : kPageSize;
+            return (std::max<size_t>(size, 1) + unit - 1) / unit * unit;
+        }
+
+        // Called with the lock held
+        void Evict(size_t limit)
+        {
+            while (cached_ > limit)
+            {
+                auto it = std::prev(blocks_.end()); // Largest first
+                cached_ -= it->first;
+                Unmap(it->second, it->first);
+                blocks_.erase(it);
+            }
+        }
+
+        void* Map(size_t capacity)
+        {
+            bool hugePages, prefault;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                hugePages = hugePages_ && capacity >= kHugePageSize;
+                prefault = prefault_;
+            }
+
+        #if defined(_WIN32)
+            // Large pages need a user privilege on Windows, so they aren't
+            // used here.
+            auto data = static_cast<uint8_t*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            if (data == nullptr) return nullptr;
+        #else
+            // Huge pages need 2MB-aligned ranges: Over-allocate and trim the
+            // head and the tail.
+            auto extra = hugePages ? kHugePageSize : 0;
+            auto mapped = mmap(nullptr, capacity + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapped == MAP_FAILED) return nullptr;
+
+            auto data = static_cast<uint8_t*>(mapped);
+            if (extra > 0)
+            {
+                auto address = reinterpret_cast<uintptr_t>(mapped);
+                auto head = ((address + kHugePageSize - 1) & ~(kHugePageSize - 1)) - address;
+                if (head > 0) munmap(mapped, head);
+                if (extra - head > 0) munmap(data + head + capacity, extra - head);
+                data += head;
+            #if defined(MADV_HUGEPAGE)
+                madvise(data, capacity, MADV_HUGEPAGE);
+            #endif
+            }
+        #endif
+
+            // Touch every page now rather than on the first frame.
+            if (prefault)
+                for (size_t i = 0; i < capacity; i += kPageSize)
+                    static_cast<volatile uint8_t*>(data)[i] = 0;
+
+            return data;
+        }
+
+        static void Unmap(void* data, size_t capacity)
+        {
+        #if defined(_WIN32)
+            (void)capacity;
+            VirtualFree(data, 0, MEM_RELEASE);
+        #else
+            munmap(data, capacity);
+        #endif
+        }
+
+        #pragma endregion
+    };
+
+    //
+    // Frame buffer
+    //
+    // A byte buffer on pooled memory with the subset of the std::vector
+    // interface the frame paths use. Unlike std::vector, it doesn't
+    // initialize the contents, and the data is always page-aligned (which
+    // also satisfies SIMD loads and unbuffered reads).
+    //
+    class FrameBuffer
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        FrameBuffer() = default;
+
+        ~FrameBuffer()
+        {
+            BufferPool::GetShared().Release(data_, capacity_);
+        }
+
+        FrameBuffer(FrameBuffer&& other) noexcept
+        {
+            swap(other);
+        }
+
+        FrameBuffer& operator=(FrameBuffer&& other) noexcept
+        {
+            swap(other);
+            return *this;
+        }
+
+        FrameBuffer(const FrameBuffer&) = delete;
+        FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        uint8_t* data() { return data_; }
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+        size_t capacity() const { return capacity_; }
+        bool empty() const { return size_ == 0; }
+
+        // Grows the block, keeping the contents. New bytes are left
+        // uninitialized.
+        void reserve(size_t capacity)
+        {
+            if (capacity <= capacity_) return;
+
+            size_t newCapacity;
+            auto newData = static_cast<uint8_t*>(BufferPool::GetShared().Acquire(capacity, newCapacity));
+            if (newData == nullptr) throw std::bad_alloc();
+
+            if (size_ > 0) std::memcpy(newData, data_, size_);
+            BufferPool::GetShared().Release(data_, capacity_);
+
+            data_ = newData;
+            capacity_ = newCapacity;
+        }
+
+        void resize(size_t size)
+        {
+            reserve(size);
+            size_ = size;
+        }
+
+        void swap(FrameBuffer& other) noexcept
+        {
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(capacity_, other.capacity_);
+        }
+
+        #pragma endregion
+
+    private:
+
+        uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+}
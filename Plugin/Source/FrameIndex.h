@@ -0,0 +1,353 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "SampleTable.h"
+
+namespace KlakHap
+{
+    //
+    // Video stream properties
+    //
+    struct VideoProperties
+    {
+        uint32_t frameCount;
+        uint32_t width;
+        uint32_t height;
+        uint32_t videoType;
+        uint32_t timescale;
+        uint32_t chunkCount;   // Hap chunk count of the first frame
+        uint64_t duration;
+    };
+
+    //
+    // Persistent frame index (sidecar file)
+    //
+    // The compact sample table with the video properties, so that a clip
+    // can be opened without parsing the MP4 sample tables. The file is
+    // memory-mapped and validated against the size and the modification
+    // time of the source file.
+    //
+    class FrameIndex
+    {
+    public:
+
+        #pragma region File layout
+
+        static constexpr uint32_t kVersion = 3;
+        static constexpr const char* kExtension = ".khidx";
+
+        struct Header
+        {
+            char magic[4];         // "KHIX"
+            uint32_t version;
+            uint64_t sourceSize;   // Source file validation
+            int64_t sourceTime;    // Nanoseconds (100ns units on Windows)
+            VideoProperties video;
+            SampleTable::Layout table; // Followed by the table data
+        };
+
+        #pragma endregion
+
+        #pragma region Global configuration
+
+        // Enables/disables the frame index. The sidecar file is placed next
+        // to the source file when the cache directory is null or empty.
+        static void Configure(bool enable, const char* directory)
+        {
+            std::lock_guard<std::mutex> lock(GetConfigMutex());
+            GetConfig().enabled = enable;
+            GetConfig().directory = (enable && directory) ? directory : "";
+        }
+
+        static bool IsEnabled()
+        {
+            std::lock_guard<std::mutex> lock(GetConfigMutex());
+            return GetConfig().enabled;
+        }
+
+        // Sidecar file path for a given source file
+        static std::string GetPath(const char* source)
+        {
+            std::lock_guard<std::mutex> lock(GetConfigMutex());
+            const auto& dir = GetConfig().directory;
+
+            if (dir.empty()) return std::string(source) + kExtension;
+
+            // Cache directory: Named with a hash of the source path
+            uint64_t hash = 14695981039346656037ull;
+            for (auto p = source; *p; p++)
+                hash = (hash ^ static_cast<uint8_t>(*p)) * 1099511628211ull;
+
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+            auto last = dir.back();
+            auto separator = (last == '/' || last == '\\') ? "" : "/";
+            return dir + separator + name + kExtension;
+        }
+
+        // Size and modification time of an open file
+        static bool GetSourceStamp(FILE* file, uint64_t& size, int64_t& time)
+        {
+        #ifdef _WIN32
+            auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+            BY_HANDLE_FILE_INFORMATION info;
+            if (GetFileInformationByHandle(handle, &info) == 0) return false;
+            size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+            time = (static_cast<int64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+                   info.ftLastWriteTime.dwLowDateTime;
+        #else
+            struct stat st;
+            if (fstat(fileno(file), &st) != 0) return false;
+            size = static_cast<uint64_t>(st.st_size);
+            time = GetModificationTime(st);
+        #endif
+            return true;
+        }
+
+    #ifndef _WIN32
+
+        // Modification time in nanoseconds: Whole seconds miss an in-place
+        // rewrite of the same size within a second.
+        static int64_t GetModificationTime(const struct stat& st)
+        {
+        #if defined(__APPLE__)
+            const auto& ts = st.st_mtimespec;
+        #else
+            const auto& ts = st.st_mtim;
+        #endif
+            return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+    #endif
+
+        #pragma endregion
+
+        #pragma region Constructor/destructor
+
+        FrameIndex() = default;
+        FrameIndex(const FrameIndex&) = delete;
+        FrameIndex& operator=(const FrameIndex&) = delete;
+
+        ~FrameIndex()
+        {
+            Unmap();
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        bool IsValid() const
+        {
+            return header_ != nullptr;
+        }
+
+        const Header& GetHeader() const
+        {
+            return *header_;
+        }
+
+        const void* GetTableData() const
+        {
+            return header_ + 1;
+        }
+
+        uint64_t GetTableDataSize() const
+        {
+            return mappedSize_ - sizeof(Header);
+        }
+
+        // Maps a sidecar file. Returns false when the file is missing or
+        // doesn't match the source file.
+        bool Open(const std::string& path, uint64_t sourceSize, int64_t sourceTime)
+        {
+            Unmap();
+
+            if (!Map(path) || mappedSize_ < sizeof(Header)) { Unmap(); return false; }
+
+            auto header = static_cast<const Header*>(mapped_);
+            auto expected = sizeof(Header) + SampleTable::GetDataSize(header->table);
+
+            if (std::memcmp(header->magic, "KHIX", 4) != 0 ||
+                header->version != kVersion ||
+                header->sourceSize != sourceSize ||
+                header->sourceTime != sourceTime ||
+                header->video.frameCount == 0 ||
+                header->video.frameCount != header->table.frameCount ||
+                mappedSize_ != expected)
+            {
+                Unmap();
+                return false;
+            }
+
+            header_ = header;
+            return true;
+        }
+
+        // Writes a sidecar file. It's written into a temporary file and then
+        // renamed, so other processes never see a partially written index.
+        static bool Write(const std::string& path, const Header& header, const void* data)
+        {
+            auto size = static_cast<size_t>(SampleTable::GetDataSize(header.table));
+
+            auto temp = path + ".tmp";
+
+            auto file = OpenForWrite(temp);
+            if (file == nullptr) return false;
+
+            auto ok = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+                      fwrite(data, 1, size, file) == size;
+            ok = (fclose(file) == 0) && ok;
+
+            if (ok) ok = Replace(temp, path);
+            if (!ok) std::remove(temp.c_str());
+
+            return ok;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        struct Config
+        {
+            bool enabled = false;
+            std::string directory;
+        };
+
+        static Config& GetConfig()
+        {
+            static Config config;
+            return config;
+        }
+
+        static std::mutex& GetConfigMutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        const Header* header_ = nullptr;
+        void* mapped_ = nullptr;
+        size_t mappedSize_ = 0;
+
+        #pragma endregion
+
+        #pragma region Platform-dependent implementation
+
+    #ifdef _WIN32
+
+        static std::wstring Widen(const std::string& path)
+        {
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+            if (wlen <= 0) return std::wstring();
+            std::wstring wpath(wlen, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wpath[0], wlen);
+            wpath.resize(wlen - 1);
+            return wpath;
+        }
+
+        bool Map(const std::string& path)
+        {
+            auto file = CreateFileW(Widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return false;
+
+            LARGE_INTEGER size;
+            HANDLE mapping = nullptr;
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+                mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (mapping == nullptr) return false;
+
+            mapped_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (mapped_ == nullptr) return false;
+
+            mappedSize_ = static_cast<size_t>(size.QuadPart);
+            return true;
+        }
+
+        void Unmap()
+        {
+            if (mapped_ != nullptr) UnmapViewOfFile(mapped_);
+            mapped_ = nullptr;
+            mappedSize_ = 0;
+            header_ = nullptr;
+        }
+
+        static FILE* OpenForWrite(const std::string& path)
+        {
+            FILE* file = nullptr;
+            if (_wfopen_s(&file, Widen(path).c_str(), L"wb") != 0) return nullptr;
+            return file;
+        }
+
+        static bool Replace(const std::string& from, const std::string& to)
+        {
+            return MoveFileExW(Widen(from).c_str(), Widen(to).c_str(),
+                               MOVEFILE_REPLACE_EXISTING) != 0;
+        }
+
+    #else
+
+        bool Map(const std::string& path)
+        {
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return false; }
+
+            auto p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) return false;
+
+            mapped_ = p;
+            mappedSize_ = static_cast<size_t>(st.st_size);
+            return true;
+        }
+
+        void Unmap()
+        {
+            if (mapped_ != nullptr) munmap(mapped_, mappedSize_);
+            mapped_ = nullptr;
+            mappedSize_ = 0;
+            header_ = nullptr;
+        }
+
+        static FILE* OpenForWrite(const std::string& path)
+        {
+            return fopen(path.c_str(), "wb");
+        }
+
+        static bool Replace(const std::string& from, const std::string& to)
+        {
+            return std::rename(from.c_str(), to.c_str()) == 0;
+        }
+
+    #endif
+
+        #pragma endregion
+    };
+}
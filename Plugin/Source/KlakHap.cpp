@@ -1,7 +1,13 @@
 #include <unordered_map>
+#include "CpuDispatch.h"
+#include "DecodeRing.h"
 #include "Decoder.h"
 #include "Demuxer.h"
+#include "FrameBuffer.h"
 #include "ReadBuffer.h"
+#include "Remuxer.h"
+#include "Thumbnailer.h"
+#include "Trace.h"
 #include "IUnityRenderingExtensions.h"
 
 #if defined(_WIN32)
@@ -41,6 +47,8 @@ namespace
         case kUnityRenderingExtFormatRGBA_DXT5_UNorm:
         case kUnityRenderingExtFormatRGBA_BC7_SRGB:
         case kUnityRenderingExtFormatRGBA_BC7_UNorm:
+        case kUnityRenderingExtFormatR8G8B8A8_SRGB:
+        case kUnityRenderingExtFormatR8G8B8A8_UNorm:
             return 4;
         }
         return 0;
@@ -55,6 +63,7 @@ namespace
         {
             // UpdateTextureBegin: Return texture image data.
             auto params = reinterpret_cast<UnityRenderingExtTextureUpdateParamsV2*>(data);
+            TraceScope trace("UpdateTextureBegin", static_cast<int32_t>(params->userData));
             auto it = decoderMap_.find(params->userData);
             if (it != decoderMap_.end())
             {
@@ -66,6 +75,7 @@ namespace
         {
             // UpdateTextureEnd:
             auto params = reinterpret_cast<UnityRenderingExtTextureUpdateParamsV2*>(data);
+            TraceScope trace("UpdateTextureEnd", static_cast<int32_t>(params->userData));
             auto it = decoderMap_.find(params->userData);
             if (it != decoderMap_.end()) it->second->UnlockBuffer();
         }
@@ -95,6 +105,47 @@ extern "C" UnityRenderingEventAndData UNITY_INTERFACE_EXPORT KlakHap_GetTextureU
 
 #pragma endregion
 
+#pragma region CPU dispatch functions
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetCpuVariant()
+{
+    return static_cast<int32_t>(CpuDispatch::GetVariant());
+}
+
+#if defined(KLAKHAP_CPU_DISPATCH)
+
+// Snappy decompressor used by hap.c (HAP_SNAPPY_UNCOMPRESS)
+extern "C" snappy_status KlakHap_SnappyUncompress(const char* compressed, size_t compressedLength, char* uncompressed, size_t* uncompressedLength)
+{
+    return CpuDispatch::SnappyUncompress(compressed, compressedLength, uncompressed, uncompressedLength);
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region Trace functions
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetTraceEnabled(int32_t enable)
+{
+    Tracer::GetShared().SetEnabled(enable != 0);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ClearTrace()
+{
+    Tracer::GetShared().Clear();
+}
+
+// Writes the recorded spans as a Chrome trace event JSON file. Returns the
+// number of the spans written, or -1 on failure.
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DumpTrace(const char* filepath)
+{
+    if (filepath == nullptr) return -1;
+    return Tracer::GetShared().Dump(filepath);
+}
+
+#pragma endregion
+
 #pragma region Read buffer functions
 
 extern "C" ReadBuffer UNITY_INTERFACE_EXPORT * KlakHap_CreateReadBuffer()
@@ -107,10 +158,71 @@ extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyReadBuffer(ReadBuffer* buf
     if (buffer != nullptr) delete buffer;
 }
 
+// Frame memory pool: The limit is the size of the cached memory in MB.
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ConfigureBufferPool(int32_t limitMB, int32_t hugePages, int32_t prefault)
+{
+    auto limit = static_cast<size_t>(limitMB > 0 ? limitMB : 0) * 1024 * 1024;
+    BufferPool::GetShared().Configure(limit, hugePages != 0, prefault != 0);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_TrimBufferPool()
+{
+    BufferPool::GetShared().Trim();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetBufferPoolState(int64_t* cachedBytes, int32_t* cachedBlocks)
+{
+    if (cachedBytes == nullptr || cachedBlocks == nullptr) return;
+    size_t bytes;
+    int blocks;
+    BufferPool::GetShared().GetState(bytes, blocks);
+    *cachedBytes = static_cast<int64_t>(bytes); *cachedBlocks = blocks;
+}
+
 #pragma endregion
 
 #pragma region Demuxer functions
 
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetFrameIndexMode(int32_t enable, const char* directory)
+{
+    FrameIndex::Configure(enable != 0, directory);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetSampleTablePaging(int32_t frameThreshold)
+{
+    PagedSampleTable::SetThreshold(frameThreshold > 0 ? frameThreshold : 0);
+}
+
+// Number of clips shared between the open demuxers
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_CountSharedClips()
+{
+    return ClipSource::GetSharedCount();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetClipPoolCapacity(int32_t capacity)
+{
+    ClipPool::GetShared().SetCapacity(capacity);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_PrewarmClip(const char* filepath)
+{
+    if (filepath == nullptr) return;
+    ClipPool::GetShared().Prewarm(filepath);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ClearClipPool()
+{
+    ClipPool::GetShared().Clear();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetClipPoolState(int32_t* warm, int32_t* pending)
+{
+    if (warm == nullptr || pending == nullptr) return;
+    int w, p;
+    ClipPool::GetShared().GetState(w, p);
+    *warm = w; *pending = p;
+}
+
 extern "C" Demuxer UNITY_INTERFACE_EXPORT * KlakHap_OpenDemuxer(const char* filepath)
 {
     return new Demuxer(filepath);
@@ -127,31 +239,53 @@ extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DemuxerIsValid(Demuxer* demuxe
     return demuxer->IsValid() ? 1 : 0;
 }
 
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DemuxerIsIndexed(Demuxer* demuxer)
+{
+    if (demuxer == nullptr) return 0;
+    return demuxer->IsIndexed() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DemuxerIsPaged(Demuxer* demuxer)
+{
+    if (demuxer == nullptr) return 0;
+    return demuxer->IsPaged() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_SetDemuxerIOPolicy(Demuxer* demuxer, int32_t policy)
+{
+    if (demuxer == nullptr) return 0;
+    if (policy < 0 || policy > static_cast<int32_t>(IOPolicy::Mapped)) policy = 0;
+    return static_cast<int32_t>(demuxer->SetIOPolicy(static_cast<IOPolicy>(policy)));
+}
+
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_CountFrames(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().sample_count;
+    return demuxer->GetFrameCount();
 }
 
 extern "C" double UNITY_INTERFACE_EXPORT KlakHap_GetDuration(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    auto track = demuxer->GetVideoTrack();
-    auto dur = static_cast<double>(track.duration_hi);
-    dur = dur * 0x100000000L + track.duration_lo;
-    return dur / track.timescale;
+    return demuxer->GetDuration();
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetVideoWidth(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().SampleDescription.video.width;
+    return demuxer->GetWidth();
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetVideoHeight(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().SampleDescription.video.height;
+    return demuxer->GetHeight();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetDemuxerRegion(Demuxer* demuxer, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    if (demuxer == nullptr) return;
+    demuxer->SetRegion(x, y, width, height);
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_AnalyzeVideoType(Demuxer* demuxer)
@@ -175,6 +309,12 @@ extern "C" Decoder UNITY_INTERFACE_EXPORT *KlakHap_CreateDecoder(int width, int
     return new Decoder(width, height, typeID);
 }
 
+extern "C" Decoder UNITY_INTERFACE_EXPORT *KlakHap_CreateScaledDecoder(int width, int height, int typeID, int scale)
+{
+    if (scale < 0 || scale > static_cast<int>(DecodeScale::BlockAverage)) scale = 0;
+    return new Decoder(width, height, typeID, static_cast<DecodeScale>(scale));
+}
+
 extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyDecoder(Decoder* decoder)
 {
     delete decoder;
@@ -194,6 +334,52 @@ extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DecodeFrame(Decoder* decoder, con
     decoder->DecodeFrame(*input);
 }
 
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DecodeFrameInto(Decoder* decoder, const ReadBuffer* input, void* dest, int32_t destSize, int32_t rowPitch)
+{
+    if (decoder == nullptr || input == nullptr || destSize < 0 || rowPitch < 0) return 0;
+    return decoder->DecodeFrameInto(*input, dest, static_cast<size_t>(destSize), static_cast<size_t>(rowPitch)) ? 1 : 0;
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetDecoderRegion(Decoder* decoder, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    if (decoder == nullptr) return;
+    decoder->SetRegion(x, y, width, height);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetDecoderRegion(Decoder* decoder, int32_t* x, int32_t* y, int32_t* width, int32_t* height)
+{
+    if (decoder == nullptr || x == nullptr || y == nullptr || width == nullptr || height == nullptr) return;
+    int rx, ry, rw, rh;
+    decoder->GetRegion(rx, ry, rw, rh);
+    *x = rx; *y = ry; *width = rw; *height = rh;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderScale(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int32_t>(decoder->GetScale());
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_SetDecoderOutputFormat(Decoder* decoder, int32_t format)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int32_t>(decoder->SetOutputFormat(static_cast<OutputFormat>(format)));
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderOutputFormat(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int32_t>(decoder->GetOutputFormat());
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetDecoderOutputSize(Decoder* decoder, int32_t* width, int32_t* height)
+{
+    if (decoder == nullptr || width == nullptr || height == nullptr) return;
+    int w, h;
+    decoder->GetOutputSize(w, h);
+    *width = w; *height = h;
+}
+
 extern "C" const void UNITY_INTERFACE_EXPORT *KlakHap_LockDecoderBuffer(Decoder* decoder)
 {
     if (decoder == nullptr) return nullptr;
@@ -213,3 +399,132 @@ extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderBufferSize(Decoder*
 }
 
 #pragma endregion
+
+#pragma region Decode ring functions
+
+extern "C" DecodeRing UNITY_INTERFACE_EXPORT * KlakHap_CreateDecodeRing(Demuxer* demuxer, Decoder* decoder, int32_t capacity)
+{
+    if (demuxer == nullptr || decoder == nullptr) return nullptr;
+    return new DecodeRing(*demuxer, *decoder, capacity);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyDecodeRing(DecodeRing* ring)
+{
+    if (ring != nullptr) delete ring;
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_RestartDecodeRing(DecodeRing* ring, double time, double delta)
+{
+    if (ring == nullptr) return;
+    ring->Restart(time, delta);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SeekDecodeRing(DecodeRing* ring, double time, double delta)
+{
+    if (ring == nullptr) return;
+    ring->Seek(time, delta);
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DecodeRingIsSeeking(DecodeRing* ring)
+{
+    if (ring == nullptr) return 0;
+    return ring->IsSeeking() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_PresentDecodeRing(DecodeRing* ring, double time, int32_t wait)
+{
+    if (ring == nullptr) return 0;
+    return ring->Present(time, wait != 0) ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecodeRingReadyCount(DecodeRing* ring)
+{
+    if (ring == nullptr) return 0;
+    return ring->GetReadyCount();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetDecodeRingStats(DecodeRing* ring, int32_t* read, int32_t* skipped, int32_t* dropped)
+{
+    if (ring == nullptr || read == nullptr || skipped == nullptr || dropped == nullptr) return;
+    int r, s, d;
+    ring->GetStats(r, s, d);
+    *read = r; *skipped = s; *dropped = d;
+}
+
+#pragma endregion
+
+#pragma region Thumbnailer functions
+
+extern "C" Thumbnailer UNITY_INTERFACE_EXPORT * KlakHap_CreateThumbnailer(Demuxer* demuxer, int32_t frameStep, int32_t maxWidth, int32_t columns)
+{
+    if (demuxer == nullptr) return nullptr;
+    return new Thumbnailer(*demuxer, frameStep, maxWidth, columns);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyThumbnailer(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer != nullptr) delete thumbnailer;
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_CancelThumbnailer(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return;
+    thumbnailer->Cancel();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_GetThumbnailerLayout(Thumbnailer* thumbnailer, int32_t* count, int32_t* width, int32_t* height, int32_t* columns, int32_t* rows)
+{
+    if (thumbnailer == nullptr || count == nullptr || width == nullptr ||
+        height == nullptr || columns == nullptr || rows == nullptr) return;
+    *count = thumbnailer->GetCount();
+    *width = thumbnailer->GetWidth();
+    *height = thumbnailer->GetHeight();
+    *columns = thumbnailer->GetColumns();
+    *rows = thumbnailer->GetRows();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetThumbnailerProgress(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return 0;
+    return thumbnailer->GetCompletedCount();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DequeueThumbnail(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return -1;
+    return thumbnailer->Dequeue();
+}
+
+extern "C" const void UNITY_INTERFACE_EXPORT *KlakHap_LockThumbnailAtlas(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return nullptr;
+    return thumbnailer->LockAtlas();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_UnlockThumbnailAtlas(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return;
+    thumbnailer->UnlockAtlas();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetThumbnailAtlasSize(Thumbnailer* thumbnailer)
+{
+    if (thumbnailer == nullptr) return 0;
+    return static_cast<int32_t>(thumbnailer->GetAtlasSize());
+}
+
+#pragma endregion
+
+#pragma region Remuxer functions
+
+// Rewrites a clip with another chunk count and/or compressor (synchronous).
+// Returns the number of frames written, or -1 on failure.
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_RemuxFile(const char* source, const char* destination, int32_t chunkCount, int32_t compressor)
+{
+    if (source == nullptr || destination == nullptr) return -1;
+    Remuxer remuxer(source, chunkCount, static_cast<RemuxCompressor>(compressor));
+    if (!remuxer.Run(destination)) return -1;
+    return static_cast<int32_t>(remuxer.GetFrameCount());
+}
+
+#pragma endregion
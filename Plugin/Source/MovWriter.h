@@ -0,0 +1,413 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // QuickTime movie writer for a single video track
+    //
+    // The samples are appended to the media data box one by one, and the
+    // movie box with the sample tables is written at the end. Each sample
+    // is a chunk of its own, so the tables map frames one to one (the same
+    // layout as the common Hap encoders). The file is written into a
+    // temporary file, which replaces the destination on Finish() and is
+    // removed when the writer is destroyed without finishing.
+    //
+    class MovWriter
+    {
+    public:
+
+        #pragma region Track description
+
+        struct SampleEntry
+        {
+            char codec[4];     // e.g. "Hap1"
+            uint16_t width;
+            uint16_t height;
+            uint16_t depth;    // 24 or 32 (with alpha)
+            const char* name;  // Compressor name
+        };
+
+        // Time-to-sample run (the stts entries)
+        struct TimeRun
+        {
+            uint32_t count;
+            uint32_t delta;
+        };
+
+        #pragma endregion
+
+        #pragma region Constructor/destructor
+
+        explicit MovWriter(const std::string& path)
+          : path_(path), temp_(path + ".tmp")
+        {
+            file_ = OpenForWrite(temp_);
+            if (file_ == nullptr) return;
+
+            // File type and the media data header (64-bit size, patched
+            // later)
+            Buffer head;
+            auto ftyp = head.Begin("ftyp");
+            head.Put("qt  ");
+            head.Put32(0x200);
+            head.Put("qt  ");
+            head.End(ftyp);
+
+            mdat_ = head.data.size();
+            head.Put32(1);
+            head.Put("mdat");
+            head.Put64(0);
+
+            position_ = head.data.size();
+            if (fwrite(head.data.data(), 1, head.data.size(), file_) != head.data.size()) Close();
+        }
+
+        ~MovWriter()
+        {
+            if (file_ == nullptr) return;
+            Close();
+            Remove(temp_);
+        }
+
+        MovWriter(const MovWriter&) = delete;
+        MovWriter& operator=(const MovWriter&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        bool IsValid() const
+        {
+            return file_ != nullptr;
+        }
+
+        bool WriteSample(const void* data, size_t size)
+        {
+            if (file_ == nullptr || size > UINT32_MAX) return false;
+            if (fwrite(data, 1, size, file_) != size) return false;
+            offsets_.push_back(position_);
+            sizes_.push_back(static_cast<uint32_t>(size));
+            position_ += size;
+            return true;
+        }
+
+        // Writes the movie box and moves the file to the destination.
+        bool Finish(const SampleEntry& entry, uint32_t timescale, const std::vector<TimeRun>& runs)
+        {
+            if (file_ == nullptr || offsets_.empty()) return false;
+
+            uint64_t duration = 0, count = 0;
+            for (const auto& run : runs)
+            {
+                duration += static_cast<uint64_t>(run.count) * run.delta;
+                count += run.count;
+            }
+            if (count != offsets_.size()) return false;
+
+            // Media data size
+            Buffer size;
+            size.Put64(position_ - mdat_);
+            if (!Seek(file_, mdat_ + 8) || fwrite(size.data.data(), 1, 8, file_) != 8 ||
+                !Seek(file_, position_)) return false;
+
+            auto moov = BuildMovie(entry, timescale, runs, duration);
+            auto written = fwrite(moov.data(), 1, moov.size(), file_) == moov.size();
+            written = fclose(file_) == 0 && written;
+            file_ = nullptr;
+
+            if (!written || !Replace(temp_, path_))
+            {
+                Remove(temp_);
+                return false;
+            }
+
+            return true;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        std::string path_, temp_;
+        FILE* file_ = nullptr;
+        uint64_t mdat_ = 0, position_ = 0;
+        std::vector<uint64_t> offsets_;
+        std::vector<uint32_t> sizes_;
+
+        void Close()
+        {
+            fclose(file_);
+            file_ = nullptr;
+        }
+
+        #pragma endregion
+
+        #pragma region Box builder
+
+        // Big-endian box serializer. Begin() returns the position of a box,
+        // and End() patches its size.
+        struct Buffer
+        {
+            std::vector<uint8_t> data;
+
+            void Put(const char* fourcc) { data.insert(data.end(), fourcc, fourcc + 4); }
+            void Put8(uint32_t x) { data.push_back(static_cast<uint8_t>(x)); }
+            void Put16(uint32_t x) { Put8(x >> 8); Put8(x); }
+            void Put32(uint32_t x) { Put16(x >> 16); Put16(x); }
+            void Put64(uint64_t x) { Put32(static_cast<uint32_t>(x >> 32)); Put32(static_cast<uint32_t>(x)); }
+            void Zero(size_t count) { data.insert(data.end(), count, 0); }
+
+            size_t Begin(const char* type)
+            {
+                auto position = data.size();
+                Put32(0);
+                Put(type);
+                return position;
+            }
+
+            size_t BeginFull(const char* type, uint32_t version, uint32_t flags)
+            {
+                auto position = Begin(type);
+                Put32((version << 24) | flags);
+                return position;
+            }
+
+            void End(size_t position)
+            {
+                auto size = static_cast<uint32_t>(data.size() - position);
+                for (auto i = 0; i < 4; i++) data[position + i] = static_cast<uint8_t>(size >> (24 - i * 8));
+            }
+
+            // Identity transformation matrix
+            void PutMatrix()
+            {
+                const uint32_t matrix[] = {0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000};
+                for (auto x : matrix) Put32(x);
+            }
+
+            // Creation/modification times and durations: 32-bit (version 0)
+            // or 64-bit (version 1) fields
+            void PutTimes(uint32_t version)
+            {
+                if (version == 1) { Put64(0); Put64(0); } else { Put32(0); Put32(0); }
+            }
+
+            void PutDuration(uint32_t version, uint64_t duration)
+            {
+                if (version == 1) Put64(duration); else Put32(static_cast<uint32_t>(duration));
+            }
+        };
+
+        #pragma endregion
+
+        #pragma region Movie box
+
+        std::vector<uint8_t> BuildMovie(const SampleEntry& entry, uint32_t timescale,
+                                        const std::vector<TimeRun>& runs, uint64_t duration) const
+        {
+            Buffer b;
+            auto version = duration > UINT32_MAX ? 1u : 0u;
+            auto count = static_cast<uint32_t>(offsets_.size());
+
+            auto moov = b.Begin("moov");
+
+            auto mvhd = b.BeginFull("mvhd", version, 0);
+            b.PutTimes(version);
+            b.Put32(timescale);
+            b.PutDuration(version, duration);
+            b.Put32(0x10000); // Rate
+            b.Put16(0x100);   // Volume
+            b.Zero(10);
+            b.PutMatrix();
+            b.Zero(24);
+            b.Put32(2);       // Next track ID
+            b.End(mvhd);
+
+            auto trak = b.Begin("trak");
+
+            auto tkhd = b.BeginFull("tkhd", version, 3); // Enabled, in movie
+            b.PutTimes(version);
+            b.Put32(1);       // Track ID
+            b.Put32(0);
+            b.PutDuration(version, duration);
+            b.Zero(8);
+            b.Put16(0);       // Layer
+            b.Put16(0);       // Alternate group
+            b.Put16(0);       // Volume
+            b.Put16(0);
+            b.PutMatrix();
+            b.Put32(static_cast<uint32_t>(entry.width) << 16);
+            b.Put32(static_cast<uint32_t>(entry.height) << 16);
+            b.End(tkhd);
+
+            auto mdia = b.Begin("mdia");
+
+            auto mdhd = b.BeginFull("mdhd", version, 0);
+            b.PutTimes(version);
+            b.Put32(timescale);
+            b.PutDuration(version, duration);
+            b.Put16(0);       // Language
+            b.Put16(0);       // Quality
+            b.End(mdhd);
+
+            auto hdlr = b.BeginFull("hdlr", 0, 0);
+            b.Put("mhlr");
+            b.Put("vide");
+            b.Zero(12);
+            b.Put8(0);        // Empty name
+            b.End(hdlr);
+
+            auto minf = b.Begin("minf");
+
+            auto vmhd = b.BeginFull("vmhd", 0, 1);
+            b.Zero(8);        // Graphics mode, opcolor
+            b.End(vmhd);
+
+            auto dinf = b.Begin("dinf");
+            auto dref = b.BeginFull("dref", 0, 0);
+            b.Put32(1);
+            b.End(b.BeginFull("url ", 0, 1)); // Self-contained
+            b.End(dref);
+            b.End(dinf);
+
+            auto stbl = b.Begin("stbl");
+
+            auto stsd = b.BeginFull("stsd", 0, 0);
+            b.Put32(1);
+            auto sample = b.Begin(entry.codec);
+            b.Zero(6);
+            b.Put16(1);       // Data reference index
+            b.Put16(0);       // Version
+            b.Put16(0);       // Revision
+            b.Zero(4);        // Vendor
+            b.Put32(0);       // Temporal quality
+            b.Put32(0x200);   // Spatial quality
+            b.Put16(entry.width);
+            b.Put16(entry.height);
+            b.Put32(72 << 16);
+            b.Put32(72 << 16);
+            b.Put32(0);       // Data size
+            b.Put16(1);       // Frame count
+            auto length = std::min<size_t>(std::strlen(entry.name), 31);
+            b.Put8(static_cast<uint32_t>(length));
+            b.data.insert(b.data.end(), entry.name, entry.name + length);
+            b.Zero(31 - length);
+            b.Put16(entry.depth);
+            b.Put16(0xffff);  // No color table
+            b.End(sample);
+            b.End(stsd);
+
+            auto stts = b.BeginFull("stts", 0, 0);
+            b.Put32(static_cast<uint32_t>(runs.size()));
+            for (const auto& run : runs) { b.Put32(run.count); b.Put32(run.delta); }
+            b.End(stts);
+
+            auto stsc = b.BeginFull("stsc", 0, 0);
+            b.Put32(1);
+            b.Put32(1);       // First chunk
+            b.Put32(1);       // Samples per chunk
+            b.Put32(1);       // Sample description
+            b.End(stsc);
+
+            auto stsz = b.BeginFull("stsz", 0, 0);
+            b.Put32(0);
+            b.Put32(count);
+            for (auto size : sizes_) b.Put32(size);
+            b.End(stsz);
+
+            auto co64 = position_ > UINT32_MAX;
+            auto stco = b.BeginFull(co64 ? "co64" : "stco", 0, 0);
+            b.Put32(count);
+            for (auto offset : offsets_)
+                if (co64) b.Put64(offset); else b.Put32(static_cast<uint32_t>(offset));
+            b.End(stco);
+
+            b.End(stbl);
+            b.End(minf);
+            b.End(mdia);
+            b.End(trak);
+            b.End(moov);
+
+            return std::move(b.data);
+        }
+
+        #pragma endregion
+
+        #pragma region Platform-dependent implementation
+
+    #ifdef _WIN32
+
+        static std::wstring Widen(const std::string& path)
+        {
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+            if (wlen <= 0) return std::wstring();
+            std::wstring wpath(wlen, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wpath[0], wlen);
+            wpath.resize(wlen - 1);
+            return wpath;
+        }
+
+        static FILE* OpenForWrite(const std::string& path)
+        {
+            FILE* file = nullptr;
+            if (_wfopen_s(&file, Widen(path).c_str(), L"wb") != 0) return nullptr;
+            return file;
+        }
+
+        static bool Seek(FILE* file, uint64_t offset)
+        {
+            return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+        }
+
+        static bool Replace(const std::string& from, const std::string& to)
+        {
+            return MoveFileExW(Widen(from).c_str(), Widen(to).c_str(),
+                               MOVEFILE_REPLACE_EXISTING) != 0;
+        }
+
+        static void Remove(const std::string& path)
+        {
+            _wremove(Widen(path).c_str());
+        }
+
+    #else
+
+        static FILE* OpenForWrite(const std::string& path)
+        {
+            return fopen(path.c_str(), "wb");
+        }
+
+        static bool Seek(FILE* file, uint64_t offset)
+        {
+            return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+        }
+
+        static bool Replace(const std::string& from, const std::string& to)
+        {
+            return std::rename(from.c_str(), to.c_str()) == 0;
+        }
+
+        static void Remove(const std::string& path)
+        {
+            std::remove(path.c_str());
+        }
+
+    #endif
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "mp4demux.h"
+#include "FileReader.h"
+
+namespace KlakHap
+{
+    //
+    // Sample tables paged from the file on demand
+    //
+    // Used for very long clips: Only the sample-to-chunk mapping is kept in
+    // memory, and the sample size/chunk offset tables are read from the file
+    // in pages when a frame is looked up. The page cache is not thread-safe;
+    // lookups have to be serialized by the owner.
+    //
+    // A frame offset is the chunk offset plus the sizes of the preceding
+    // frames in the chunk, which can be the whole clip. To avoid summing
+    // them on every lookup, the last located frame (cursor) and the
+    // offsets of every kPageEntries-th frame passed so far (marks) are
+    // kept, and the sum starts from the closest of them. Sequential lookups
+    // are O(1), and the others are bounded by the mark interval once the
+    // marks are known.
+    //
+    class PagedSampleTable
+    {
+    public:
+
+        #pragma region Global configuration
+
+        // Clips with this many frames or more use paged tables (0 = never).
+        static void SetThreshold(uint32_t frames)
+        {
+            GetThresholdRef() = frames;
+        }
+
+        static uint32_t GetThreshold()
+        {
+            return GetThresholdRef();
+        }
+
+        #pragma endregion
+
+        #pragma region Initialization
+
+        // Takes the table positions from a track parsed with the lazy
+        // tables option.
+        bool Init(const MP4D_track_t& track)
+        {
+            Reset();
+
+            if (track.sample_count == 0) return false;
+            if (track.sample_size == 0 && track.entry_size_pos == 0) return false;
+            if (track.chunk_offset_pos == 0 || track.chunk_count == 0) return false;
+
+            frameCount_ = track.sample_count;
+            chunkCount_ = track.chunk_count;
+            sampleSize_ = track.sample_size;
+            sizeTablePos_ = track.entry_size_pos;
+            offsetTablePos_ = track.chunk_offset_pos;
+            offsetBytes_ = track.chunk_offset_bytes;
+            marks_.assign((frameCount_ + kPageEntries - 1) / kPageEntries, kNoOffset);
+
+            // Chunk runs (the same mapping as MP4D__frame_offset)
+            if (track.chunk_count <= 1 || track.sample_to_chunk_count == 0)
+            {
+                runs_.push_back(ChunkRun{0, 0, frameCount_});
+                return true;
+            }
+
+            uint64_t frame = 0;
+            for (unsigned i = 0; i < track.sample_to_chunk_count && frame < frameCount_; i++)
+            {
+                auto first = i == 0 ? 0u : track.sample_to_chunk[i].first_chunk - 1;
+                auto last = i + 1 < track.sample_to_chunk_count ?
+                    track.sample_to_chunk[i + 1].first_chunk - 1 : chunkCount_;
+                auto perChunk = track.sample_to_chunk[i].samples_per_chunk;
+
+                if (perChunk == 0 || last <= first) continue;
+
+                runs_.push_back(ChunkRun{first, static_cast<uint32_t>(frame), perChunk});
+                frame += static_cast<uint64_t>(last - first) * perChunk;
+            }
+
+            return !runs_.empty();
+        }
+
+        void Reset()
+        {
+            std::vector<ChunkRun>().swap(runs_);
+            std::vector<uint8_t>().swap(sizePage_);
+            std::vector<uint8_t>().swap(offsetPage_);
+            std::vector<uint64_t>().swap(marks_);
+            sizePageBase_ = offsetPageBase_ = kNoPage;
+            cursorFrame_ = kNoPage;
+            frameCount_ = 0;
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        bool IsValid() const
+        {
+            return !runs_.empty();
+        }
+
+        uint32_t GetFrameCount() const
+        {
+            return frameCount_;
+        }
+
+        void Locate(FileReader& file, uint32_t index, uint64_t& offset, uint32_t& size)
+        {
+            offset = 0;
+            size = 0;
+            if (index >= frameCount_) return;
+
+            auto it = std::upper_bound(runs_.begin(), runs_.end(), index,
+                [](uint32_t i, const ChunkRun& run) { return i < run.firstFrame; });
+            if (it == runs_.begin()) return;
+            --it;
+
+            auto chunkInRun = (index - it->firstFrame) / it->framesPerChunk;
+            auto chunk = it->firstChunk + chunkInRun;
+            if (chunk >= chunkCount_) return;
+
+            auto chunkHead = it->firstFrame + chunkInRun * it->framesPerChunk;
+
+            // Fixed frame size (uncommon for HAP)
+            if (sampleSize_ != 0)
+            {
+                offset = GetChunkOffset(file, chunk) + static_cast<uint64_t>(index - chunkHead) * sampleSize_;
+                size = sampleSize_;
+                return;
+            }
+
+            // Starting point of the sum: The chunk head, the closest known
+            // mark in the chunk or the cursor, whichever is the nearest.
+            auto from = chunkHead;
+            auto fromOffset = kNoOffset;
+
+            for (auto m = index / kPageEntries; m * kPageEntries > chunkHead; m--)
+            {
+                if (marks_[m] == kNoOffset) continue;
+                from = m * kPageEntries;
+                fromOffset = marks_[m];
+                break;
+            }
+
+            if (cursorFrame_ != kNoPage && cursorFrame_ >= chunkHead &&
+                cursorFrame_ < chunkHead + it->framesPerChunk)
+            {
+                auto distance = cursorFrame_ > index ? cursorFrame_ - index : index - cursorFrame_;
+                if (distance < index - from)
+                {
+                    from = cursorFrame_;
+                    fromOffset = cursorOffset_;
+                }
+            }
+
+            if (fromOffset == kNoOffset) fromOffset = GetChunkOffset(file, chunk);
+
+            offset = fromOffset;
+            for (auto i = from; i < index; i++)
+            {
+                if (i % kPageEntries == 0) marks_[i / kPageEntries] = offset;
+                offset += GetSize(file, i);
+            }
+            for (auto i = from; i > index; i--) offset -= GetSize(file, i - 1);
+
+            if (index % kPageEntries == 0) marks_[index / kPageEntries] = offset;
+            cursorFrame_ = index;
+            cursorOffset_ = offset;
+
+            size = GetSize(file, index);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        struct ChunkRun
+        {
+            uint32_t firstChunk;
+            uint32_t firstFrame;
+            uint32_t framesPerChunk;
+        };
+
+        static constexpr uint32_t kPageEntries = 1024;
+        static constexpr uint32_t kNoPage = ~0u;
+        static constexpr uint64_t kNoOffset = ~0ull;
+
+        std::vector<ChunkRun> runs_;
+        uint32_t frameCount_ = 0;
+        uint32_t chunkCount_ = 0;
+        uint32_t sampleSize_ = 0;
+        uint64_t sizeTablePos_ = 0;
+        uint64_t offsetTablePos_ = 0;
+        uint32_t offsetBytes_ = 4;
+
+        std::vector<uint8_t> sizePage_, offsetPage_;
+        uint32_t sizePageBase_ = kNoPage, offsetPageBase_ = kNoPage;
+
+        // Lookup starting points (see the class comment)
+        std::vector<uint64_t> marks_;
+        uint32_t cursorFrame_ = kNoPage;
+        uint64_t cursorOffset_ = 0;
+
+        static std::atomic<uint32_t>& GetThresholdRef()
+        {
+            static std::atomic<uint32_t> threshold(0);
+            return threshold;
+        }
+
+        #pragma endregion
+
+        #pragma region Table paging
+
+        // Returns a pointer to a big-endian table entry, reading the page
+        // that contains it when needed.
+        static const uint8_t* FetchEntry(FileReader& file, uint64_t tablePos, uint32_t count,
+                                         uint32_t entryBytes, uint32_t index,
+                                         std::vector<uint8_t>& page, uint32_t& pageBase)
+        {
+            auto base = index / kPageEntries * kPageEntries;
+            if (base != pageBase)
+            {
+                auto entries = std::min(kPageEntries, count - base);
+                page.assign(static_cast<size_t>(entries) * entryBytes, 0);
+                file.ReadRaw(tablePos + static_cast<uint64_t>(base) * entryBytes, page.data(), page.size());
+                pageBase = base;
+            }
+            return page.data() + static_cast<size_t>(index - base) * entryBytes;
+        }
+
+        uint32_t GetSize(FileReader& file, uint32_t index)
+        {
+            if (sampleSize_ != 0) return sampleSize_;
+            auto p = FetchEntry(file, sizeTablePos_, frameCount_, 4, index, sizePage_, sizePageBase_);
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                   (static_cast<uint32_t>(p[2]) <<  8) |  static_cast<uint32_t>(p[3]);
+        }
+
+        uint64_t GetChunkOffset(FileReader& file, uint32_t chunk)
+        {
+            auto p = FetchEntry(file, offsetTablePos_, chunkCount_, offsetBytes_, chunk, offsetPage_, offsetPageBase_);
+            uint64_t value = 0;
+            for (uint32_t i = 0; i < offsetBytes_; i++) value = (value << 8) | p[i];
+            return value;
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include "BlockScaler.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // DXT/BC4 to uncompressed pixel expansion
+    //
+    // Expands compressed blocks into RGBA32, BGRA32, RGB565, RGBA4444 or R8
+    // pixels. The block palettes are converted into the output pixel format
+    // once per block, so each pixel is a palette lookup (plus an OR with
+    // the alpha palette for DXT5) without any per-pixel packing.
+    //
+    // The palettes follow BlockScaler::ColorPalette/AlphaPalette, so the
+    // results match the compressed-domain decoder bit for bit. DXT1 output
+    // is always opaque.
+    //
+    // HAP Q frames are converted from scaled YCoCg into opaque RGB in the
+    // same pass (R8 gives the luma as is).
+    //
+    class PixelExpander
+    {
+    public:
+
+        // Pixel formats (the values are OutputFormat values)
+        enum class Format : int { RGBA32 = 3, BGRA32 = 4, RGB565 = 5, RGBA4444 = 6, R8 = 7 };
+
+        #pragma region Format queries
+
+        // RGB565 drops alpha, so it's only for opaque DXT1. R8 takes the
+        // BC4 channel (the alpha of DXT5 or the BC4 texture).
+        static bool IsSupported(Format format, int typeID)
+        {
+            auto type = typeID & 0xf;
+            auto color = type == 0xb || type == 0xe || type == 0xf;
+            switch (format)
+            {
+            case Format::RGBA32:
+            case Format::BGRA32:
+            case Format::RGBA4444: return color;
+            case Format::RGB565: return type == 0xb;
+            case Format::R8: return type == 0xe || type == 0xf || type == 0x1;
+            }
+            return false;
+        }
+
+        static int GetBytesPerPixel(Format format)
+        {
+            switch (format)
+            {
+            case Format::RGB565:
+            case Format::RGBA4444: return 2;
+            case Format::R8: return 1;
+            default: return 4;
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Expansion operation
+
+        // Expands the block rows [rowBegin, rowEnd) into the pixel rows of
+        // an output image with the given size.
+        static void ExpandRows(Format format, int typeID, const uint8_t* input,
+                               int width, int height, int rowBegin, int rowEnd, uint8_t* output)
+        {
+            switch (format)
+            {
+            case Format::RGBA32: Expand<uint32_t, PackRGBA32>(typeID, input, width, height, rowBegin, rowEnd, output); break;
+            case Format::BGRA32: Expand<uint32_t, PackBGRA32>(typeID, input, width, height, rowBegin, rowEnd, output); break;
+            case Format::RGB565: Expand<uint16_t, PackRGB565>(typeID, input, width, height, rowBegin, rowEnd, output); break;
+            case Format::RGBA4444: Expand<uint16_t, PackRGBA4444>(typeID, input, width, height, rowBegin, rowEnd, output); break;
+            case Format::R8: Expand<uint8_t, PackR8>(typeID, input, width, height, rowBegin, rowEnd, output); break;
+            }
+        }
+
+        // Converts scaled YCoCg pixels (Co, Cg, scale, Y) into opaque RGB in
+        // place (e.g. the block averages of HAP Q).
+        static void ConvertYCoCg(uint8_t* rgba, size_t count)
+        {
+            for (size_t i = 0; i < count; i++, rgba += 4)
+            {
+                const int entry[3] = { rgba[0], rgba[1], rgba[2] };
+                auto chroma = ChromaTerms(entry, 0);
+                int y = rgba[3];
+                for (auto ch = 0; ch < 3; ch++) rgba[ch] = static_cast<uint8_t>(Saturate(y + Lane(chroma, ch)));
+                rgba[3] = 255;
+            }
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Pixel packers
+
+        // Each packer gives the color part (RGB, opaque or zero alpha) and
+        // the alpha part of a pixel, which are ORed together.
+
+        static int Quantize(int value, int max)
+        {
+            auto x = value * max + 127;
+            return (x + 1 + (x >> 8)) >> 8; // x / 255 for x < 65535
+        }
+
+        struct PackRGBA32
+        {
+            static uint32_t Color(const int* c, bool opaque)
+            {
+                return c[0] | (c[1] << 8) | (c[2] << 16) | (opaque ? 0xff000000u : 0);
+            }
+            static uint32_t Alpha(int a) { return static_cast<uint32_t>(a) << 24; }
+        };
+
+        struct PackBGRA32
+        {
+            static uint32_t Color(const int* c, bool opaque)
+            {
+                return c[2] | (c[1] << 8) | (c[0] << 16) | (opaque ? 0xff000000u : 0);
+            }
+            static uint32_t Alpha(int a) { return static_cast<uint32_t>(a) << 24; }
+        };
+
+        struct PackRGB565
+        {
+            static uint16_t Color(const int* c, bool)
+            {
+                return static_cast<uint16_t>((Quantize(c[0], 31) << 11) | (Quantize(c[1], 63) << 5) | Quantize(c[2], 31));
+            }
+            static uint16_t Alpha(int) { return 0; }
+        };
+
+        struct PackRGBA4444
+        {
+            static uint16_t Color(const int* c, bool opaque)
+            {
+                return static_cast<uint16_t>((Quantize(c[0], 15) << 12) | (Quantize(c[1], 15) << 8) |
+                                             (Quantize(c[2], 15) << 4) | (opaque ? 15 : 0));
+            }
+            static uint16_t Alpha(int a) { return static_cast<uint16_t>(Quantize(a, 15)); }
+        };
+
+        struct PackR8
+        {
+            static uint8_t Color(const int*, bool) { return 0; }
+            static uint8_t Alpha(int a) { return static_cast<uint8_t>(a); }
+        };
+
+        #pragma endregion
+
+        #pragma region Expansion kernel
+
+        template <typename T, typename Pack>
+        static void Expand(int typeID, const uint8_t* input,
+                           int width, int height, int rowBegin, int rowEnd, uint8_t* output)
+        {
+            auto format = BlockScaler::GetFormat(typeID);
+
+            if ((typeID & 0xf) == 0xf && sizeof(T) > 1)
+            {
+                ExpandYCoCg<T, Pack>(input, width, height, rowBegin, rowEnd, output);
+                return;
+            }
+
+            // R8 only takes the BC4 channel.
+            auto color = format.hasColor && sizeof(T) > 1;
+            auto alpha = format.alphaChannel >= 0;
+
+            if (color && alpha)
+                ExpandBlocks<T, Pack, true, true>(format, input, width, height, rowBegin, rowEnd, output);
+            else if (color)
+                ExpandBlocks<T, Pack, true, false>(format, input, width, height, rowBegin, rowEnd, output);
+            else
+                ExpandBlocks<T, Pack, false, true>(format, input, width, height, rowBegin, rowEnd, output);
+        }
+
+        template <typename T, typename Pack, bool HasColor, bool HasAlpha>
+        static void ExpandBlocks(const BlockScaler::Format& format, const uint8_t* input,
+                                 int width, int height, int rowBegin, int rowEnd, uint8_t* output)
+        {
+            auto bx = (width + 3) / 4;
+            auto pixels = reinterpret_cast<T*>(output);
+            auto block = input + static_cast<size_t>(rowBegin) * bx * format.blockBytes;
+
+            // Pixel palettes (zero for the unused part)
+            T color[4] = {}, alpha[8] = {};
+
+            for (auto by = rowBegin; by < rowEnd; by++)
+            {
+                auto rows = std::min(4, height - by * 4);
+
+                for (auto x = 0; x < bx; x++, block += format.blockBytes)
+                {
+                    uint32_t colorBits = 0;
+                    uint64_t alphaBits = 0;
+
+                    if (HasAlpha)
+                    {
+                        int palette[8];
+                        BlockScaler::AlphaPalette(block, palette);
+                        for (auto k = 0; k < 8; k++) alpha[k] = Pack::Alpha(palette[k]);
+                        alphaBits = BlockScaler::AlphaIndices(block);
+                    }
+
+                    if (HasColor)
+                    {
+                        auto data = block + format.blockBytes - 8;
+                        ColorPalette<T, Pack>(data, HasAlpha, color);
+                        colorBits = BlockScaler::ColorIndices(data);
+                    }
+
+                    auto columns = std::min(4, width - x * 4);
+                    auto dest = pixels + static_cast<size_t>(by) * 4 * width + x * 4;
+
+                    for (auto y = 0; y < rows; y++, dest += width)
+                    {
+                        auto c = colorBits >> (y * 8);
+                        auto a = static_cast<uint32_t>(alphaBits >> (y * 12));
+                        if (columns == 4)
+                        {
+                            dest[0] = Pixel<T, HasColor, HasAlpha>(color, alpha, c, a);
+                            dest[1] = Pixel<T, HasColor, HasAlpha>(color, alpha, c >> 2, a >> 3);
+                            dest[2] = Pixel<T, HasColor, HasAlpha>(color, alpha, c >> 4, a >> 6);
+                            dest[3] = Pixel<T, HasColor, HasAlpha>(color, alpha, c >> 6, a >> 9);
+                        }
+                        else
+                        {
+                            for (auto i = 0; i < columns; i++)
+                                dest[i] = Pixel<T, HasColor, HasAlpha>(color, alpha, c >> (i * 2), a >> (i * 3));
+                        }
+                    }
+                }
+            }
+        }
+
+        template <typename T, bool HasColor, bool HasAlpha>
+        static T Pixel(const T* color, const T* alpha, uint32_t c, uint32_t a)
+        {
+            if (!HasAlpha) return color[c & 3];
+            if (!HasColor) return alpha[a & 7];
+            return static_cast<T>(color[c & 3] | alpha[a & 7]);
+        }
+
+        // Color palette in the output pixel format (the same values as
+        // BlockScaler::ColorPalette)
+        template <typename T, typename Pack>
+        static void ColorPalette(const uint8_t* block, bool forceFourColor, T* color)
+        {
+            auto c0 = block[0] | (block[1] << 8);
+            auto c1 = block[2] | (block[3] << 8);
+
+            int p[4][3];
+            BlockScaler::Unpack565(c0, p[0]);
+            BlockScaler::Unpack565(c1, p[1]);
+
+            auto opaque = !forceFourColor;
+            if (forceFourColor || c0 > c1)
+            {
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    p[2][ch] = (2 * p[0][ch] + p[1][ch]) / 3;
+                    p[3][ch] = (p[0][ch] + 2 * p[1][ch]) / 3;
+                }
+                color[3] = Pack::Color(p[3], opaque);
+            }
+            else
+            {
+                for (auto ch = 0; ch < 3; ch++) p[2][ch] = (p[0][ch] + p[1][ch]) / 2;
+                const int black[3] = {};
+                color[3] = Pack::Color(black, opaque);
+            }
+
+            color[0] = Pack::Color(p[0], opaque);
+            color[1] = Pack::Color(p[1], opaque);
+            color[2] = Pack::Color(p[2], opaque);
+        }
+
+        #pragma endregion
+
+        #pragma region YCoCg kernel
+
+        // HAP Q: The color block has (Co, Cg, scale) and the alpha block has
+        // Y. The conversion follows CoCgSY2RGB in HapY.shader:
+        //
+        //   s = 1 / (scale * 255 / 8 + 1)
+        //   RGB = (Co - Cg, Cg, -Co - Cg) * s + Y
+        //
+        // The chroma terms only depend on the color index, so they're
+        // computed for the four palette entries of a block, and each pixel
+        // is a saturated add of a luma entry and a chroma entry. The entries
+        // are four 16-bit lanes in the output channel order.
+
+        template <typename T, typename Pack>
+        static void ExpandYCoCg(const uint8_t* input, int width, int height,
+                                int rowBegin, int rowEnd, uint8_t* output)
+        {
+            auto bx = (width + 3) / 4;
+            auto pixels = reinterpret_cast<T*>(output);
+            auto block = input + static_cast<size_t>(rowBegin) * bx * 16;
+            auto red = RedLane(Pack());
+
+            uint64_t luma[8], chroma[4];
+
+            for (auto by = rowBegin; by < rowEnd; by++)
+            {
+                auto rows = std::min(4, height - by * 4);
+
+                for (auto x = 0; x < bx; x++, block += 16)
+                {
+                    int y[8], c[4][4];
+                    BlockScaler::AlphaPalette(block, y);
+                    BlockScaler::ColorPalette(block + 8, true, c);
+
+                    // Luma in the color lanes, opaque alpha
+                    for (auto k = 0; k < 8; k++)
+                        luma[k] = static_cast<uint64_t>(y[k]) * 0x100010001ull | 0xff000000000000ull;
+
+                    for (auto k = 0; k < 4; k++) chroma[k] = ChromaTerms(c[k], red);
+
+                    auto colorBits = BlockScaler::ColorIndices(block + 8);
+                    auto alphaBits = BlockScaler::AlphaIndices(block);
+                    auto columns = std::min(4, width - x * 4);
+                    auto dest = pixels + static_cast<size_t>(by) * 4 * width + x * 4;
+
+                    for (auto r = 0; r < rows; r++, dest += width)
+                    {
+                        auto ci = colorBits >> (r * 8);
+                        auto ai = static_cast<uint32_t>(alphaBits >> (r * 12));
+                        if (columns == 4)
+                        {
+                            YCoCgRow(Pack(), luma, chroma, ci, ai, dest);
+                        }
+                        else
+                        {
+                            T row[4];
+                            YCoCgRow(Pack(), luma, chroma, ci, ai, row);
+                            std::copy(row, row + columns, dest);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Lane of the red channel (BGRA32 swaps red and blue)
+        template <typename Pack>
+        static int RedLane(Pack) { return 0; }
+        static int RedLane(PackBGRA32) { return 2; }
+
+        // 1 / (scale / 8 + 1) in 16-bit fixed point for each scale value
+        static const int32_t* ScaleTable()
+        {
+            static const struct Table
+            {
+                int32_t s[256];
+                Table() { for (auto i = 0; i < 256; i++) s[i] = ((8 << 16) + (i + 8) / 2) / (i + 8); }
+            } table;
+            return table.s;
+        }
+
+        // Chroma terms of a palette entry in 8-bit units (rounded)
+        static uint64_t ChromaTerms(const int* entry, int red)
+        {
+            auto co = entry[0] - 128, cg = entry[1] - 128;
+            auto s = ScaleTable()[entry[2]];
+            auto r = static_cast<uint16_t>(((co - cg) * s + 32768) >> 16);
+            auto g = static_cast<uint16_t>((cg * s + 32768) >> 16);
+            auto b = static_cast<uint16_t>(((-co - cg) * s + 32768) >> 16);
+            return (static_cast<uint64_t>(red == 0 ? r : b)) | (static_cast<uint64_t>(g) << 16) |
+                   (static_cast<uint64_t>(red == 0 ? b : r) << 32);
+        }
+
+        static int Lane(uint64_t entry, int lane)
+        {
+            return static_cast<int16_t>(entry >> (lane * 16));
+        }
+
+        static uint32_t Saturate(int x)
+        {
+            return static_cast<uint32_t>(x < 0 ? 0 : (x > 255 ? 255 : x));
+        }
+
+        // A row of four pixels: The lanes are added and narrowed with
+        // unsigned saturation into RGBA32 (in vector registers where
+        // available), then packed into the output format.
+        template <typename Pack, typename T>
+        static void YCoCgRow(Pack, const uint64_t* luma, const uint64_t* chroma,
+                             uint32_t ci, uint32_t ai, T* dest)
+        {
+            uint32_t rgba[4];
+            YCoCgRow(PackRGBA32(), luma, chroma, ci, ai, rgba);
+            for (auto i = 0; i < 4; i++)
+            {
+                const int rgb[3] = { static_cast<int>(rgba[i] & 0xff), static_cast<int>((rgba[i] >> 8) & 0xff),
+                                     static_cast<int>((rgba[i] >> 16) & 0xff) };
+                dest[i] = Pack::Color(rgb, true);
+            }
+        }
+
+        template <typename Pack>
+        static void YCoCgRow(Pack, const uint64_t* luma, const uint64_t* chroma,
+                             uint32_t ci, uint32_t ai, uint32_t* dest)
+        {
+            const uint64_t c[4] = { chroma[ci & 3], chroma[(ci >> 2) & 3], chroma[(ci >> 4) & 3], chroma[(ci >> 6) & 3] };
+            const uint64_t l[4] = { luma[ai & 7], luma[(ai >> 3) & 7], luma[(ai >> 6) & 7], luma[(ai >> 9) & 7] };
+
+        #if defined(__SSE2__)
+            auto lo = _mm_add_epi16(_mm_set_epi64x(c[1], c[0]), _mm_set_epi64x(l[1], l[0]));
+            auto hi = _mm_add_epi16(_mm_set_epi64x(c[3], c[2]), _mm_set_epi64x(l[3], l[2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_packus_epi16(lo, hi));
+        #elif defined(__ARM_NEON)
+            auto lo = vaddq_s16(vreinterpretq_s16_u64(vcombine_u64(vcreate_u64(c[0]), vcreate_u64(c[1]))),
+                                vreinterpretq_s16_u64(vcombine_u64(vcreate_u64(l[0]), vcreate_u64(l[1]))));
+            auto hi = vaddq_s16(vreinterpretq_s16_u64(vcombine_u64(vcreate_u64(c[2]), vcreate_u64(c[3]))),
+                                vreinterpretq_s16_u64(vcombine_u64(vcreate_u64(l[2]), vcreate_u64(l[3]))));
+            vst1q_u8(reinterpret_cast<uint8_t*>(dest), vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+        #else
+            for (auto i = 0; i < 4; i++)
+            {
+                auto y = Lane(l[i], 0);
+                dest[i] = Saturate(y + Lane(c[i], 0)) | (Saturate(y + Lane(c[i], 1)) << 8) |
+                          (Saturate(y + Lane(c[i], 2)) << 16) | 0xff000000u;
+            }
+        #endif
+        }
+
+        #pragma endregion
+    };
+}
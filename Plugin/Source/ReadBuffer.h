@@ -1,12 +1,39 @@
 #pragma once
 
 #include <stdint.h>
-#include <vector>
+#include <memory>
+#include "FrameBuffer.h"
 
 namespace KlakHap
 {
     struct ReadBuffer
     {
-        std::vector<uint8_t> storage;
+        FrameBuffer storage;
+
+        // Frame data range in the storage. The head can be padded when the
+        // frame was read with an aligned (unbuffered) read.
+        size_t offset = 0;
+        size_t length = 0;
+
+        // Frame data in a memory-mapped file instead of the storage. The
+        // owner keeps the mapping alive while the buffer refers to it.
+        const uint8_t* mapped = nullptr;
+        std::shared_ptr<const void> owner;
+
+        // Range of the Hap chunks whose data is present. A partial read for
+        // a region only contains the header and the chunks covering it.
+        static constexpr uint32_t kAllChunks = ~0u;
+        uint32_t chunkBegin = 0;
+        uint32_t chunkEnd = kAllChunks;
+
+        const uint8_t* data() const { return mapped != nullptr ? mapped : storage.data() + offset; }
+        size_t size() const { return length; }
+
+        // Drops the mapped data before reading into the storage.
+        void Unmap()
+        {
+            mapped = nullptr;
+            owner.reset();
+        }
     };
 }
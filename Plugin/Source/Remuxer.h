@@ -0,0 +1,290 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mp4demux.h"
+#include "hap.h"
+#include "Demuxer.h"
+#include "FileReader.h"
+#include "MovWriter.h"
+#include "ReadBuffer.h"
+#include "WorkerPool.h"
+
+namespace KlakHap
+{
+    //
+    // Second-stage compressor of remuxed frames (the values are shared with
+    // the C API and the HapRemux tool)
+    //
+    enum class RemuxCompressor : int
+    {
+        Snappy = 0,
+        None = 1    // Plain frames without chunks
+    };
+
+    //
+    // HAP clip remuxer
+    //
+    // Rewrites a clip with another chunk count per texture and/or another
+    // second-stage compressor. The frames are decompressed into the DXT
+    // textures and re-encoded with HapEncode, so the texture data is kept
+    // bit for bit. Batches of frames are processed in parallel on the
+    // shared worker pool and written in order into a new movie file with
+    // the same timing. Only the video track is kept.
+    //
+    // HapEncode splits a texture on block boundaries, so the chunk count is
+    // reduced to a divisor of the block count when needed. Zero keeps the
+    // chunk count of the source frames.
+    //
+    class Remuxer
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        Remuxer(const char* source, int chunkCount, RemuxCompressor compressor)
+          : demuxer_(source), chunkCount_(std::max(0, chunkCount)), compressor_(compressor)
+        {
+            if (!demuxer_.IsValid()) return;
+            valid_ = LoadTiming(source);
+        }
+
+        Remuxer(const Remuxer&) = delete;
+        Remuxer& operator=(const Remuxer&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsValid() const
+        {
+            return valid_;
+        }
+
+        uint32_t GetFrameCount() const
+        {
+            return demuxer_.GetFrameCount();
+        }
+
+        int GetCompletedCount() const
+        {
+            return completed_.load();
+        }
+
+        uint64_t GetOutputBytes() const
+        {
+            return outputBytes_;
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        // Stops Run() after the current batch.
+        void Cancel()
+        {
+            canceled_ = true;
+        }
+
+        // Writes the remuxed clip. The destination is only replaced when
+        // all the frames are written.
+        bool Run(const char* destination)
+        {
+            if (!valid_) return false;
+
+            MovWriter writer(destination);
+            if (!writer.IsValid()) return false;
+
+            auto& pool = WorkerPool::GetShared();
+            auto batch = static_cast<int>(pool.GetThreadCount() + 1) * 2;
+            std::vector<Frame> frames(batch);
+
+            auto count = static_cast<int>(demuxer_.GetFrameCount());
+            for (auto first = 0; first < count; first += batch)
+            {
+                if (canceled_) return false;
+
+                auto n = std::min(batch, count - first);
+                pool.ParallelFor(n, [&](int i) { frames[i].valid = Encode(first + i, frames[i]); });
+
+                for (auto i = 0; i < n; i++)
+                {
+                    auto& frame = frames[i];
+                    if (!frame.valid || !writer.WriteSample(frame.output.data(), frame.size)) return false;
+                    outputBytes_ += frame.size;
+                }
+
+                // The sample description follows the first frame.
+                if (first == 0) entry_ = GetSampleEntry(frames[0]);
+
+                completed_ += n;
+            }
+
+            return writer.Finish(entry_, timescale_, runs_);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        // Working storage of a frame (reused between batches)
+        struct Frame
+        {
+            ReadBuffer input;
+            std::vector<uint8_t> textures[2];
+            std::vector<uint8_t> output;
+            unsigned int count = 0;
+            unsigned int formats[2] = {};
+            unsigned long size = 0;
+            bool valid = false;
+        };
+
+        Demuxer demuxer_;
+        int chunkCount_;
+        RemuxCompressor compressor_;
+        bool valid_ = false;
+
+        uint32_t timescale_ = 0;
+        std::vector<MovWriter::TimeRun> runs_;
+        MovWriter::SampleEntry entry_ = {};
+
+        std::atomic<int> completed_{0};
+        std::atomic<bool> canceled_{false};
+        uint64_t outputBytes_ = 0;
+
+        #pragma endregion
+
+        #pragma region Frame conversion
+
+        bool Encode(int index, Frame& frame)
+        {
+            demuxer_.ReadFrame(index, frame.input, false);
+
+            auto data = frame.input.data();
+            auto size = static_cast<unsigned long>(frame.input.size());
+            if (HapGetFrameTextureCount(data, size, &frame.count) != HapResult_No_Error ||
+                frame.count == 0 || frame.count > 2) return false;
+
+            const void* inputs[2];
+            unsigned long lengths[2];
+            unsigned int compressors[2], chunks[2];
+
+            for (auto t = 0u; t < frame.count; t++)
+            {
+                if (HapGetFrameTextureFormat(data, size, t, &frame.formats[t]) != HapResult_No_Error)
+                    return false;
+
+                auto& texture = frame.textures[t];
+                texture.resize(GetTextureSize(frame.formats[t]));
+
+                unsigned int format;
+                if (HapDecode(data, size, t, SerialCallback, nullptr,
+                              texture.data(), static_cast<unsigned long>(texture.size()),
+                              &lengths[t], &format) != HapResult_No_Error) return false;
+
+                int sourceChunks = 1;
+                HapGetFrameTextureChunkCount(data, size, t, &sourceChunks);
+
+                inputs[t] = texture.data();
+                chunks[t] = static_cast<unsigned int>(chunkCount_ > 0 ? chunkCount_ : std::max(1, sourceChunks));
+                compressors[t] = compressor_ == RemuxCompressor::None ? HapCompressorNone : HapCompressorSnappy;
+            }
+
+            auto capacity = HapMaxEncodedLength(frame.count, lengths, frame.formats, chunks);
+            if (capacity == 0) return false;
+            frame.output.resize(capacity);
+
+            return HapEncode(frame.count, inputs, lengths, frame.formats, compressors, chunks,
+                             frame.output.data(), capacity, &frame.size) == HapResult_No_Error;
+        }
+
+        size_t GetTextureSize(unsigned int format) const
+        {
+            auto blocks = static_cast<size_t>((demuxer_.GetWidth() + 3) / 4) * ((demuxer_.GetHeight() + 3) / 4);
+            auto small = format == HapTextureFormat_RGB_DXT1 || format == HapTextureFormat_A_RGTC1;
+            return blocks * (small ? 8 : 16);
+        }
+
+        // Codec type from the texture formats
+        MovWriter::SampleEntry GetSampleEntry(const Frame& frame) const
+        {
+            const char* codec = "Hap1";
+            auto alpha = true;
+
+            if (frame.count == 2)
+                codec = "HapM";
+            else if (frame.formats[0] == HapTextureFormat_RGBA_DXT5)
+                codec = "Hap5";
+            else if (frame.formats[0] == HapTextureFormat_YCoCg_DXT5)
+                codec = "HapY", alpha = false;
+            else if (frame.formats[0] == HapTextureFormat_A_RGTC1)
+                codec = "HapA";
+            else if (frame.formats[0] == HapTextureFormat_RGBA_BPTC_UNORM)
+                codec = "Hap7";
+            else
+                alpha = false;
+
+            MovWriter::SampleEntry entry = {};
+            std::memcpy(entry.codec, codec, 4);
+            entry.width = static_cast<uint16_t>(demuxer_.GetWidth());
+            entry.height = static_cast<uint16_t>(demuxer_.GetHeight());
+            entry.depth = alpha ? 32 : 24;
+            entry.name = "Hap";
+            return entry;
+        }
+
+        static void SerialCallback(HapDecodeWorkFunction work, void* p, unsigned int count, void* info)
+        {
+            for (auto i = 0u; i < count; i++) work(p, i);
+        }
+
+        #pragma endregion
+
+        #pragma region Timing
+
+        // Time scale and sample durations of the video track. The demuxer
+        // only keeps the frame locations, so the timing is read from the
+        // MP4 tables (without loading the sample tables).
+        bool LoadTiming(const char* source)
+        {
+            FileReader file(source);
+            if (!file.IsValid()) return false;
+
+            MP4D_demux_t demux;
+            std::memset(&demux, 0, sizeof(MP4D_demux_t));
+            if (!MP4D__open_ex(&demux, file.GetStdioHandle(), MP4D_OPEN_LAZY_TABLES)) return false;
+
+            const auto& track = demux.track[0];
+            timescale_ = track.timescale;
+
+            uint64_t count = 0;
+            for (auto i = 0u; i < track.time_to_sample_count; i++)
+            {
+                const auto& run = track.time_to_sample[i];
+                runs_.push_back({run.sample_count, run.sample_delta});
+                count += run.sample_count;
+            }
+
+            MP4D__close(&demux);
+
+            // Broken tables: Even durations over the track duration
+            auto frames = demuxer_.GetFrameCount();
+            if (count != frames || timescale_ == 0)
+            {
+                if (timescale_ == 0) timescale_ = 30;
+                auto total = static_cast<uint64_t>(demuxer_.GetDuration() * timescale_ + 0.5);
+                runs_.assign(1, {frames, static_cast<uint32_t>(std::max<uint64_t>(1, total / frames))});
+            }
+
+            return true;
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "mp4demux.h"
+
+namespace KlakHap
+{
+    //
+    // Compact frame table
+    //
+    // Frame sizes and offsets are stored in blocks of 64 frames. Each block
+    // has a base size and a base offset, and the per-frame differences are
+    // bit-packed with the minimum width for the block. When the frames in a
+    // block are stored back to back (the common case with Hap files), the
+    // offsets are implicit and derived from the sizes. Timestamps are
+    // run-length coded.
+    //
+    // The table is a single flat data block, so it can be serialized into
+    // the frame index file and used directly from a memory mapping.
+    //
+    class SampleTable
+    {
+    public:
+
+        #pragma region Data layout
+
+        static constexpr uint32_t kBlockFrames = 64;
+
+        struct Block
+        {
+            uint64_t baseOffset;
+            uint64_t bitPosition;
+            uint32_t baseSize;
+            uint8_t sizeBits;
+            uint8_t offsetBits;
+            uint8_t contiguous; // Implicit offsets (no offset bits)
+            uint8_t reserved;
+        };
+
+        struct Run
+        {
+            uint32_t firstFrame;
+            uint32_t duration;
+            uint64_t timestamp;
+        };
+
+        // Element counts of the data block
+        struct Layout
+        {
+            uint32_t frameCount;
+            uint32_t blockCount;
+            uint32_t runCount;
+            uint32_t reserved;
+            uint64_t wordCount;
+        };
+
+        static uint64_t GetDataSize(const Layout& layout)
+        {
+            return sizeof(Block) * static_cast<uint64_t>(layout.blockCount) +
+                   sizeof(uint64_t) * layout.wordCount +
+                   sizeof(Run) * static_cast<uint64_t>(layout.runCount);
+        }
+
+        #pragma endregion
+
+        #pragma region Constructor/destructor
+
+        SampleTable() = default;
+        SampleTable(const SampleTable&) = delete;
+        SampleTable& operator=(const SampleTable&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsValid() const
+        {
+            return layout_.frameCount > 0;
+        }
+
+        uint32_t GetFrameCount() const
+        {
+            return layout_.frameCount;
+        }
+
+        const Layout& GetLayout() const
+        {
+            return layout_;
+        }
+
+        const void* GetData() const
+        {
+            return blocks_;
+        }
+
+        #pragma endregion
+
+        #pragma region Table construction
+
+        // Builds the table from a frame source, which returns the offset
+        // and the size of each frame in order: next(offset, size)
+        template <typename Source>
+        void Build(uint32_t frameCount, Source next, const std::vector<Run>& runs)
+        {
+            layout_ = Layout{};
+            if (frameCount == 0) return;
+
+            auto blockCount = (frameCount + kBlockFrames - 1) / kBlockFrames;
+            std::vector<Block> blocks(blockCount);
+            std::vector<uint64_t> words;
+            uint64_t bitCount = 0;
+
+            uint64_t offsets[kBlockFrames];
+            uint32_t sizes[kBlockFrames];
+
+            for (uint32_t bi = 0; bi < blockCount; bi++)
+            {
+                auto n = std::min(kBlockFrames, frameCount - bi * kBlockFrames);
+                for (uint32_t k = 0; k < n; k++) next(offsets[k], sizes[k]);
+
+                auto& block = blocks[bi];
+                auto minSize = *std::min_element(sizes, sizes + n);
+                auto maxSize = *std::max_element(sizes, sizes + n);
+
+                auto contiguous = true;
+                for (uint32_t k = 1; k < n && contiguous; k++)
+                    contiguous = offsets[k] == offsets[k - 1] + sizes[k - 1];
+
+                block.bitPosition = bitCount;
+                block.baseSize = minSize;
+                block.sizeBits = BitWidth(maxSize - minSize);
+                block.contiguous = contiguous ? 1 : 0;
+
+                if (contiguous)
+                {
+                    block.baseOffset = offsets[0];
+                    block.offsetBits = 0;
+                }
+                else
+                {
+                    auto minOffset = *std::min_element(offsets, offsets + n);
+                    auto maxOffset = *std::max_element(offsets, offsets + n);
+                    block.baseOffset = minOffset;
+                    block.offsetBits = BitWidth(maxOffset - minOffset);
+                }
+
+                for (uint32_t k = 0; k < n; k++)
+                {
+                    AppendBits(words, bitCount, sizes[k] - minSize, block.sizeBits);
+                    AppendBits(words, bitCount, offsets[k] - block.baseOffset, block.offsetBits);
+                }
+            }
+
+            // Single flat data block: [blocks][bit stream][runs]
+            layout_.frameCount = frameCount;
+            layout_.blockCount = blockCount;
+            layout_.runCount = static_cast<uint32_t>(runs.size());
+            layout_.wordCount = words.size();
+
+            storage_.resize(GetDataSize(layout_) / sizeof(uint64_t));
+            auto p = reinterpret_cast<uint8_t*>(storage_.data());
+            std::copy(blocks.begin(), blocks.end(), reinterpret_cast<Block*>(p));
+            p += sizeof(Block) * blocks.size();
+            std::copy(words.begin(), words.end(), reinterpret_cast<uint64_t*>(p));
+            p += sizeof(uint64_t) * words.size();
+            std::copy(runs.begin(), runs.end(), reinterpret_cast<Run*>(p));
+
+            SetPointers(storage_.data());
+        }
+
+        // Uses an external data block (e.g. a mapped index file) instead of
+        // the own storage. The data has to be 8-byte aligned.
+        bool Attach(const Layout& layout, const void* data, uint64_t size)
+        {
+            if (layout.frameCount == 0 || size != GetDataSize(layout) ||
+                layout.blockCount != (layout.frameCount + kBlockFrames - 1) / kBlockFrames)
+                return false;
+
+            layout_ = layout;
+            SetPointers(data);
+            std::vector<uint64_t>().swap(storage_);
+            return true;
+        }
+
+        // Timestamp runs from the time-to-sample table of a track
+        static std::vector<Run> BuildRuns(const MP4D_track_t& track)
+        {
+            std::vector<Run> runs;
+            uint64_t frame = 0, time = 0;
+
+            for (unsigned i = 0; i < track.time_to_sample_count; i++)
+            {
+                const auto& entry = track.time_to_sample[i];
+                if (entry.sample_count == 0) continue;
+
+                if (runs.empty() || runs.back().duration != entry.sample_delta)
+                    runs.push_back(Run{static_cast<uint32_t>(frame), entry.sample_delta, time});
+
+                frame += entry.sample_count;
+                time += static_cast<uint64_t>(entry.sample_count) * entry.sample_delta;
+            }
+
+            return runs;
+        }
+
+        #pragma endregion
+
+        #pragma region Frame lookup
+
+        void Locate(uint32_t index, uint64_t& offset, uint32_t& size) const
+        {
+            const auto& block = blocks_[index / kBlockFrames];
+            auto k = index % kBlockFrames;
+            auto width = block.sizeBits + block.offsetBits;
+            auto pos = block.bitPosition + static_cast<uint64_t>(k) * width;
+
+            size = block.baseSize + static_cast<uint32_t>(ReadBits(pos, block.sizeBits));
+
+            if (block.contiguous)
+            {
+                // Sum of the preceding frame sizes in the block (< 64 terms)
+                offset = block.baseOffset + static_cast<uint64_t>(k) * block.baseSize;
+                for (uint32_t j = 0; j < k; j++)
+                    offset += ReadBits(block.bitPosition + static_cast<uint64_t>(j) * width, block.sizeBits);
+            }
+            else
+            {
+                offset = block.baseOffset + ReadBits(pos + block.sizeBits, block.offsetBits);
+            }
+        }
+
+        // Upper bound of the frame sizes (from the block headers)
+        uint32_t GetMaxSizeBound() const
+        {
+            uint64_t bound = 0;
+            for (uint32_t i = 0; i < layout_.blockCount; i++)
+            {
+                const auto& block = blocks_[i];
+                bound = std::max(bound, block.baseSize + (uint64_t(1) << block.sizeBits) - 1);
+            }
+            return static_cast<uint32_t>(std::min<uint64_t>(bound, UINT32_MAX));
+        }
+
+        uint64_t GetTimestamp(uint32_t index) const
+        {
+            auto end = runs_ + layout_.runCount;
+            auto it = std::upper_bound(runs_, end, index,
+                [](uint32_t i, const Run& run) { return i < run.firstFrame; });
+            if (it == runs_) return 0;
+            --it;
+            return it->timestamp + static_cast<uint64_t>(index - it->firstFrame) * it->duration;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        Layout layout_ = {};
+        std::vector<uint64_t> storage_;
+        const Block* blocks_ = nullptr;
+        const uint64_t* words_ = nullptr;
+        const Run* runs_ = nullptr;
+
+        void SetPointers(const void* data)
+        {
+            auto p = static_cast<const uint8_t*>(data);
+            blocks_ = reinterpret_cast<const Block*>(p);
+            p += sizeof(Block) * layout_.blockCount;
+            words_ = reinterpret_cast<const uint64_t*>(p);
+            p += sizeof(uint64_t) * layout_.wordCount;
+            runs_ = reinterpret_cast<const Run*>(p);
+        }
+
+        #pragma endregion
+
+        #pragma region Bit packing
+
+        static uint8_t BitWidth(uint64_t x)
+        {
+            uint8_t bits = 0;
+            while (x) { bits++; x >>= 1; }
+            return bits;
+        }
+
+        static void AppendBits(std::vector<uint64_t>& words, uint64_t& count, uint64_t value, unsigned bits)
+        {
+            if (bits == 0) return;
+
+            auto index = static_cast<size_t>(count >> 6);
+            auto shift = static_cast<unsigned>(count & 63);
+            if (words.size() < index + 2) words.resize(index + 2, 0);
+
+            words[index] |= value << shift;
+            if (shift + bits > 64) words[index + 1] |= value >> (64 - shift);
+
+            count += bits;
+        }
+
+        uint64_t ReadBits(uint64_t pos, unsigned bits) const
+        {
+            if (bits == 0) return 0;
+
+            auto index = static_cast<size_t>(pos >> 6);
+            auto shift = static_cast<unsigned>(pos & 63);
+
+            auto value = words_[index] >> shift;
+            if (shift + bits > 64) value |= words_[index + 1] << (64 - shift);
+
+            return bits == 64 ? value : value & ((1ull << bits) - 1);
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,64 @@
+//
+// Snappy built for an instruction set variant
+//
+// Common.mk compiles this file once per variant with KLAKHAP_SNAPPY_NAMESPACE
+// set (e.g. snappy_avx2) and the SNAPPY_HAVE_* switches of the variant. The
+// whole library is put in that namespace, so it can be linked with the
+// baseline build. See CpuDispatch.h for the selection.
+//
+// The instruction set is enabled with a target pragma around the Snappy
+// sources rather than with -m flags for the whole file: The standard
+// library templates instantiated here are emitted as weak symbols shared
+// with the baseline objects, and the linker may keep any of the copies, so
+// they have to be built for the baseline target too.
+//
+
+// Standard and intrinsic headers used by Snappy (outside the pragma)
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <tmmintrin.h>
+
+#if SNAPPY_HAVE_BMI2
+  #if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("avx2,bmi2"))), apply_to = function)
+  #else
+    #pragma GCC push_options
+    #pragma GCC target("avx2,bmi2")
+  #endif
+#else
+  #if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("ssse3"))), apply_to = function)
+  #else
+    #pragma GCC push_options
+    #pragma GCC target("ssse3")
+  #endif
+#endif
+
+#define snappy KLAKHAP_SNAPPY_NAMESPACE
+
+#include "snappy.cc"
+#include "snappy-sinksource.cc"
+#include "snappy-stubs-internal.cc"
+
+#undef snappy
+
+#if defined(__clang__)
+  #pragma clang attribute pop
+#else
+  #pragma GCC pop_options
+#endif
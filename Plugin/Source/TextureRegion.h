@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace KlakHap
+{
+    // Bits per pixel of the texture format in a Hap type ID
+    inline size_t GetBppFromTypeID(int typeID)
+    {
+        switch (typeID & 0xf)
+        {
+        case 0xb: return 4; // DXT1
+        case 0xe: return 8; // DXT5
+        case 0xf: return 8; // DXT5
+        case 0xc: return 8; // BC7
+        case 0x1: return 4; // BC4
+        }
+        return 0;
+    }
+
+    //
+    // Region of interest in a frame
+    //
+    // The rectangle is snapped to the 4x4 block grid of the compressed
+    // texture. Hap chunks are even slices of the texture data, so a band
+    // of block rows maps to a contiguous range of chunks.
+    //
+    struct TextureRegion
+    {
+        int x = 0, y = 0, width = 0, height = 0;
+
+        // An empty region means the whole frame.
+        bool IsFull() const
+        {
+            return width <= 0 || height <= 0;
+        }
+
+        // Snaps a rectangle outward to the block grid and clamps it to the
+        // frame. Returns an empty region when the rectangle covers the
+        // whole frame or nothing at all.
+        static TextureRegion Align(int x, int y, int width, int height,
+                                   int frameWidth, int frameHeight)
+        {
+            TextureRegion r;
+            if (width <= 0 || height <= 0) return r;
+
+            auto w4 = (frameWidth + 3) & ~3, h4 = (frameHeight + 3) & ~3;
+            auto x0 = std::max(0, x) & ~3;
+            auto y0 = std::max(0, y) & ~3;
+            auto x1 = std::min(w4, (x + width + 3) & ~3);
+            auto y1 = std::min(h4, (y + height + 3) & ~3);
+            if (x1 <= x0 || y1 <= y0) return r;
+            if (x0 == 0 && y0 == 0 && x1 == w4 && y1 == h4) return r;
+
+            r.x = x0;
+            r.y = y0;
+            r.width = x1 - x0;
+            r.height = y1 - y0;
+            return r;
+        }
+
+        // Bytes in a block row of the frame
+        static size_t GetRowBytes(int frameWidth, int typeID)
+        {
+            return static_cast<size_t>(frameWidth) * 4 * GetBppFromTypeID(typeID) / 8;
+        }
+
+        // Texture data size of the region
+        size_t GetDataSize(int typeID) const
+        {
+            return static_cast<size_t>(width) * height * GetBppFromTypeID(typeID) / 8;
+        }
+
+        // Range of the chunks that cover the block rows of the region.
+        // Returns false when the texture can't be split by chunks.
+        bool GetChunkRange(int frameWidth, int frameHeight, int typeID, int chunkCount,
+                           uint32_t& firstChunk, uint32_t& count, size_t& chunkBytes) const
+        {
+            auto rowBytes = GetRowBytes(frameWidth, typeID);
+            auto total = rowBytes * ((frameHeight + 3) / 4);
+            if (IsFull() || rowBytes == 0 || chunkCount <= 0 || total % chunkCount != 0)
+                return false;
+
+            chunkBytes = total / chunkCount;
+            auto begin = rowBytes * (y / 4);
+            auto end = rowBytes * ((y + height) / 4);
+            firstChunk = static_cast<uint32_t>(begin / chunkBytes);
+            count = static_cast<uint32_t>((end - 1) / chunkBytes) + 1 - firstChunk;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BlockScaler.h"
+#include "Demuxer.h"
+#include "PixelExpander.h"
+#include "ReadBuffer.h"
+#include "WorkerPool.h"
+#include "hap.h"
+
+namespace KlakHap
+{
+    //
+    // Background thumbnail (scrub strip) generator
+    //
+    // Decodes every Nth frame of a clip on the shared worker pool and
+    // writes RGBA32 thumbnails into an atlas. The thumbnails are reduced in
+    // the compressed domain (block averages), so no full-resolution frame
+    // is ever produced. They're scheduled coarse-to-fine, so a scrub strip
+    // fills in evenly from the start.
+    //
+    // The atlas is stored bottom-up (the Texture2D raw data layout) with
+    // the first thumbnail at the top-left corner. HAP Q thumbnails are
+    // converted from YCoCg to RGB.
+    //
+    class Thumbnailer
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        Thumbnailer(Demuxer& demuxer, int frameStep, int maxWidth, int columns)
+          : demuxer_(demuxer)
+        {
+            auto typeID = static_cast<int>(demuxer.ReadVideoTypeField());
+            if (!demuxer.IsValid() || !BlockScaler::IsSupported(typeID)) return;
+
+            typeID_ = typeID;
+            frameWidth_ = static_cast<int>(demuxer.GetWidth());
+            frameHeight_ = static_cast<int>(demuxer.GetHeight());
+            step_ = std::max(1, frameStep);
+            count_ = static_cast<int>((demuxer.GetFrameCount() + step_ - 1) / step_);
+
+            // Thumbnail size: Block averages, box-reduced to fit the width.
+            BlockScaler::GetScaledSize(DecodeScale::BlockAverage,
+                                       frameWidth_, frameHeight_, blocksX_, blocksY_);
+            reduction_ = std::max(1, (blocksX_ + std::max(1, maxWidth) - 1) / std::max(1, maxWidth));
+            width_ = std::max(1, blocksX_ / reduction_);
+            height_ = std::max(1, blocksY_ / reduction_);
+
+            columns_ = std::max(1, std::min(columns, count_));
+            rows_ = (count_ + columns_ - 1) / columns_;
+            atlas_.assign(static_cast<size_t>(width_) * columns_ * height_ * rows_ * 4, 0);
+
+            // Only a few tasks are kept in the shared queue at a time (each
+            // one queues the next when it finishes), so the other users of
+            // the pool don't wait behind the whole strip.
+            schedule_ = GetSchedule(count_);
+            auto inFlight = std::min<size_t>(WorkerPool::GetShared().GetThreadCount(), schedule_.size());
+            next_ = inFlight;
+            pending_ = static_cast<int>(inFlight);
+            for (size_t i = 0; i < inFlight; i++) EnqueueTask(schedule_[i]);
+        }
+
+        ~Thumbnailer()
+        {
+            Cancel();
+            std::unique_lock<std::mutex> lock(stateLock_);
+            idle_.wait(lock, [this] { return pending_ == 0; });
+        }
+
+        Thumbnailer(const Thumbnailer&) = delete;
+        Thumbnailer& operator=(const Thumbnailer&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        int GetCount() const { return count_; }
+        int GetWidth() const { return width_; }
+        int GetHeight() const { return height_; }
+        int GetColumns() const { return columns_; }
+        int GetRows() const { return rows_; }
+        int GetFrameStep() const { return step_; }
+
+        int GetCompletedCount() const
+        {
+            return completed_.load();
+        }
+
+        bool IsCanceled() const
+        {
+            return canceled_.load();
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        // Stops the remaining tasks (the ones running now still finish).
+        void Cancel()
+        {
+            canceled_ = true;
+        }
+
+        // Index of a completed thumbnail in completion order, or -1 when
+        // nothing new has been completed.
+        int Dequeue()
+        {
+            std::lock_guard<std::mutex> lock(stateLock_);
+            if (done_.empty()) return -1;
+            auto index = done_.front();
+            done_.pop_front();
+            return index;
+        }
+
+        const void* LockAtlas()
+        {
+            atlasLock_.lock();
+            return atlas_.data();
+        }
+
+        void UnlockAtlas()
+        {
+            atlasLock_.unlock();
+        }
+
+        size_t GetAtlasSize() const
+        {
+            return atlas_.size();
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        Demuxer& demuxer_;
+        int typeID_ = 0, frameWidth_ = 0, frameHeight_ = 0;
+        int step_ = 1, count_ = 0, reduction_ = 1;
+        int blocksX_ = 0, blocksY_ = 0, width_ = 0, height_ = 0;
+        int columns_ = 1, rows_ = 0;
+
+        std::vector<uint8_t> atlas_;
+        std::mutex atlasLock_;
+
+        std::atomic<bool> canceled_{false};
+        std::atomic<int> completed_{0};
+        std::deque<int> done_;
+        std::vector<int> schedule_;
+        size_t next_ = 0;
+        int pending_ = 0;
+        std::mutex stateLock_;
+        std::condition_variable idle_;
+
+        // Per-thread working buffers
+        struct Scratch
+        {
+            ReadBuffer frame;
+            std::vector<uint8_t> dxt, blocks;
+            std::unique_ptr<HapDecodeContext, void (*)(HapDecodeContext*)>
+                context{HapCreateDecodeContext(), HapDestroyDecodeContext};
+        };
+
+        static Scratch& GetScratch()
+        {
+            static thread_local Scratch scratch;
+            return scratch;
+        }
+
+        // Coarse-to-fine order: every 2^k-th thumbnail, halving k.
+        static std::vector<int> GetSchedule(int count)
+        {
+            std::vector<int> order;
+            order.reserve(count);
+            std::vector<bool> queued(count, false);
+
+            auto stride = 1;
+            while (stride * 2 < count) stride *= 2;
+
+            for (; stride >= 1; stride /= 2)
+                for (auto i = 0; i < count; i += stride)
+                    if (!queued[i]) { queued[i] = true; order.push_back(i); }
+
+            return order;
+        }
+
+        #pragma endregion
+
+        #pragma region Thumbnail generation
+
+        // The caller counts the task in pending_.
+        void EnqueueTask(int index)
+        {
+            WorkerPool::GetShared().Enqueue([this, index]
+            {
+                // A frame that fails to decode leaves a blank cell but
+                // still counts as completed.
+                auto done = !canceled_;
+                if (done) Generate(index);
+                if (done) completed_++;
+
+                // Hand the slot over to the next thumbnail in the schedule.
+                auto next = -1;
+                {
+                    std::lock_guard<std::mutex> lock(stateLock_);
+                    if (done) done_.push_back(index);
+                    if (!canceled_ && next_ < schedule_.size())
+                        next = schedule_[next_++];
+                    else if (--pending_ == 0)
+                        idle_.notify_all();
+                }
+                if (next >= 0) EnqueueTask(next);
+            });
+        }
+
+        void Generate(int index)
+        {
+            auto& scratch = GetScratch();
+
+            demuxer_.ReadFrame(index * step_, scratch.frame, false);
+
+            auto dxtSize = static_cast<size_t>(blocksX_) * blocksY_ * 16 * GetBppFromTypeID(typeID_) / 8;
+            scratch.dxt.resize(dxtSize);
+
+            unsigned int format;
+            if (HapDecodeWithContext(scratch.context.get(),
+                                     scratch.frame.data(), static_cast<unsigned long>(scratch.frame.size()),
+                                     0, SerialCallback, nullptr,
+                                     scratch.dxt.data(), static_cast<unsigned long>(dxtSize),
+                                     nullptr, &format) != HapResult_No_Error) return;
+
+            scratch.blocks.resize(static_cast<size_t>(blocksX_) * blocksY_ * 4);
+            BlockScaler::Scale(DecodeScale::BlockAverage, typeID_,
+                               scratch.dxt.data(), frameWidth_, frameHeight_, scratch.blocks.data());
+
+            WriteCell(index, scratch.blocks.data());
+        }
+
+        // Box-reduces the block averages into an atlas cell.
+        void WriteCell(int index, const uint8_t* blocks)
+        {
+            auto column = index % columns_;
+            auto row = index / columns_;
+            auto stride = static_cast<size_t>(width_) * columns_ * 4;
+            auto area = reduction_ * reduction_;
+
+            std::lock_guard<std::mutex> lock(atlasLock_);
+
+            for (auto y = 0; y < height_; y++)
+            {
+                // Bottom-up: The top row of the first cell is the last row.
+                auto atlasY = (rows_ - 1 - row) * height_ + (height_ - 1 - y);
+                auto out = atlas_.data() + atlasY * stride + static_cast<size_t>(column) * width_ * 4;
+
+                for (auto x = 0; x < width_; x++, out += 4)
+                {
+                    int sum[4] = {};
+                    for (auto j = 0; j < reduction_; j++)
+                    {
+                        auto p = blocks + (static_cast<size_t>(y * reduction_ + j) * blocksX_ + x * reduction_) * 4;
+                        for (auto i = 0; i < reduction_; i++, p += 4)
+                            for (auto ch = 0; ch < 4; ch++) sum[ch] += p[ch];
+                    }
+
+                    uint8_t rgba[4];
+                    for (auto ch = 0; ch < 4; ch++) rgba[ch] = static_cast<uint8_t>((sum[ch] + area / 2) / area);
+                    ToRGBA(rgba, out);
+                }
+            }
+        }
+
+        void ToRGBA(const uint8_t* in, uint8_t* out) const
+        {
+            switch (typeID_ & 0xf)
+            {
+            case 0xf:
+                // Scaled YCoCg (HAP Q): The same conversion as the shader
+                for (auto ch = 0; ch < 4; ch++) out[ch] = in[ch];
+                PixelExpander::ConvertYCoCg(out, 1);
+                break;
+            case 0x1:
+                // BC4: Grayscale
+                out[0] = out[1] = out[2] = in[0];
+                out[3] = 255;
+                break;
+            default:
+                for (auto ch = 0; ch < 4; ch++) out[ch] = in[ch];
+                break;
+            }
+        }
+
+        static void SerialCallback(HapDecodeWorkFunction work, void* p, unsigned int count, void* info)
+        {
+            for (auto i = 0u; i < count; i++) work(p, i);
+        }
+
+        #pragma endregion
+    };
+}
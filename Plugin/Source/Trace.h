@@ -0,0 +1,247 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // Pipeline tracer
+    //
+    // Records spans of the frame pipeline (frame reads, chunk
+    // decompression, conversion, buffer locks and the render thread
+    // callbacks) into a fixed-size ring and dumps them in the Chrome trace
+    // event format, which chrome://tracing and Perfetto can open.
+    //
+    // Recording is lock-free: A span claims a slot with an atomic counter
+    // and publishes it with a per-slot sequence number. The oldest spans
+    // are overwritten when the ring is full. While tracing is disabled, a
+    // span only costs a load of the enable flag.
+    //
+    class Tracer
+    {
+    public:
+
+        #pragma region Shared instance
+
+        // Process-wide tracer. It's never destroyed, as spans can be
+        // recorded on any thread until the library is unloaded.
+        static Tracer& GetShared()
+        {
+            static auto tracer = new Tracer;
+            return *tracer;
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        static bool IsEnabled()
+        {
+            return GetEnabledRef().load(std::memory_order_acquire);
+        }
+
+        // The ring is allocated on the first enabling and kept afterwards.
+        void SetEnabled(bool enable)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (enable && events_ == nullptr) events_.reset(new Event[kCapacity]);
+            GetEnabledRef().store(enable, std::memory_order_release);
+        }
+
+        // Discards the recorded spans.
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cleared_ = head_.load(std::memory_order_acquire);
+        }
+
+        // Names the calling thread in the dump (e.g. "DecodeRing").
+        void NameThread(const char* name)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            threadNames_[GetThreadID()] = name;
+        }
+
+        static uint64_t Now()
+        {
+            using namespace std::chrono;
+            return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+        }
+
+        // Records a span. The name has to be a string literal (only the
+        // pointer is stored). A negative arg is omitted from the dump.
+        void Record(const char* name, uint64_t begin, uint64_t end, int32_t arg)
+        {
+            if (!IsEnabled()) return;
+
+            auto i = head_.fetch_add(1, std::memory_order_relaxed);
+            auto& e = events_[i & (kCapacity - 1)];
+
+            // Odd sequence = being written
+            e.seq.store(i * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            e.span = Span{name, begin, end, arg, GetThreadID()};
+
+            e.seq.store(i * 2 + 2, std::memory_order_release);
+        }
+
+        // Writes the recorded spans into a JSON file. Returns the number of
+        // the spans written, or -1 on failure.
+        int Dump(const char* path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (events_ == nullptr) return 0;
+
+            auto file = OpenForWrite(path);
+            if (file == nullptr) return -1;
+
+            fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+            auto separator = "";
+            for (auto& pair : threadNames_)
+            {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        separator, pair.first, pair.second.c_str());
+                separator = ",\n";
+            }
+
+            auto count = 0;
+
+            auto head = head_.load(std::memory_order_acquire);
+            auto first = std::max(cleared_, head > kCapacity ? head - kCapacity : 0);
+
+            for (auto i = first; i < head; i++)
+            {
+                // Skip the slots being written or already overwritten.
+                const auto& e = events_[i & (kCapacity - 1)];
+                auto seq = e.seq.load(std::memory_order_acquire);
+                if (seq != i * 2 + 2) continue;
+
+                auto span = e.span;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (e.seq.load(std::memory_order_relaxed) != seq) continue;
+
+                // Timestamps in microseconds
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                        separator, span.name, span.thread,
+                        static_cast<int64_t>(span.begin - origin_) / 1000.0, (span.end - span.begin) / 1000.0);
+                if (span.arg >= 0) fprintf(file, ",\"args\":{\"index\":%d}", span.arg);
+                fputc('}', file);
+                separator = ",\n";
+                count++;
+            }
+
+            fputs("\n]}\n", file);
+            auto ok = ferror(file) == 0;
+            fclose(file);
+            return ok ? count : -1;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        static constexpr uint64_t kCapacity = 1 << 16; // Power of two
+
+        struct Span
+        {
+            const char* name;
+            uint64_t begin, end;
+            int32_t arg;
+            uint32_t thread;
+        };
+
+        struct Event
+        {
+            std::atomic<uint64_t> seq{0};
+            Span span;
+        };
+
+        std::mutex mutex_;
+        std::unique_ptr<Event[]> events_;
+        std::atomic<uint64_t> head_{0};
+        uint64_t cleared_ = 0;
+        uint64_t origin_ = Now();
+        std::map<uint32_t, std::string> threadNames_;
+
+        Tracer() = default;
+
+        static std::atomic<bool>& GetEnabledRef()
+        {
+            static std::atomic<bool> enabled(false);
+            return enabled;
+        }
+
+        // Small sequential thread IDs (readable in the trace viewers)
+        static uint32_t GetThreadID()
+        {
+            static std::atomic<uint32_t> counter(0);
+            static thread_local uint32_t id = ++counter;
+            return id;
+        }
+
+    #if defined(_WIN32)
+
+        static FILE* OpenForWrite(const char* path)
+        {
+            int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+            if (wlen <= 0) return nullptr;
+            std::wstring wpath(wlen, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, path, -1, &wpath[0], wlen);
+            FILE* file = nullptr;
+            if (_wfopen_s(&file, wpath.c_str(), L"wb") != 0) return nullptr;
+            return file;
+        }
+
+    #else
+
+        static FILE* OpenForWrite(const char* path)
+        {
+            return fopen(path, "wb");
+        }
+
+    #endif
+
+        #pragma endregion
+    };
+
+    //
+    // Scoped span: Records the time between construction and destruction.
+    //
+    class TraceScope
+    {
+    public:
+
+        explicit TraceScope(const char* name, int32_t arg = -1)
+          : name_(name), arg_(arg), begin_(Tracer::IsEnabled() ? Tracer::Now() : 0) {}
+
+        ~TraceScope()
+        {
+            if (begin_ != 0) Tracer::GetShared().Record(name_, begin_, Tracer::Now(), arg_);
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+
+        const char* name_;
+        int32_t arg_;
+        uint64_t begin_;
+    };
+}
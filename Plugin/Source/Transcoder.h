@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+#include "AstcBlock.h"
+#include "BlockScaler.h"
+#include "EtcBlock.h"
+#include "PixelExpander.h"
+#include "WorkerPool.h"
+
+namespace KlakHap
+{
+    //
+    // Decoder output format (the values are shared with the C# side)
+    //
+    enum class OutputFormat : int
+    {
+        Default = 0, // The HAP texture format (RGBA32 on mobile platforms)
+        ETC2 = 1,    // ETC2 RGB (DXT1) or ETC2 RGBA8 (DXT5, HAP Q)
+        ASTC = 2,    // ASTC 4x4
+        RGBA32 = 3,  // Uncompressed formats (see PixelExpander)
+        BGRA32 = 4,
+        RGB565 = 5,
+        RGBA4444 = 6,
+        R8 = 7
+    };
+
+    //
+    // Compressed texture transcoder for GPUs without BC support
+    //
+    // Transcodes decoded DXT textures into another output format (ETC2,
+    // ASTC 4x4 or an uncompressed pixel format) block by block. The block
+    // rows are split into bands that run in parallel on the shared worker
+    // pool. This is a pure CPU module, so it's built and tested on every
+    // platform.
+    //
+    class Transcoder
+    {
+    public:
+
+        #pragma region Format queries
+
+        static bool IsUncompressed(OutputFormat format)
+        {
+            return format >= OutputFormat::RGBA32 && format <= OutputFormat::R8;
+        }
+
+        static bool IsSupported(OutputFormat format, int typeID)
+        {
+            if (IsUncompressed(format)) return PixelExpander::IsSupported(ToPixelFormat(format), typeID);
+            if (format != OutputFormat::ETC2 && format != OutputFormat::ASTC) return false;
+            auto type = typeID & 0xf;
+            return type == 0xb || type == 0xe || type == 0xf;
+        }
+
+        // Output buffer size in bytes (compressed textures are padded to
+        // the block grid)
+        static size_t GetBufferSize(OutputFormat format, int typeID, int width, int height)
+        {
+            if (IsUncompressed(format))
+                return static_cast<size_t>(width) * height * PixelExpander::GetBytesPerPixel(ToPixelFormat(format));
+            auto blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+            return blocks * GetOutputBlockBytes(format, typeID);
+        }
+
+        // ASTC blocks are 16 bytes regardless of the alpha channel.
+        static int GetOutputBlockBytes(OutputFormat format, int typeID)
+        {
+            return format == OutputFormat::ASTC ? 16 : BlockScaler::GetFormat(typeID).blockBytes;
+        }
+
+        static PixelExpander::Format ToPixelFormat(OutputFormat format)
+        {
+            return static_cast<PixelExpander::Format>(format);
+        }
+
+        #pragma endregion
+
+        #pragma region Transcoding operation
+
+        static void Transcode(OutputFormat format, int typeID,
+                              const uint8_t* input, int width, int height, uint8_t* output)
+        {
+            auto bx = (width + 3) / 4, by = (height + 3) / 4;
+            auto blockBytes = BlockScaler::GetFormat(typeID).blockBytes;
+            auto outBytes = GetOutputBlockBytes(format, typeID);
+            auto alpha = blockBytes == 16;
+
+            // Bands of block rows (a few per thread for load balancing)
+            auto& pool = WorkerPool::GetShared();
+            auto bands = std::min(by, static_cast<int>(pool.GetThreadCount() + 1) * 4);
+
+            pool.ParallelFor(bands, [=](int band)
+            {
+                if (IsUncompressed(format))
+                {
+                    PixelExpander::ExpandRows(ToPixelFormat(format), typeID, input, width, height,
+                                              by * band / bands, by * (band + 1) / bands, output);
+                    return;
+                }
+
+                auto begin = static_cast<size_t>(by * band / bands) * bx;
+                auto end = static_cast<size_t>(by * (band + 1) / bands) * bx;
+                for (auto i = begin; i < end; i++)
+                {
+                    auto src = input + i * blockBytes;
+                    auto dst = output + i * outBytes;
+                    if (format == OutputFormat::ASTC)
+                    {
+                        if (alpha)
+                            AstcBlock::TranscodeColorAlpha(src, dst);
+                        else
+                            AstcBlock::TranscodeColor(src, dst);
+                    }
+                    else
+                    {
+                        if (alpha) EtcBlock::TranscodeAlpha(src, dst);
+                        EtcBlock::TranscodeColor(src + blockBytes - 8, alpha, dst + blockBytes - 8);
+                    }
+                }
+            });
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.h"
+
+namespace KlakHap
+{
+    //
+    // Fixed-size worker thread pool
+    //
+    // Tasks are run in FIFO order. Owners of queued tasks have to keep the
+    // captured state alive until the tasks finish (or are skipped); the pool
+    // doesn't track them.
+    //
+    class WorkerPool
+    {
+    public:
+
+        #pragma region Shared instance
+
+        // Process-wide pool with a thread per core (minus one for the main
+        // thread). It's intentionally never destroyed, as joining threads
+        // while unloading the library can deadlock on some platforms.
+        static WorkerPool& GetShared()
+        {
+            // hardware_concurrency() returns zero when it's unknown.
+            static auto pool = []
+            {
+                auto n = std::thread::hardware_concurrency();
+                return new WorkerPool(n > 1 ? n - 1 : 1);
+            }();
+            return *pool;
+        }
+
+        #pragma endregion
+
+        #pragma region Constructor/destructor
+
+        explicit WorkerPool(unsigned threadCount)
+        {
+            for (auto i = 0u; i < std::max(1u, threadCount); i++)
+                threads_.emplace_back([this] { WorkerThread(); });
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            for (auto& thread : threads_) thread.join();
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        unsigned GetThreadCount() const
+        {
+            return static_cast<unsigned>(threads_.size());
+        }
+
+        void Enqueue(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.push_back(std::move(task));
+            }
+            wake_.notify_one();
+        }
+
+        // Runs body(0) ... body(count - 1) on the pool and the calling
+        // thread, and returns when all of them are done. The calling thread
+        // takes items too, so it completes even when the pool is busy.
+        void ParallelFor(int count, const std::function<void(int)>& body)
+        {
+            if (count <= 1 || threads_.size() == 0)
+            {
+                for (auto i = 0; i < count; i++) body(i);
+                return;
+            }
+
+            // Shared with the helper tasks, which can start after return
+            // (they find no items left then).
+            struct Job
+            {
+                const std::function<void(int)>* body;
+                int count;
+                std::atomic<int> next{0}, done{0};
+                std::mutex mutex;
+                std::condition_variable finished;
+
+                void Run()
+                {
+                    for (int i; (i = next++) < count;)
+                    {
+                        (*body)(i);
+                        if (++done == count)
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            finished.notify_all();
+                        }
+                    }
+                }
+            };
+
+            auto job = std::make_shared<Job>();
+            job->body = &body;
+            job->count = count;
+
+            auto helpers = std::min<size_t>(threads_.size(), count - 1);
+            for (auto i = 0u; i < helpers; i++) Enqueue([job] { job->Run(); });
+
+            job->Run();
+
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait(lock, [&] { return job->done == count; });
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        std::vector<std::thread> threads_;
+        std::deque<std::function<void()>> queue_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stop_ = false;
+
+        void WorkerThread()
+        {
+            Tracer::GetShared().NameThread("WorkerPool");
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                    if (stop_ && queue_.empty()) return;
+                    task = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+                task();
+            }
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,741 @@
+//
+// Transcoder test: Decodes the test-card clips, transcodes the frames into
+// the output formats and compares the results with the reference PNGs.
+//
+// Usage: TranscoderTest <StreamingAssets/Tests directory>
+//
+
+#include <stdio.h>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <png.h>
+#include "Demuxer.h"
+#include "Transcoder.h"
+#include "hap.h"
+
+using namespace KlakHap;
+
+namespace
+{
+    struct Image
+    {
+        int width = 0, height = 0;
+        std::vector<uint8_t> rgba;
+    };
+
+    #pragma region PNG loader
+
+    bool LoadPng(const std::string& path, Image& image)
+    {
+        png_image png = {};
+        png.version = PNG_IMAGE_VERSION;
+        if (!png_image_begin_read_from_file(&png, path.c_str())) return false;
+        png.format = PNG_FORMAT_RGBA;
+        image.width = static_cast<int>(png.width);
+        image.height = static_cast<int>(png.height);
+        image.rgba.resize(PNG_IMAGE_SIZE(png));
+        return png_image_finish_read(&png, nullptr, image.rgba.data(), 0, nullptr) != 0;
+    }
+
+    #pragma endregion
+
+    #pragma region Reference block decoders
+
+    // DXT blocks to RGBA (through the block scaler's decoder)
+    Image DecodeDxt(int typeID, const uint8_t* data, int width, int height)
+    {
+        Image image{width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+        auto format = BlockScaler::GetFormat(typeID);
+        auto bx = (width + 3) / 4;
+
+        for (auto by = 0; by < (height + 3) / 4; by++)
+        {
+            for (auto x = 0; x < bx; x++)
+            {
+                BlockScaler::Pixels pixels;
+                BlockScaler::DecodeBlock(format, data + (static_cast<size_t>(by) * bx + x) * format.blockBytes, pixels);
+                for (auto i = 0; i < 16; i++)
+                {
+                    auto px = x * 4 + (i & 3), py = by * 4 + (i >> 2);
+                    if (px >= width || py >= height) continue;
+                    auto out = &image.rgba[(static_cast<size_t>(py) * width + px) * 4];
+                    for (auto ch = 0; ch < 4; ch++) out[ch] = pixels[i][ch];
+                }
+            }
+        }
+
+        return image;
+    }
+
+    int Clamp255(int x)
+    {
+        return x < 0 ? 0 : (x > 255 ? 255 : x);
+    }
+
+    // Scaled YCoCg to RGB (CoCgSY2RGB in HapY.shader, in floating point)
+    Image YCoCgToRgb(Image image)
+    {
+        for (size_t i = 0; i < image.rgba.size(); i += 4)
+        {
+            auto p = &image.rgba[i];
+            auto co = (p[0] - 128) / 255.0, cg = (p[1] - 128) / 255.0;
+            auto s = 1 / (p[2] / 8.0 + 1), y = p[3] / 255.0;
+            double rgb[3] = {(co - cg) * s + y, cg * s + y, (-co - cg) * s + y};
+            for (auto ch = 0; ch < 3; ch++) p[ch] = static_cast<uint8_t>(Clamp255(static_cast<int>(std::lround(rgb[ch] * 255))));
+            p[3] = 255;
+        }
+        return image;
+    }
+
+    uint64_t ReadWord(const uint8_t* block)
+    {
+        uint64_t word = 0;
+        for (auto i = 0; i < 8; i++) word = (word << 8) | block[i];
+        return word;
+    }
+
+    // ETC2 RGB block (individual, differential, T and H modes) following
+    // the Khronos specification
+    void DecodeEtc2Color(const uint8_t* block, uint8_t out[16][4])
+    {
+        static const int intensity[8][2] =
+            {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+        static const int distance[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+        auto word = ReadWord(block);
+        auto bits = [&](int hi, int lo) { return static_cast<int>((word >> lo) & ((1ull << (hi - lo + 1)) - 1)); };
+        auto sext3 = [](int x) { return x >= 4 ? x - 8 : x; };
+        auto index = [&](int x, int y) { auto p = x * 4 + y; return (bits(16 + p, 16 + p) << 1) | bits(p, p); };
+
+        auto diff = bits(33, 33);
+        auto r = bits(63, 59) + sext3(bits(58, 56));
+        auto g = bits(55, 51) + sext3(bits(50, 48));
+        auto b = bits(47, 43) + sext3(bits(42, 40));
+
+        if (diff && (r < 0 || r > 31 || g < 0 || g > 31))
+        {
+            int c1[3], c2[3], d, paint[4][3];
+            if (r < 0 || r > 31)
+            {
+                // T mode
+                c1[0] = (bits(60, 59) << 2) | bits(57, 56); c1[1] = bits(55, 52); c1[2] = bits(51, 48);
+                c2[0] = bits(47, 44); c2[1] = bits(43, 40); c2[2] = bits(39, 36);
+                d = distance[(bits(35, 34) << 1) | bits(32, 32)];
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    paint[0][ch] = c1[ch] * 17;
+                    paint[1][ch] = Clamp255(c2[ch] * 17 + d);
+                    paint[2][ch] = c2[ch] * 17;
+                    paint[3][ch] = Clamp255(c2[ch] * 17 - d);
+                }
+            }
+            else
+            {
+                // H mode
+                c1[0] = bits(62, 59); c1[1] = (bits(58, 56) << 1) | bits(52, 52);
+                c1[2] = (bits(51, 51) << 3) | bits(49, 47);
+                c2[0] = bits(46, 43); c2[1] = bits(42, 39); c2[2] = bits(38, 35);
+                auto v1 = (c1[0] << 8) | (c1[1] << 4) | c1[2];
+                auto v2 = (c2[0] << 8) | (c2[1] << 4) | c2[2];
+                d = distance[(bits(34, 34) << 2) | (bits(32, 32) << 1) | (v1 >= v2 ? 1 : 0)];
+                for (auto ch = 0; ch < 3; ch++)
+                {
+                    paint[0][ch] = Clamp255(c1[ch] * 17 + d);
+                    paint[1][ch] = Clamp255(c1[ch] * 17 - d);
+                    paint[2][ch] = Clamp255(c2[ch] * 17 + d);
+                    paint[3][ch] = Clamp255(c2[ch] * 17 - d);
+                }
+            }
+
+            for (auto y = 0; y < 4; y++)
+                for (auto x = 0; x < 4; x++)
+                    for (auto ch = 0; ch < 3; ch++) out[y * 4 + x][ch] = static_cast<uint8_t>(paint[index(x, y)][ch]);
+            return;
+        }
+
+        // The planar mode isn't produced by the transcoder.
+        if (diff && (b < 0 || b > 31))
+        {
+            for (auto i = 0; i < 16; i++) out[i][0] = out[i][1] = out[i][2] = 0;
+            return;
+        }
+
+        int base[2][3];
+        for (auto ch = 0; ch < 3; ch++)
+        {
+            auto shift = 56 - ch * 8;
+            if (diff)
+            {
+                auto c = bits(shift + 7, shift + 3);
+                auto c2 = c + sext3(bits(shift + 2, shift));
+                base[0][ch] = (c << 3) | (c >> 2);
+                base[1][ch] = (c2 << 3) | (c2 >> 2);
+            }
+            else
+            {
+                base[0][ch] = bits(shift + 7, shift + 4) * 17;
+                base[1][ch] = bits(shift + 3, shift) * 17;
+            }
+        }
+
+        int tables[2] = {bits(39, 37), bits(36, 34)};
+        auto flip = bits(32, 32);
+
+        for (auto y = 0; y < 4; y++)
+        {
+            for (auto x = 0; x < 4; x++)
+            {
+                auto sub = (flip ? y : x) >> 1;
+                auto v = index(x, y);
+                auto modifier = intensity[tables[sub]][v & 1] * (v & 2 ? -1 : 1);
+                for (auto ch = 0; ch < 3; ch++)
+                    out[y * 4 + x][ch] = static_cast<uint8_t>(Clamp255(base[sub][ch] + modifier));
+            }
+        }
+    }
+
+    void DecodeEacAlpha(const uint8_t* block, uint8_t out[16][4])
+    {
+        static const int table[16][8] =
+        {
+            {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+            {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+            {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+            {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+            {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+            {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+            {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+            {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+        };
+
+        auto word = ReadWord(block);
+        auto base = static_cast<int>(word >> 56);
+        auto multiplier = static_cast<int>((word >> 52) & 15);
+        auto t = static_cast<int>((word >> 48) & 15);
+
+        for (auto x = 0; x < 4; x++)
+        {
+            for (auto y = 0; y < 4; y++)
+            {
+                auto v = static_cast<int>((word >> (45 - 3 * (x * 4 + y))) & 7);
+                out[y * 4 + x][3] = static_cast<uint8_t>(Clamp255(base + table[t][v] * multiplier));
+            }
+        }
+    }
+
+    Image DecodeEtc2(bool alpha, const uint8_t* data, int width, int height)
+    {
+        Image image{width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+        auto blockBytes = alpha ? 16 : 8;
+        auto bx = (width + 3) / 4;
+
+        for (auto by = 0; by < (height + 3) / 4; by++)
+        {
+            for (auto x = 0; x < bx; x++)
+            {
+                auto block = data + (static_cast<size_t>(by) * bx + x) * blockBytes;
+                uint8_t pixels[16][4];
+                for (auto i = 0; i < 16; i++) pixels[i][3] = 255;
+                if (alpha) DecodeEacAlpha(block, pixels);
+                DecodeEtc2Color(block + blockBytes - 8, pixels);
+
+                for (auto i = 0; i < 16; i++)
+                {
+                    auto px = x * 4 + (i & 3), py = by * 4 + (i >> 2);
+                    if (px >= width || py >= height) continue;
+                    auto out = &image.rgba[(static_cast<size_t>(py) * width + px) * 4];
+                    for (auto ch = 0; ch < 4; ch++) out[ch] = pixels[i][ch];
+                }
+            }
+        }
+
+        return image;
+    }
+
+    // ASTC 4x4 (LDR, single partition, 4x4 weight grids and the integer
+    // sequence encodings with bits and trits)
+
+    struct IseRange { int levels, trits, quints, bits; };
+
+    const IseRange kIseRanges[] =
+    {
+        {2, 0, 0, 1}, {3, 1, 0, 0}, {4, 0, 0, 2}, {5, 0, 1, 0}, {6, 1, 0, 1}, {8, 0, 0, 3},
+        {10, 0, 1, 1}, {12, 1, 0, 2}, {16, 0, 0, 4}, {20, 0, 1, 2}, {24, 1, 0, 3},
+        {32, 0, 0, 5}, {40, 0, 1, 3}, {48, 1, 0, 4}, {64, 0, 0, 6}, {80, 0, 1, 4},
+        {96, 1, 0, 5}, {128, 0, 0, 7}, {160, 0, 1, 5}, {192, 1, 0, 6}, {256, 0, 0, 8}
+    };
+
+    int IseBitCount(const IseRange& range, int count)
+    {
+        return count * range.bits + (range.trits ? (count * 8 + 4) / 5 : 0) +
+                                    (range.quints ? (count * 7 + 2) / 3 : 0);
+    }
+
+    const IseRange* FindIseRange(int levels)
+    {
+        for (const auto& range : kIseRanges) if (range.levels == levels) return &range;
+        return nullptr;
+    }
+
+    // Bit reader (forward from the bottom or reversed from the top)
+    struct AstcBits
+    {
+        const uint8_t* block;
+        bool reversed;
+
+        int Read(int position, int count) const
+        {
+            auto value = 0;
+            for (auto i = 0; i < count; i++)
+            {
+                auto p = reversed ? 127 - (position + i) : position + i;
+                value |= ((block[p >> 3] >> (p & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    void DecodeTritBlock(int t, int* trits)
+    {
+        auto bit = [](int x, int i) { return (x >> i) & 1; };
+        int c;
+        if (((t >> 2) & 7) == 7)
+        {
+            c = (((t >> 5) & 7) << 2) | (t & 3);
+            trits[4] = trits[3] = 2;
+        }
+        else
+        {
+            c = t & 31;
+            if (((t >> 5) & 3) == 3)
+                trits[4] = 2, trits[3] = bit(t, 7);
+            else
+                trits[4] = bit(t, 7), trits[3] = (t >> 5) & 3;
+        }
+        if ((c & 3) == 3)
+            trits[2] = 2, trits[1] = bit(c, 4), trits[0] = (bit(c, 3) << 1) | (bit(c, 2) & (1 - bit(c, 3)));
+        else if (((c >> 2) & 3) == 3)
+            trits[2] = trits[1] = 2, trits[0] = c & 3;
+        else
+            trits[2] = bit(c, 4), trits[1] = (c >> 2) & 3, trits[0] = (bit(c, 1) << 1) | (bit(c, 0) & (1 - bit(c, 1)));
+    }
+
+    // Integer sequence decoding (quints aren't supported)
+    bool DecodeIse(const AstcBits& bits, int position, const IseRange& range, int count, int* values)
+    {
+        if (range.quints) return false;
+
+        if (!range.trits)
+        {
+            for (auto i = 0; i < count; i++) values[i] = bits.Read(position + i * range.bits, range.bits);
+            return true;
+        }
+
+        static const int tritBits[5] = {2, 2, 1, 2, 1};
+        for (auto group = 0; group < count; group += 5)
+        {
+            int m[5] = {}, packed = 0, shift = 0;
+            for (auto i = 0; i < 5 && group + i < count; i++)
+            {
+                m[i] = bits.Read(position, range.bits);
+                position += range.bits;
+                packed |= bits.Read(position, tritBits[i]) << shift;
+                position += tritBits[i];
+                shift += tritBits[i];
+            }
+            int trits[5];
+            DecodeTritBlock(packed, trits);
+            for (auto i = 0; i < 5 && group + i < count; i++)
+                values[group + i] = (trits[i] << range.bits) | m[i];
+        }
+        return true;
+    }
+
+    // Endpoint unquantization (bits and the 48-level trits)
+    int UnquantizeEndpoint(const IseRange& range, int value)
+    {
+        if (!range.trits && !range.quints)
+        {
+            auto v = value << (8 - range.bits);
+            for (auto filled = range.bits; filled < 8; filled += range.bits) v |= v >> range.bits;
+            return v & 0xff;
+        }
+        if (range.levels != 48) return -1;
+        auto bits = value & 15, d = value >> 4;
+        auto a = bits & 1 ? 0x1ff : 0;
+        auto cb = (bits >> 1) & 7;
+        auto t = (d * 22 + ((cb << 6) | cb)) ^ a;
+        return (a & 0x80) | (t >> 2);
+    }
+
+    bool DecodeAstcBlock(const uint8_t* block, uint8_t out[16][4])
+    {
+        AstcBits forward{block, false}, reversed{block, true};
+
+        // Block mode (the layouts with the range bits in bits 0-1)
+        auto mode = forward.Read(0, 11);
+        if ((mode & 3) == 0) return false;
+        auto r = ((mode >> 4) & 1) | ((mode & 3) << 1);
+        auto h = (mode >> 9) & 1, dual = (mode >> 10) & 1;
+        auto a = (mode >> 5) & 3, b = (mode >> 7) & 3;
+        int gw, gh;
+        switch ((mode >> 2) & 3)
+        {
+            case 0: gw = b + 4; gh = a + 2; break;
+            case 1: gw = b + 8; gh = a + 2; break;
+            case 2: gw = a + 2; gh = b + 8; break;
+            default:
+                if ((mode >> 8) & 1) gw = (b & 1) + 2, gh = a + 2;
+                else gw = a + 2, gh = (b & 1) + 6;
+        }
+        if (gw != 4 || gh != 4) return false;
+
+        static const int weightLevels[2][8] = {{0, 0, 2, 3, 4, 5, 6, 8}, {0, 0, 10, 12, 16, 20, 24, 32}};
+        auto weightRange = FindIseRange(weightLevels[h][r]);
+        if (weightRange == nullptr || weightRange->trits || weightRange->quints) return false;
+
+        if (forward.Read(11, 2) != 0) return false; // Single partition only
+        auto cem = forward.Read(13, 4);
+        if (cem != 8 && cem != 12) return false;
+        auto valueCount = cem == 8 ? 6 : 8;
+
+        auto planes = dual + 1;
+        auto weightBits = IseBitCount(*weightRange, 16 * planes);
+        auto colorBits = 128 - 17 - weightBits - (dual ? 2 : 0);
+        auto ccs = dual ? forward.Read(128 - weightBits - 2, 2) : -1;
+
+        // Endpoint range: The largest one that fits
+        const IseRange* colorRange = nullptr;
+        for (const auto& range : kIseRanges)
+            if (IseBitCount(range, valueCount) <= colorBits) colorRange = &range;
+        if (colorRange == nullptr) return false;
+
+        int v[8];
+        if (!DecodeIse(forward, 17, *colorRange, valueCount, v)) return false;
+        for (auto i = 0; i < valueCount; i++)
+            if ((v[i] = UnquantizeEndpoint(*colorRange, v[i])) < 0) return false;
+        if (cem == 8) v[6] = v[7] = 255;
+
+        int e[2][4];
+        if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4])
+        {
+            for (auto ch = 0; ch < 4; ch++) e[0][ch] = v[ch * 2], e[1][ch] = v[ch * 2 + 1];
+        }
+        else
+        {
+            // Swapped endpoints with blue contraction
+            for (auto i = 0; i < 2; i++)
+            {
+                auto s = 1 - i;
+                e[i][0] = (v[s] + v[4 + s]) >> 1;
+                e[i][1] = (v[2 + s] + v[4 + s]) >> 1;
+                e[i][2] = v[4 + s];
+                e[i][3] = v[6 + s];
+            }
+        }
+
+        int weights[32];
+        DecodeIse(reversed, 0, *weightRange, 16 * planes, weights);
+        for (auto i = 0; i < 16 * planes; i++)
+        {
+            auto w = weights[i] << (6 - weightRange->bits);
+            for (auto filled = weightRange->bits; filled < 6; filled += weightRange->bits) w |= w >> weightRange->bits;
+            w &= 63;
+            weights[i] = w > 32 ? w + 1 : w;
+        }
+
+        for (auto i = 0; i < 16; i++)
+        {
+            for (auto ch = 0; ch < 4; ch++)
+            {
+                auto w = dual ? weights[i * 2 + (ch == ccs ? 1 : 0)] : weights[i];
+                auto c = (e[0][ch] * 257 * (64 - w) + e[1][ch] * 257 * w + 32) >> 6;
+                out[i][ch] = static_cast<uint8_t>(c >> 8);
+            }
+        }
+        return true;
+    }
+
+    Image DecodeAstc(const uint8_t* data, int width, int height, bool& valid)
+    {
+        Image image{width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+        auto bx = (width + 3) / 4;
+        valid = true;
+
+        for (auto by = 0; by < (height + 3) / 4; by++)
+        {
+            for (auto x = 0; x < bx; x++)
+            {
+                uint8_t pixels[16][4] = {};
+                valid &= DecodeAstcBlock(data + (static_cast<size_t>(by) * bx + x) * 16, pixels);
+
+                for (auto i = 0; i < 16; i++)
+                {
+                    auto px = x * 4 + (i & 3), py = by * 4 + (i >> 2);
+                    if (px >= width || py >= height) continue;
+                    auto out = &image.rgba[(static_cast<size_t>(py) * width + px) * 4];
+                    for (auto ch = 0; ch < 4; ch++) out[ch] = pixels[i][ch];
+                }
+            }
+        }
+
+        return image;
+    }
+
+    #pragma endregion
+
+    #pragma region Comparison
+
+    // PSNR over the given channels
+    double Psnr(const Image& a, const Image& b, int channels)
+    {
+        if (a.width != b.width || a.height != b.height) return 0;
+        double sum = 0;
+        for (size_t i = 0; i < a.rgba.size(); i += 4)
+        {
+            for (auto ch = 0; ch < channels; ch++)
+            {
+                double d = static_cast<double>(a.rgba[i + ch]) - b.rgba[i + ch];
+                sum += d * d;
+            }
+        }
+        auto mse = sum / (static_cast<double>(a.width) * a.height * channels);
+        return mse == 0 ? 99 : 10 * std::log10(255.0 * 255.0 / mse);
+    }
+
+    #pragma endregion
+
+    void SerialCallback(HapDecodeWorkFunction work, void* p, unsigned int count, void* info)
+    {
+        for (auto i = 0u; i < count; i++) work(p, i);
+    }
+
+    int failures = 0;
+
+    void Check(bool condition, const std::string& message)
+    {
+        printf("%s %s\n", condition ? "PASS" : "FAIL", message.c_str());
+        if (!condition) failures++;
+    }
+
+    #pragma region Test cases
+
+    struct Clip
+    {
+        const char* name;
+        const char* movie;
+        int pngCount;
+        bool ycocg;
+    };
+
+    // Transcoded output vs the DXT output and vs the reference PNGs (HAP Q
+    // frames are in YCoCg, so they're only compared with the DXT output).
+    // ETC2 can't follow saturated color gradients as closely as DXT, so
+    // the thresholds are absolute rather than relative to DXT.
+    const double kMinPsnr = 30;
+
+    void TestFormat(const std::string& root, const Clip& clip, OutputFormat format, const char* formatName)
+    {
+        auto dir = root + "/" + clip.name + "/";
+        Demuxer demuxer((dir + clip.movie).c_str());
+        Check(demuxer.IsValid(), std::string(clip.name) + ": open");
+        if (!demuxer.IsValid()) return;
+
+        auto typeID = static_cast<int>(demuxer.ReadVideoTypeField());
+        auto width = static_cast<int>(demuxer.GetWidth());
+        auto height = static_cast<int>(demuxer.GetHeight());
+        auto alpha = BlockScaler::GetFormat(typeID).blockBytes == 16;
+
+        Check(Transcoder::IsSupported(format, typeID), std::string(clip.name) + ": " + formatName + " supported");
+
+        auto dxtSize = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockScaler::GetFormat(typeID).blockBytes;
+        std::vector<uint8_t> dxt(dxtSize);
+        std::vector<uint8_t> output(Transcoder::GetBufferSize(format, typeID, width, height));
+
+        for (auto frame = 0; frame < clip.pngCount; frame++)
+        {
+            auto label = std::string(clip.name) + " frame " + std::to_string(frame + 1);
+
+            ReadBuffer input;
+            demuxer.ReadFrame(frame, input);
+            unsigned int textureFormat;
+            auto result = HapDecode(input.data(), static_cast<unsigned long>(input.size()), 0, SerialCallback, nullptr,
+                                    dxt.data(), static_cast<unsigned long>(dxt.size()), nullptr, &textureFormat);
+            Check(result == HapResult_No_Error, label + ": decode");
+            if (result != HapResult_No_Error) continue;
+
+            Transcoder::Transcode(format, typeID, dxt.data(), width, height, output.data());
+
+            auto fromDxt = DecodeDxt(typeID, dxt.data(), width, height);
+            Image transcoded;
+            if (format == OutputFormat::ASTC)
+            {
+                bool valid;
+                transcoded = DecodeAstc(output.data(), width, height, valid);
+                Check(valid, label + ": ASTC blocks valid");
+            }
+            else
+            {
+                transcoded = DecodeEtc2(alpha, output.data(), width, height);
+            }
+
+            char text[128];
+            auto channels = alpha ? 4 : 3;
+            auto vsDxt = Psnr(fromDxt, transcoded, channels);
+            snprintf(text, sizeof(text), ": %s vs DXT %.2f dB", formatName, vsDxt);
+            Check(vsDxt > kMinPsnr, label + text);
+
+            if (clip.ycocg) continue;
+
+            Image png;
+            if (!LoadPng(dir + std::string(6 - std::to_string(frame + 1).size(), '0') +
+                         std::to_string(frame + 1) + ".png", png))
+            {
+                Check(false, label + ": PNG load");
+                continue;
+            }
+
+            auto dxtPsnr = Psnr(png, fromDxt, channels);
+            auto psnr = Psnr(png, transcoded, channels);
+            snprintf(text, sizeof(text), ": %s vs PNG %.2f dB (DXT %.2f dB)", formatName, psnr, dxtPsnr);
+            Check(psnr > kMinPsnr, label + text);
+        }
+    }
+
+    // Reference pixel of an uncompressed format from a decoded RGBA pixel
+    uint32_t PackPixel(OutputFormat format, const uint8_t* p, bool opaque)
+    {
+        auto q = [](int v, int max) { return static_cast<uint32_t>((v * max + 127) / 255); };
+        uint32_t a = opaque ? 255 : p[3];
+        switch (format)
+        {
+        case OutputFormat::RGBA32: return p[0] | (p[1] << 8) | (p[2] << 16) | (a << 24);
+        case OutputFormat::BGRA32: return p[2] | (p[1] << 8) | (p[0] << 16) | (a << 24);
+        case OutputFormat::RGB565: return (q(p[0], 31) << 11) | (q(p[1], 63) << 5) | q(p[2], 31);
+        case OutputFormat::RGBA4444: return (q(p[0], 15) << 12) | (q(p[1], 15) << 8) | (q(p[2], 15) << 4) | q(a, 15);
+        default: return a;
+        }
+    }
+
+    // Differences between two packed pixels within a tolerance per channel
+    bool PixelMatches(OutputFormat format, uint32_t a, uint32_t b, int tolerance)
+    {
+        static const int rgba32[] = {8, 8, 8, 8}, rgb565[] = {5, 6, 5}, rgba4444[] = {4, 4, 4, 4}, r8[] = {8};
+        const int* bits = rgba32;
+        auto count = 4;
+        if (format == OutputFormat::RGB565) bits = rgb565, count = 3;
+        if (format == OutputFormat::RGBA4444) bits = rgba4444;
+        if (format == OutputFormat::R8) bits = r8, count = 1;
+
+        for (auto i = 0; i < count; a >>= bits[i], b >>= bits[i], i++)
+        {
+            auto mask = (1u << bits[i]) - 1;
+            if (std::abs(static_cast<int>(a & mask) - static_cast<int>(b & mask)) > tolerance) return false;
+        }
+        return true;
+    }
+
+    // Uncompressed formats: They have to match the DXT output exactly. HAP Q
+    // is converted into RGB, which is compared with the floating-point
+    // conversion (rounding differences of one level allowed) and the PNGs.
+    void TestExpansion(const std::string& root, const Clip& clip, OutputFormat format, const char* formatName)
+    {
+        auto dir = root + "/" + clip.name + "/";
+        Demuxer demuxer((dir + clip.movie).c_str());
+        if (!demuxer.IsValid()) return;
+
+        auto typeID = static_cast<int>(demuxer.ReadVideoTypeField());
+        if (!Transcoder::IsSupported(format, typeID)) return;
+
+        auto width = static_cast<int>(demuxer.GetWidth());
+        auto height = static_cast<int>(demuxer.GetHeight());
+        auto ycocg = clip.ycocg && format != OutputFormat::R8;
+        auto opaque = (typeID & 0xf) == 0xb || ycocg;
+
+        std::vector<uint8_t> dxt(static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) *
+                                 BlockScaler::GetFormat(typeID).blockBytes);
+        auto size = Transcoder::GetBufferSize(format, typeID, width, height);
+        std::vector<uint8_t> output(size);
+        auto bpp = static_cast<int>(size / (static_cast<size_t>(width) * height));
+
+        ReadBuffer input;
+        demuxer.ReadFrame(0, input);
+        unsigned int textureFormat;
+        auto result = HapDecode(input.data(), static_cast<unsigned long>(input.size()), 0, SerialCallback, nullptr,
+                                dxt.data(), static_cast<unsigned long>(dxt.size()), nullptr, &textureFormat);
+        if (result != HapResult_No_Error) return;
+
+        Transcoder::Transcode(format, typeID, dxt.data(), width, height, output.data());
+        auto reference = DecodeDxt(typeID, dxt.data(), width, height);
+        if (ycocg) reference = YCoCgToRgb(reference);
+
+        auto mismatches = 0;
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+        {
+            uint32_t value = 0;
+            for (auto b = 0; b < bpp; b++) value |= static_cast<uint32_t>(output[i * bpp + b]) << (b * 8);
+            if (!PixelMatches(format, value, PackPixel(format, &reference.rgba[i * 4], opaque), ycocg ? 1 : 0)) mismatches++;
+        }
+
+        Check(mismatches == 0, std::string(clip.name) + ": " + formatName + " matches DXT (" +
+                               std::to_string(mismatches) + " mismatches)");
+
+        Image png;
+        if (ycocg && format == OutputFormat::RGBA32 && LoadPng(dir + "000001.png", png))
+        {
+            Image converted;
+            converted.width = width;
+            converted.height = height;
+            converted.rgba = output;
+            char text[64];
+            auto psnr = Psnr(png, converted, 3);
+            snprintf(text, sizeof(text), ": RGB vs PNG %.2f dB", psnr);
+            Check(psnr > kMinPsnr, std::string(clip.name) + text);
+        }
+
+        // Sizes off the block grid (the same blocks, cropped)
+        auto cw = width - 2, ch = height - 1;
+        std::vector<uint8_t> cropped(Transcoder::GetBufferSize(format, typeID, cw, ch));
+        Transcoder::Transcode(format, typeID, dxt.data(), cw, ch, cropped.data());
+
+        mismatches = 0;
+        for (auto y = 0; y < ch; y++)
+            for (auto x = 0; x < cw; x++)
+                for (auto b = 0; b < bpp; b++)
+                    if (cropped[(static_cast<size_t>(y) * cw + x) * bpp + b] !=
+                        output[(static_cast<size_t>(y) * width + x) * bpp + b]) mismatches++;
+
+        Check(mismatches == 0, std::string(clip.name) + ": " + formatName + " cropped to " +
+                               std::to_string(cw) + "x" + std::to_string(ch));
+    }
+
+    #pragma endregion
+}
+
+int main(int argc, char** argv)
+{
+    std::string root = argc > 1 ? argv[1] : "../Assets/StreamingAssets/Tests";
+
+    const Clip clips[] =
+    {
+        {"Hap", "TestCards.mov", 5, false},
+        {"HapAlpha", "HapAlpha.mov", 1, false},
+        {"HapQ", "TestCards.mov", 5, true}
+    };
+
+    for (const auto& clip : clips)
+    {
+        TestFormat(root, clip, OutputFormat::ETC2, "ETC2");
+        TestFormat(root, clip, OutputFormat::ASTC, "ASTC");
+        TestExpansion(root, clip, OutputFormat::RGBA32, "RGBA32");
+        TestExpansion(root, clip, OutputFormat::BGRA32, "BGRA32");
+        TestExpansion(root, clip, OutputFormat::RGB565, "RGB565");
+        TestExpansion(root, clip, OutputFormat::RGBA4444, "RGBA4444");
+        TestExpansion(root, clip, OutputFormat::R8, "R8");
+    }
+
+    printf("%s (%d failures)\n", failures == 0 ? "OK" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,635 @@
+//
+// HapBench: Headless playback benchmark (Linux). Simulates N players driven
+// by a fixed-rate clock through the same read/decode path as HapPlayer and
+// reports whether they sustain the rate.
+//
+// Usage: HapBench [options] clip.mov [clip.mov ...]
+//
+//   -n  Player counts to run, comma separated (default: 1)
+//   -r  Update rate in Hz (default: 60)
+//   -t  Seconds per run (default: 10)
+//   -s  Playback speed (default: 1)
+//   -p  I/O policy (0 Buffered, 1 Prefetch, 2 Streaming, 3 Direct, 4 Mapped)
+//   -a  Decode-ahead frames (default: 0 = stream reader + decoder thread)
+//   -u  Skip the texture upload copy
+//
+// Each player follows HapPlayer.LateUpdate with background decoding: The
+// main thread advances the playhead and hands it to the player's decoder
+// thread (waiting for it to pick the request up, like Decoder.UpdateAsync),
+// and a render thread uploads the outputs (LockBuffer, copy, UnlockBuffer).
+// With -a, the players use the decode-ahead ring instead. The clips are
+// assigned to the players in turn, and their start times are spread over
+// the clips so they don't read the same frames.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "DecodeRing.h"
+#include "Decoder.h"
+#include "Demuxer.h"
+#include "FrameBuffer.h"
+#include "ReadBuffer.h"
+
+using namespace KlakHap;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    struct Options
+    {
+        std::vector<int> counts{1};
+        double rate = 60;
+        double seconds = 10;
+        double speed = 1;
+        int policy = 0;
+        int decodeAhead = 0;
+        bool upload = true;
+        std::vector<const char*> clips;
+    };
+
+    int Usage()
+    {
+        fprintf(stderr, "Usage: HapBench [-n players,...] [-r hz] [-t seconds] [-s speed] [-p policy] [-a frames] [-u] clip.mov [...]\n");
+        return 2;
+    }
+
+    double Seconds(Clock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    //
+    // Stream reader: C++ port of StreamReader.cs. A reader thread keeps a
+    // queue of frames read ahead of the playhead. It reads a frame per
+    // update (poke), like the C# version.
+    //
+    class StreamReader
+    {
+    public:
+
+        struct Entry
+        {
+            ReadBuffer buffer;
+            int frame = -1;
+            double time = 0;
+        };
+
+        StreamReader(Demuxer& demuxer, double time, double delta)
+          : demuxer_(demuxer), time_(time), delta_(delta)
+        {
+            for (auto& entry : entries_) free_.push_back(&entry);
+            thread_ = std::thread([this] { ReaderThread(); });
+        }
+
+        ~StreamReader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            thread_.join();
+        }
+
+        // Returns the frame for a given time when it changed.
+        Entry* Advance(double time)
+        {
+            time += 1e-6;
+            Entry* changed = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                while (!lead_.empty())
+                {
+                    auto peek = lead_.front();
+                    if (current_ != nullptr)
+                    {
+                        if (current_->time <= peek->time)
+                        {
+                            if (time < peek->time) break;
+                        }
+                        else
+                        {
+                            if (current_->time < time) break;
+                        }
+                        free_.push_back(current_);
+                    }
+                    current_ = changed = peek;
+                    lead_.pop_front();
+                }
+                poked_ = true;
+            }
+            wake_.notify_all();
+            return changed;
+        }
+
+    private:
+
+        Demuxer& demuxer_;
+        Entry entries_[4];
+        std::deque<Entry*> lead_;
+        std::vector<Entry*> free_;
+        Entry* current_ = nullptr;
+        double time_, delta_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::thread thread_;
+        bool poked_ = true;
+        bool stop_ = false;
+
+        void ReaderThread()
+        {
+            auto frames = static_cast<int>(demuxer_.GetFrameCount());
+            auto duration = demuxer_.GetDuration();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                wake_.wait(lock, [&] { return stop_ || poked_; });
+                if (stop_) break;
+                poked_ = false;
+                if (free_.empty()) continue;
+
+                auto entry = free_.back();
+                free_.pop_back();
+
+                // Same rounding as StreamReader.cs
+                auto count = static_cast<int>(std::floor(time_ * frames / duration + 1e-3));
+                entry->time = count * duration / frames;
+                entry->frame = (count % frames + frames) % frames;
+                time_ += delta_;
+
+                lock.unlock();
+                demuxer_.ReadFrame(entry->frame, entry->buffer);
+                lock.lock();
+
+                lead_.push_back(entry);
+            }
+        }
+    };
+
+    //
+    // Simulated player
+    //
+    class Player
+    {
+    public:
+
+        Player(const char* path, const Options& options, double startTime)
+          : demuxer_(path), start_(startTime), speed_(options.speed)
+        {
+            if (!demuxer_.IsValid()) return;
+
+            demuxer_.SetIOPolicy(static_cast<IOPolicy>(options.policy));
+            decoder_.reset(new Decoder(demuxer_.GetWidth(), demuxer_.GetHeight(),
+                                       demuxer_.ReadVideoTypeField()));
+            if (options.upload) texture_.resize(decoder_->GetBufferSize());
+
+            auto delta = options.speed / options.rate;
+            if (options.decodeAhead > 0)
+            {
+                ring_.reset(new DecodeRing(demuxer_, *decoder_, options.decodeAhead));
+                ring_->Restart(start_, delta);
+                ring_->Present(start_, true);
+            }
+            else
+            {
+                stream_.reset(new StreamReader(demuxer_, start_, delta));
+
+                // First frame (Decoder.Present/UpdateSync waits for it)
+                StreamReader::Entry* entry;
+                while ((entry = stream_->Advance(start_)) == nullptr)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                decoder_->DecodeFrame(entry->buffer);
+                decoded_ = entry->frame;
+
+                thread_ = std::thread([this] { DecoderThread(); });
+            }
+
+            uploaded_ = version_.load();
+        }
+
+        ~Player()
+        {
+            if (thread_.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                wake_.notify_all();
+                thread_.join();
+            }
+            ring_.reset();
+            stream_.reset();
+        }
+
+        bool IsValid() const
+        {
+            return decoder_ != nullptr;
+        }
+
+        // Main thread update (HapPlayer.LateUpdate)
+        void Update(double time)
+        {
+            if (ring_ != nullptr)
+            {
+                if (ring_->Present(start_ + time, false)) version_++;
+                else if (FrameAt(time) != FrameAt(lastTime_)) late_++;
+                lastTime_ = time;
+                return;
+            }
+
+            // Decoder.UpdateAsync: Hand the time to the decoder thread and
+            // wait for it to pick it up. It's late when the thread is still
+            // decoding the previous frame.
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (busy_) late_++;
+            time_ = time;
+            requested_ = true;
+            wake_.notify_all();
+            picked_.wait(lock, [&] { return !requested_; });
+        }
+
+        // Render thread texture update. Like LockBuffer in the texture
+        // update callback, it waits for the decoding requested by the last
+        // update.
+        void Upload()
+        {
+            if (stream_ != nullptr)
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                idle_.wait(lock, [&] { return !busy_ && !requested_; });
+            }
+
+            // The version is read after the copy, so a frame decoded in the
+            // meantime is counted on the next upload.
+            auto data = decoder_->LockBuffer();
+            if (!texture_.empty()) std::memcpy(texture_.data(), data, texture_.size());
+            decoder_->UnlockBuffer();
+            auto version = version_.load();
+            if (version != uploaded_) shown_++;
+            uploaded_ = version;
+        }
+
+        // Frames the playhead passed over between two times
+        int CountFrames(double from, double to) const
+        {
+            return std::abs(FrameAt(to) - FrameAt(from));
+        }
+
+        // Frames expected to be shown: The ones the playhead passed over,
+        // up to one per update
+        int CountExpected(double elapsed, int updates) const
+        {
+            return std::min(CountFrames(0, elapsed * speed_), updates);
+        }
+
+        int GetShownCount() const { return shown_; }
+        int GetLateCount() const { return late_; }
+
+    private:
+
+        Demuxer demuxer_;
+        std::unique_ptr<Decoder> decoder_;
+        std::unique_ptr<StreamReader> stream_;
+        std::unique_ptr<DecodeRing> ring_;
+        FrameBuffer texture_;
+        double start_, speed_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_, picked_, idle_;
+        std::thread thread_;
+        double time_ = 0;
+        bool requested_ = false;
+        bool busy_ = false;
+        bool stop_ = false;
+
+        std::atomic<int> version_{0}; // Incremented on new frames
+        int decoded_ = -1;
+        int uploaded_ = 0;
+        int shown_ = 0;
+        int late_ = 0;
+        double lastTime_ = 0;
+
+        int FrameAt(double time) const
+        {
+            return static_cast<int>(std::floor((start_ + time) * demuxer_.GetFrameCount() / demuxer_.GetDuration() + 1e-3));
+        }
+
+        // Decoder.DecoderThread
+        void DecoderThread()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                wake_.wait(lock, [&] { return stop_ || requested_; });
+                if (stop_) break;
+
+                auto time = start_ + time_;
+                requested_ = false;
+                busy_ = true;
+                picked_.notify_all();
+                lock.unlock();
+
+                // The same frame can be decoded again (e.g. slow motion).
+                // Only a new frame counts.
+                auto entry = stream_->Advance(time);
+                if (entry != nullptr)
+                {
+                    decoder_->DecodeFrame(entry->buffer);
+                    if (entry->frame != decoded_) version_++;
+                    decoded_ = entry->frame;
+                }
+
+                lock.lock();
+                busy_ = false;
+                idle_.notify_all();
+            }
+        }
+    };
+
+    //
+    // Process statistics (Linux procfs)
+    //
+    struct ProcessStats
+    {
+        double cpu;         // User + system seconds
+        uint64_t readChars; // Bytes read through syscalls (incl. page cache)
+        uint64_t readBytes; // Bytes fetched from storage
+
+        static ProcessStats Capture()
+        {
+            ProcessStats stats = {};
+
+            rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            stats.cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+                        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+
+            if (auto file = fopen("/proc/self/io", "r"))
+            {
+                char key[64];
+                unsigned long long value;
+                while (fscanf(file, "%63[^:]: %llu\n", key, &value) == 2)
+                {
+                    if (std::strcmp(key, "rchar") == 0) stats.readChars = value;
+                    if (std::strcmp(key, "read_bytes") == 0) stats.readBytes = value;
+                }
+                fclose(file);
+            }
+
+            return stats;
+        }
+
+        // Resets the peak RSS to the current RSS (Linux 4.0+).
+        static void ResetPeakRss()
+        {
+            if (auto file = fopen("/proc/self/clear_refs", "w"))
+            {
+                fputs("5", file);
+                fclose(file);
+            }
+        }
+
+        static double GetPeakRssMB()
+        {
+            auto peak = 0.0;
+            if (auto file = fopen("/proc/self/status", "r"))
+            {
+                char line[256];
+                while (fgets(line, sizeof(line), file))
+                    if (std::strncmp(line, "VmHWM:", 6) == 0) peak = atof(line + 6) / 1024;
+                fclose(file);
+            }
+            return peak;
+        }
+    };
+
+    //
+    // Benchmark run with a given player count
+    //
+    class Bench
+    {
+    public:
+
+        explicit Bench(const Options& options)
+          : options_(options) {}
+
+        bool Run(int count)
+        {
+            BufferPool::GetShared().Trim();
+            ProcessStats::ResetPeakRss();
+
+            // Player setup (start times spread over the clips)
+            std::vector<std::unique_ptr<Player>> players;
+            for (auto i = 0; i < count; i++)
+            {
+                auto path = options_.clips[i % options_.clips.size()];
+                Demuxer probe(path);
+                if (!probe.IsValid())
+                {
+                    fprintf(stderr, "Can't open %s\n", path);
+                    return false;
+                }
+                auto start = probe.GetDuration() * i / count;
+                players.emplace_back(new Player(path, options_, start));
+                if (!players.back()->IsValid()) return false;
+            }
+
+            // Render thread: Uploads the outputs once per update.
+            std::mutex renderMutex;
+            std::condition_variable renderWake;
+            uint64_t requestedFrame = 0, renderedFrame = 0;
+            auto renderLate = 0;
+            auto stop = false;
+
+            std::thread render([&]
+            {
+                std::unique_lock<std::mutex> lock(renderMutex);
+                while (true)
+                {
+                    renderWake.wait(lock, [&] { return stop || renderedFrame < requestedFrame; });
+                    if (stop) break;
+                    if (requestedFrame > renderedFrame + 1) renderLate++;
+                    renderedFrame = requestedFrame;
+                    lock.unlock();
+                    for (auto& p : players) p->Upload();
+                    lock.lock();
+                }
+            });
+
+            // Fixed-rate clock
+            auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / options_.rate));
+            auto updates = static_cast<int>(options_.seconds * options_.rate);
+            auto missed = 0;
+
+            auto stats0 = ProcessStats::Capture();
+            auto start = Clock::now();
+            auto next = start;
+
+            for (auto frame = 1; frame <= updates; frame++)
+            {
+                next += period;
+                std::this_thread::sleep_until(next);
+
+                // The playhead follows the clock like Time.time does.
+                auto time = Seconds(Clock::now() - start) * options_.speed;
+                for (auto& p : players) p->Update(time);
+
+                {
+                    std::lock_guard<std::mutex> lock(renderMutex);
+                    requestedFrame = frame;
+                }
+                renderWake.notify_all();
+
+                // Updates that took longer than the period
+                if (Clock::now() > next + period) missed++;
+            }
+
+            auto elapsed = Seconds(Clock::now() - start);
+            auto stats1 = ProcessStats::Capture();
+
+            {
+                std::lock_guard<std::mutex> lock(renderMutex);
+                stop = true;
+            }
+            renderWake.notify_all();
+            render.join();
+
+            // Results: The rate is sustained when every player shows 98%
+            // of the frames expected (give or take a frame at the ends).
+            auto minFps = 1e9, sumFps = 0.0;
+            auto shown = 0, expected = 0, late = 0;
+            auto sustained = true;
+
+            for (auto& p : players)
+            {
+                auto fps = p->GetShownCount() / elapsed;
+                auto pe = p->CountExpected(elapsed, updates);
+                minFps = std::min(minFps, fps);
+                sumFps += fps;
+                shown += p->GetShownCount();
+                expected += pe;
+                late += p->GetLateCount();
+                sustained &= p->GetShownCount() + 1 >= pe * 0.98;
+            }
+
+            auto cpu = (stats1.cpu - stats0.cpu) / elapsed;
+            auto cores = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+            printf("%7d %8.1f %8.1f %8d %8d %6d %6d %7.0f%% %5.0f%% %9.1f %9.1f %9.1f  %s\n",
+                   count, sumFps / count, minFps, shown, std::max(0, expected - shown), late,
+                   missed + renderLate, cpu * 100, cpu * 100 / cores, ProcessStats::GetPeakRssMB(),
+                   (stats1.readChars - stats0.readChars) / 1048576.0 / elapsed,
+                   (stats1.readBytes - stats0.readBytes) / 1048576.0 / elapsed,
+                   sustained ? "OK" : "FAIL");
+            fflush(stdout);
+            return true;
+        }
+
+    private:
+
+        const Options& options_;
+    };
+
+    const char* GetPolicyName(int policy)
+    {
+        static const char* names[] = { "Buffered", "Prefetch", "Streaming", "Direct", "Mapped" };
+        return names[policy];
+    }
+
+    const char* GetCodecName(int videoType)
+    {
+        switch (videoType & 0xf)
+        {
+        case 0xb: return "HAP";
+        case 0xe: return "HAP Alpha";
+        case 0xf: return "HAP Q";
+        case 0xc: return "HAP R";
+        case 0x1: return "HAP Alpha-Only";
+        }
+        return "unsupported";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    for (auto i = 1; i < argc; i++)
+    {
+        auto arg = argv[i];
+        auto hasValue = i + 1 < argc;
+
+        if (std::strcmp(arg, "-n") == 0 && hasValue)
+        {
+            options.counts.clear();
+            for (auto p = argv[++i]; *p != 0;)
+            {
+                auto count = static_cast<int>(strtol(p, &p, 10));
+                if (count < 1) return Usage();
+                options.counts.push_back(count);
+                if (*p == ',') p++; else if (*p != 0) return Usage();
+            }
+        }
+        else if (std::strcmp(arg, "-r") == 0 && hasValue)
+            options.rate = atof(argv[++i]);
+        else if (std::strcmp(arg, "-t") == 0 && hasValue)
+            options.seconds = atof(argv[++i]);
+        else if (std::strcmp(arg, "-s") == 0 && hasValue)
+            options.speed = atof(argv[++i]);
+        else if (std::strcmp(arg, "-p") == 0 && hasValue)
+            options.policy = atoi(argv[++i]);
+        else if (std::strcmp(arg, "-a") == 0 && hasValue)
+            options.decodeAhead = atoi(argv[++i]);
+        else if (std::strcmp(arg, "-u") == 0)
+            options.upload = false;
+        else if (arg[0] != '-')
+            options.clips.push_back(arg);
+        else
+            return Usage();
+    }
+
+    if (options.clips.empty() || options.rate <= 0 || options.seconds <= 0 || options.speed <= 0 ||
+        options.policy < 0 || options.policy > static_cast<int>(IOPolicy::Mapped) ||
+        options.decodeAhead < 0 || options.decodeAhead > 16) return Usage();
+
+    for (auto path : options.clips)
+    {
+        Demuxer demuxer(path);
+        if (!demuxer.IsValid())
+        {
+            fprintf(stderr, "Can't open %s\n", path);
+            return 1;
+        }
+        printf("%s: %ux%u %s, %u frames, %.2f fps\n", path, demuxer.GetWidth(), demuxer.GetHeight(),
+               GetCodecName(demuxer.ReadVideoTypeField()), demuxer.GetFrameCount(),
+               demuxer.GetFrameCount() / demuxer.GetDuration());
+    }
+
+    printf("%.0f Hz, %.0f s per run, speed %.2f, %s I/O, %s, %u cores\n",
+           options.rate, options.seconds, options.speed, GetPolicyName(options.policy),
+           options.decodeAhead > 0 ? "decode-ahead" : "stream reader",
+           static_cast<unsigned>(sysconf(_SC_NPROCESSORS_ONLN)));
+    printf("players  avg fps  min fps    shown  dropped   late missed     cpu  mach  peak RSS   read/s    disk/s\n");
+    printf("                                                                       (MB)      (MB)      (MB)\n");
+
+    Bench bench(options);
+    for (auto count : options.counts)
+        if (!bench.Run(count)) return 1;
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+//
+// HapRemux: Rewrites a HAP clip with another chunk count per texture and/or
+// another second-stage compressor (see Remuxer.h).
+//
+// Usage: HapRemux [-c chunks] [-z snappy|none] input.mov output.mov
+//
+//   -c  Chunk count per texture (default: the source chunk count)
+//   -z  Second-stage compressor (default: snappy)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cstring>
+#include "Remuxer.h"
+
+using namespace KlakHap;
+
+namespace
+{
+    int Usage()
+    {
+        fprintf(stderr, "Usage: HapRemux [-c chunks] [-z snappy|none] input.mov output.mov\n");
+        return 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto chunks = 0;
+    auto compressor = RemuxCompressor::Snappy;
+    const char* paths[2] = {};
+    auto pathCount = 0;
+
+    for (auto i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            chunks = atoi(argv[++i]);
+            if (chunks < 1) return Usage();
+        }
+        else if (std::strcmp(argv[i], "-z") == 0 && i + 1 < argc)
+        {
+            auto name = argv[++i];
+            if (std::strcmp(name, "snappy") == 0)
+                compressor = RemuxCompressor::Snappy;
+            else if (std::strcmp(name, "none") == 0)
+                compressor = RemuxCompressor::None;
+            else
+                return Usage();
+        }
+        else if (argv[i][0] != '-' && pathCount < 2)
+        {
+            paths[pathCount++] = argv[i];
+        }
+        else
+        {
+            return Usage();
+        }
+    }
+
+    if (pathCount != 2) return Usage();
+
+    auto start = std::chrono::steady_clock::now();
+
+    Remuxer remuxer(paths[0], chunks, compressor);
+    if (!remuxer.IsValid())
+    {
+        fprintf(stderr, "Can't open %s\n", paths[0]);
+        return 1;
+    }
+
+    if (!remuxer.Run(paths[1]))
+    {
+        fprintf(stderr, "Failed to remux %s (frame %d)\n", paths[0], remuxer.GetCompletedCount());
+        return 1;
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %u frames, %.1f MB in %.2f s (%.0f fps)\n", paths[1], remuxer.GetFrameCount(),
+           remuxer.GetOutputBytes() / 1048576.0, seconds, remuxer.GetFrameCount() / seconds);
+    return 0;
+}